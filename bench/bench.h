@@ -0,0 +1,30 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+
+// Runs fn repeatedly for at least min_seconds and returns seconds per call
+template <typename Fn>
+double measure(Fn &&fn, double min_seconds = 0.5)
+{
+	using clock = std::chrono::steady_clock;
+
+	fn(); // Warm up caches
+	uint64_t iterations = 0;
+	auto start = clock::now();
+	double elapsed = 0.0;
+	do
+	{
+		fn();
+		iterations++;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	} while (elapsed < min_seconds);
+
+	return elapsed / iterations;
+}
+
+#define REPORT(name, value, unit) std::printf("%-48s %14.2f %s\n", name, value, unit)
+
+// Benchmark suites
+void bench_ppu();
+void bench_apu();
+void bench_bus();
@@ -0,0 +1,190 @@
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "bench.h"
+#include "core/apu.h"
+#include "core/blip_buffer.h"
+#include "core/audio_ring.h"
+#include "core/audio_renderer.h"
+#include "core/audio_recorder.h"
+#include "core/expansion_audio.h"
+#include "core/cpu_features.h"
+
+static constexpr uint64_t FRAME_CYCLES = 29781; // CPU cycles per NTSC video frame
+
+// Every channel playing: two pulses, triangle, noise and a looping DMC sample
+static void setup_channels(APU &apu)
+{
+	apu.cpu_write(0, 0x4015, 0x0F);
+	apu.cpu_write(0, 0x4000, 0xBF);
+	apu.cpu_write(0, 0x4002, 0xFD);
+	apu.cpu_write(0, 0x4003, 0x00);
+	apu.cpu_write(0, 0x4004, 0x7F);
+	apu.cpu_write(0, 0x4006, 0x7E);
+	apu.cpu_write(0, 0x4007, 0x00);
+	apu.cpu_write(0, 0x4008, 0xFF);
+	apu.cpu_write(0, 0x400A, 0x40);
+	apu.cpu_write(0, 0x400B, 0x00);
+	apu.cpu_write(0, 0x400C, 0x3F);
+	apu.cpu_write(0, 0x400E, 0x03);
+	apu.cpu_write(0, 0x400F, 0x00);
+	apu.cpu_write(0, 0x4010, 0x4F);
+	apu.cpu_write(0, 0x4013, 0x10);
+	apu.cpu_write(0, 0x4015, 0x1F);
+}
+
+// One video frame of a music engine: a few register writes, then the frame's samples
+static double run_frames(APU &apu)
+{
+	uint64_t cycle = 0;
+	std::vector<int16_t> samples(4096);
+	return measure([&] {
+		for (int i = 0; i < 4; i++)
+			apu.cpu_write(cycle + i * (FRAME_CYCLES / 4), 0x4002, static_cast<uint8_t>(0xFD - i * 16));
+		cycle += FRAME_CYCLES;
+		apu.end_frame(cycle);
+		apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+	});
+}
+
+// Resampler alone: a block of dense steps (one every 18 clocks, a pulse at its
+// highest pitch plus noise) filtered and read back as 48 kHz samples
+static void bench_resampler()
+{
+	const char *quality_names[3] = {"low", "medium", "high"};
+	const uint32_t block = 7457;
+	SimdPath original = get_kernel_path(Kernel::RESAMPLER);
+
+	for (SimdPath path : {SimdPath::SCALAR, SimdPath::AVX2})
+	{
+		if (!set_kernel_path(Kernel::RESAMPLER, path))
+			continue;
+		for (int level = 0; level < 3; level++)
+		{
+			BlipBuffer blip;
+			blip.set_quality(static_cast<BlipBuffer::Quality>(level));
+			blip.set_rates(APU::CLOCK_RATE, 48000, 4096);
+			std::vector<float> samples(4096);
+			double seconds = measure([&] {
+				float delta = 0.05f;
+				for (uint32_t t = 0; t < block; t += 18, delta = -delta)
+					blip.add_delta(t, delta);
+				blip.end_block(block);
+				blip.read_samples(samples.data(), blip.samples_available());
+			});
+
+			char name[64];
+			std::snprintf(name, sizeof(name), "apu: resampler %s, %s", quality_names[level], simd_path_name(path));
+			REPORT(name, block * 48000.0 / APU::CLOCK_RATE / seconds / 1e6, "Msamples/s");
+		}
+	}
+	set_kernel_path(Kernel::RESAMPLER, original);
+}
+
+// Ring hand-off cost on the emulation thread: one frame of samples in, then out
+static void bench_ring()
+{
+	AudioRing ring(9600);
+	std::vector<int16_t> samples(800, 1);
+	double seconds = measure([&] {
+		ring.write(samples.data(), static_cast<int>(samples.size()));
+		ring.read(samples.data(), static_cast<int>(samples.size()));
+	});
+	REPORT("audio: ring write + read of one frame", seconds * 1e9 / samples.size(), "ns/sample");
+}
+
+// Capture to /dev/null: synthesis plus the hand-off, at 48 kHz and at the native rate
+static void bench_capture()
+{
+	for (uint32_t rate : {48000u, static_cast<uint32_t>(APU::CLOCK_RATE)})
+	{
+		APU apu;
+		apu.set_sample_rate(rate);
+		setup_channels(apu);
+		AudioRecorder recorder;
+		recorder.open("/dev/null", rate, AudioRecorder::Format::RAW);
+
+		uint64_t cycle = 0;
+		double seconds = measure([&] {
+			cycle += FRAME_CYCLES;
+			apu.end_frame(cycle);
+			recorder.push(apu);
+		});
+		recorder.close();
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "audio: capture at %u Hz", rate);
+		REPORT(name, seconds * 1e6, "us/frame");
+	}
+}
+
+// Namco 163 with all eight channels: one channel update every 15 cycles on top of the 2A03
+static void bench_expansion()
+{
+	APU apu;
+	setup_channels(apu);
+	Namco163Audio chip;
+	apu.set_expansion(&chip);
+	apu.write_expansion(0, 0xF800, 0x80);
+	for (int i = 0; i < 32; i++)
+		apu.write_expansion(0, 0x4800, static_cast<uint8_t>(i * 0x11 + 0x37));
+	apu.write_expansion(0, 0xF800, 0x80 | 0x40);
+	for (int channel = 0; channel < 8; channel++)
+	{
+		uint8_t registers[8] = {static_cast<uint8_t>(0x40 + channel * 9), 0x00, 0x10, 0x00, 0xC0, 0x00, 0x00, 0x7F};
+		for (uint8_t data : registers)
+			apu.write_expansion(0, 0x4800, data);
+	}
+	double seconds = run_frames(apu);
+	REPORT("apu: all channels + namco 163, 8 channels", seconds * 1e6, "us/frame");
+}
+
+void bench_apu()
+{
+	APU apu;
+	setup_channels(apu);
+	double seconds = run_frames(apu);
+
+	APU::Stats stats = apu.get_stats();
+	double frame_samples = apu.get_sample_rate() * FRAME_CYCLES / APU::CLOCK_RATE;
+	REPORT("apu: all channels", seconds * 1e6, "us/frame");
+	REPORT("apu: share of 16.6 ms budget", seconds / 0.01667 * 100.0, "%");
+	REPORT("apu: synthesis throughput", frame_samples / seconds / 1e6, "Msamples/s");
+	REPORT("apu: dmc fetches per frame", static_cast<double>(stats.dmc_fetches) * frame_samples / stats.samples_generated, "");
+
+	APU quiet;
+	quiet.set_audio_enabled(false);
+	setup_channels(quiet);
+	double off = run_frames(quiet);
+	REPORT("apu: audio off", off * 1e6, "us/frame");
+	REPORT("apu: audio-off speedup", seconds / off, "x");
+
+	// Deferred: the queue holds every frame, so the emulation side never waits
+	// for the worker and its own cost shows
+	const int frames = 600;
+	using clock = std::chrono::steady_clock;
+	AudioRenderer renderer(frames + 1);
+	APU deferred;
+	setup_channels(deferred);
+	deferred.set_deferred_renderer(&renderer);
+	deferred.end_frame(0);
+	auto start = clock::now();
+	for (int frame = 1; frame <= frames; frame++)
+	{
+		for (int i = 0; i < 4; i++)
+			deferred.cpu_write(frame * FRAME_CYCLES + i * (FRAME_CYCLES / 4), 0x4002, static_cast<uint8_t>(0xFD - i * 16));
+		deferred.end_frame((frame + 1) * FRAME_CYCLES);
+	}
+	double emulation = std::chrono::duration<double>(clock::now() - start).count() / frames;
+	renderer.flush();
+	double total = std::chrono::duration<double>(clock::now() - start).count() / frames;
+	deferred.set_deferred_renderer(nullptr);
+	REPORT("apu: deferred, emulation thread", emulation * 1e6, "us/frame");
+	REPORT("apu: deferred, worker throughput", total * 1e6, "us/frame");
+
+	bench_expansion();
+	bench_resampler();
+	bench_ring();
+	bench_capture();
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "bench.h"
+#include "core/bus.h"
+#include "core/cartridge.h"
+#include "core/mapper.h"
+#include "core/rom_database.h"
+#include "core/rom_hash.h"
+#include "core/save_ram.h"
+
+static std::shared_ptr<Cartridge> make_cartridge(uint8_t mapper)
+{
+	std::vector<uint8_t> image = {'N', 'E', 'S', 0x1A, 2, 1, static_cast<uint8_t>(mapper << 4), 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	for (int i = 0; i < 0x8000 + 0x2000; i++)
+		image.push_back(static_cast<uint8_t>(i * 13));
+	auto cartridge = std::make_shared<Cartridge>();
+	cartridge->load(image);
+	return cartridge;
+}
+
+// Register writes that only set a latch: the cost of reaching the mapper
+static double write_latch(Bus &bus)
+{
+	const int writes = 1 << 16;
+	double seconds = measure([&] {
+		for (int i = 0; i < writes; i++)
+			bus.write(0xC000, static_cast<uint8_t>(i));
+	});
+	return seconds / writes;
+}
+
+// Walks the ROM the way instruction fetches do
+static double read_rom(Bus &bus)
+{
+	volatile uint8_t sink = 0;
+	const int reads = 1 << 16;
+	double seconds = measure([&] {
+		uint8_t sum = 0;
+		for (int i = 0; i < reads; i++)
+			sum += bus.read(static_cast<uint16_t>(0x8000 | ((i * 7) & 0x7FFF)));
+		sink = sum;
+	});
+	(void)sink;
+	return seconds / reads;
+}
+
+void bench_bus()
+{
+	const char *names[] = {"bus: rom read, nrom", "bus: rom read, mmc1", "bus: rom read, mmc3"};
+	const uint8_t ids[] = {0, 1, 4};
+	for (int i = 0; i < 3; i++)
+	{
+		Bus bus;
+		bus.insert_cartridge(make_cartridge(ids[i]));
+		REPORT(names[i], read_rom(bus) * 1e9, "ns/read");
+	}
+
+	// One cheat: reads of its 2 KiB page (1/16 of the walk) take the patch path
+	Bus cheat;
+	cheat.insert_cartridge(make_cartridge(0));
+	cheat.add_game_genie("GOSSIP");
+	REPORT("bus: rom read, one cheat installed", read_rom(cheat) * 1e9, "ns/read");
+
+	// MMC3 register pairs that swap a PRG and a CHR bank each time: only page
+	// table entries change
+	Bus mmc3;
+	mmc3.insert_cartridge(make_cartridge(4));
+	volatile uint8_t sink = 0;
+	const int switches = 1 << 16;
+	double seconds = measure([&] {
+		for (int i = 0; i < switches; i++)
+		{
+			mmc3.write(0x8000, 6);
+			mmc3.write(0x8001, static_cast<uint8_t>(i));
+			mmc3.write(0x8000, 2);
+			mmc3.write(0x8001, static_cast<uint8_t>(i));
+		}
+		sink = mmc3.read(0x8000);
+	});
+	(void)sink;
+	REPORT("bus: mmc3 prg + chr bank switch", seconds / switches * 1e9, "ns/switch");
+
+	REPORT("bus: mmc3 irq latch write", write_latch(mmc3) * 1e9, "ns/write");
+
+	// Whole frames with rendering on and the MMC3 counting scanlines
+	auto nops = make_cartridge(4);
+	std::fill(nops->prg_rom.begin(), nops->prg_rom.end(), 0xEA);
+	nops->prg_rom[0x7FFC] = 0x00; // Reset vector: $8000
+	nops->prg_rom[0x7FFD] = 0x80;
+	Bus frames;
+	frames.insert_cartridge(nops);
+	frames.reset();
+	frames.write(0x2000, 0x08); // Sprites at $1000
+	frames.write(0x2001, 0x18);
+	const int dots = 341 * 262 * 4;
+	seconds = measure([&] {
+		for (int i = 0; i < dots; i++)
+			frames.clock();
+	});
+	REPORT("bus: frame, mmc3 counting", seconds / 4 * 1e6, "us/frame");
+
+	// ROM identification: hashing a 256 KiB PRG + 128 KiB CHR image
+	std::vector<uint8_t> rom(384 * 1024);
+	for (size_t i = 0; i < rom.size(); i++)
+		rom[i] = static_cast<uint8_t>(i * 131 + (i >> 9));
+	volatile uint32_t crc_sink = 0;
+	seconds = measure([&] { crc_sink = crc32_scalar(rom.data(), rom.size()); });
+	REPORT("rom: crc32, slicing-by-8", rom.size() / seconds / 1e9, "GB/s");
+	seconds = measure([&] { crc_sink = crc32(rom.data(), rom.size()); });
+	REPORT(crc32_accelerated() ? "rom: crc32, pclmul" : "rom: crc32 (no pclmul)", rom.size() / seconds / 1e9, "GB/s");
+	seconds = measure([&] {
+		Sha1 sha1;
+		sha1.update(rom.data(), rom.size());
+		uint8_t digest[20];
+		sha1.finish(digest);
+		crc_sink = digest[0];
+	});
+	REPORT("rom: sha1", rom.size() / seconds / 1e9, "GB/s");
+	(void)crc_sink;
+
+	// Database miss, the common case in a corpus scan: CRC only
+	std::vector<RomRecord> records(4096);
+	for (size_t i = 0; i < records.size(); i++)
+		records[i].crc32 = static_cast<uint32_t>(i * 0x9E3779B1u);
+	RomDatabase database;
+	database.set_records(records);
+	volatile const RomRecord *found = nullptr;
+	seconds = measure([&] { found = database.find(rom.data(), 256 * 1024, rom.data() + 256 * 1024, 128 * 1024); });
+	(void)found;
+	REPORT("rom: database lookup, 384 KiB image", seconds * 1e6, "us");
+
+	// Save RAM: the per-frame cost when the game did not touch it
+	{
+		auto battery = make_cartridge(0);
+		SaveRam save(1);
+		std::string path = "/tmp/nes_bench_" + std::to_string(getpid()) + ".sav";
+		save.open(battery, path);
+		seconds = measure([&] { save.end_frame(); });
+		REPORT("save ram: unchanged frame check", seconds * 1e9, "ns");
+		save.close();
+		std::remove(path.c_str());
+	}
+
+	Bus flat;
+	REPORT("bus: flat memory read", read_rom(flat) * 1e9, "ns/read");
+}
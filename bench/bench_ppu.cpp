@@ -0,0 +1,212 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "core/ppu.h"
+#include "core/tile_decode.h"
+#include "core/frame_convert.h"
+#include "core/frame_renderer.h"
+#include "core/frame_hash.h"
+#include "core/y4m_recorder.h"
+
+// Busy screen: random tiles and attributes, 64 sprites spread over the frame
+static void setup_scene(PPU &ppu)
+{
+	std::mt19937 rng(1234);
+
+	for (auto &byte : ppu.pattern)
+		byte = static_cast<uint8_t>(rng());
+	for (uint16_t i = 0; i < 0x0800; i++)
+		ppu.ppu_write(0x2000 + i, static_cast<uint8_t>(rng()));
+	for (uint16_t i = 0; i < 32; i++)
+		ppu.ppu_write(0x3F00 + i, static_cast<uint8_t>(rng() & 0x3F));
+	for (int i = 0; i < 64; i++)
+	{
+		ppu.oam[i * 4 + 0] = static_cast<uint8_t>(rng() % 232);
+		ppu.oam[i * 4 + 1] = static_cast<uint8_t>(rng());
+		ppu.oam[i * 4 + 2] = static_cast<uint8_t>(rng());
+		ppu.oam[i * 4 + 3] = static_cast<uint8_t>(rng());
+	}
+
+	ppu.cpu_write(0x0005, 3); // Fine X scroll
+	ppu.cpu_write(0x0005, 0);
+	ppu.cpu_write(0x0001, 0x1E);
+}
+
+static void run_frame(PPU &ppu)
+{
+	ppu.frame_complete = false;
+	while (!ppu.frame_complete)
+		ppu.clock();
+}
+
+static void bench_tile_decode()
+{
+	std::mt19937 rng(99);
+	constexpr int TILES = 4096;
+	std::vector<uint8_t> lo(TILES), hi(TILES), attribute(TILES), pixels(TILES * 8);
+	for (int i = 0; i < TILES; i++)
+	{
+		lo[i] = static_cast<uint8_t>(rng());
+		hi[i] = static_cast<uint8_t>(rng());
+		attribute[i] = static_cast<uint8_t>(rng() & 0x0C);
+	}
+
+	DecodePath original = get_decode_path();
+	for (DecodePath path : {DecodePath::SCALAR, DecodePath::SSE2, DecodePath::BMI2, DecodePath::AVX2})
+	{
+		if (!set_decode_path(path))
+			continue;
+
+		// Decode in scanline-sized batches of 33 tiles, as the renderer does
+		double seconds = measure([&]
+								 {
+			for (int i = 0; i + 33 <= TILES; i += 33)
+				decode_tile_rows(&lo[i], &hi[i], &attribute[i], 33, &pixels[i * 8]); });
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "ppu: tile decode (%s)", decode_path_name(path));
+		REPORT(name, (TILES / 33) * 33 * 8 / seconds / 1e6, "Mpixels/s");
+	}
+	set_decode_path(original);
+}
+
+static void bench_frame_convert(const PPU &ppu)
+{
+	constexpr int PIXELS = PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT;
+	std::vector<uint32_t> rgba(PIXELS);
+	std::vector<uint16_t> rgb565(PIXELS);
+	std::vector<uint8_t> y(PIXELS), u(PIXELS / 4), v(PIXELS / 4);
+	const uint8_t *indices = ppu.get_frame().data();
+	const uint8_t *emphasis = ppu.get_frame_emphasis().data();
+
+	REPORT("ppu: indexed frame size", PIXELS / 1024.0, "KiB");
+	REPORT("ppu: rgba8888 frame size", PIXELS * 4 / 1024.0, "KiB");
+
+	SimdPath original = get_kernel_path(Kernel::FRAME_CONVERT);
+	for (SimdPath path : {SimdPath::SCALAR, SimdPath::AVX2})
+	{
+		if (!set_kernel_path(Kernel::FRAME_CONVERT, path))
+			continue;
+
+		char name[64];
+		double seconds = measure([&]
+								 { convert_rgba8888(indices, emphasis, PPU::SCREEN_WIDTH, PPU::SCREEN_HEIGHT, rgba.data()); });
+		std::snprintf(name, sizeof(name), "ppu: convert rgba8888 (%s)", simd_path_name(path));
+		REPORT(name, seconds * 1e6, "us/frame");
+
+		seconds = measure([&]
+						  { convert_rgb565(indices, emphasis, PPU::SCREEN_WIDTH, PPU::SCREEN_HEIGHT, rgb565.data()); });
+		std::snprintf(name, sizeof(name), "ppu: convert rgb565 (%s)", simd_path_name(path));
+		REPORT(name, seconds * 1e6, "us/frame");
+
+		seconds = measure([&]
+						  { convert_yuv420(indices, emphasis, PPU::SCREEN_WIDTH, PPU::SCREEN_HEIGHT, y.data(), u.data(), v.data()); });
+		std::snprintf(name, sizeof(name), "ppu: convert yuv420 (%s)", simd_path_name(path));
+		REPORT(name, seconds * 1e6, "us/frame");
+	}
+	set_kernel_path(Kernel::FRAME_CONVERT, original);
+}
+
+// Fast-forward capture: frames pushed back to back, as fast as the encoder takes them
+static void bench_recorder(PPU &ppu)
+{
+	const int frames = 2000;
+	const char *path = "/tmp/nes_bench.y4m";
+
+	Y4mRecorder recorder;
+	if (!recorder.open(path))
+		return;
+
+	using clock = std::chrono::steady_clock;
+	auto start = clock::now();
+	for (int i = 0; i < frames; i++)
+		recorder.push_frame(ppu.get_frame().data(), ppu.get_frame_emphasis().data());
+	double handoff = std::chrono::duration<double>(clock::now() - start).count();
+	recorder.close();
+	double total = std::chrono::duration<double>(clock::now() - start).count();
+	std::remove(path);
+
+	auto stats = recorder.get_stats();
+	REPORT("y4m: recorded frames per second", frames / total, "fps");
+	REPORT("y4m: producer hand-off", handoff / frames * 1e6, "us/frame");
+	REPORT("y4m: producer waits", static_cast<double>(stats.producer_waits), "");
+}
+
+void bench_ppu()
+{
+	bench_tile_decode();
+
+	PPU ppu;
+	setup_scene(ppu);
+
+	double seconds = measure([&]
+							 { run_frame(ppu); });
+	REPORT("ppu: full frame", seconds * 1e3, "ms/frame");
+	REPORT("ppu: share of 16.6 ms budget", seconds / 0.01667 * 100.0, "%");
+
+	auto chr = ppu.get_stats().chr_cache;
+	REPORT("ppu: chr cache hit rate", 100.0 * chr.hits / (chr.hits + chr.misses), "%");
+	REPORT("ppu: chr cache memory", chr.memory_bytes / 1024.0, "KiB");
+
+	// Static screen: background lines are reused, scrolling misses every line
+	auto stats = ppu.get_stats();
+	REPORT("ppu: background line hit rate (static)",
+		   100.0 * stats.background_line_hits / (stats.background_line_hits + stats.background_line_misses), "%");
+	uint8_t scroll = 3;
+	double scrolling = measure([&]
+							   {
+		ppu.cpu_write(0x0005, ++scroll);
+		ppu.cpu_write(0x0005, 0);
+		run_frame(ppu); });
+	ppu.cpu_write(0x0005, 3);
+	ppu.cpu_write(0x0005, 0);
+	REPORT("ppu: scrolling frame", scrolling * 1e3, "ms/frame");
+
+	bench_frame_convert(ppu);
+	bench_recorder(ppu);
+
+	// Frame digest: separate pass over the framebuffer vs folded into line output
+	volatile uint64_t digest = 0;
+	double hash_pass = measure([&]
+							   { digest = hash_frame(ppu.get_frame().data(), ppu.get_frame_emphasis().data(), PPU::SCREEN_WIDTH, PPU::SCREEN_HEIGHT); });
+	ppu.set_frame_hashing(true);
+	double hashed = measure([&]
+							{ run_frame(ppu); });
+	ppu.set_frame_hashing(false);
+	REPORT("ppu: full-frame hash pass", hash_pass * 1e6, "us/frame");
+	REPORT("ppu: frame with incremental hash", hashed * 1e3, "ms/frame");
+
+	// Observation output instead of the framebuffer
+	Observation::Config observation;
+	ppu.set_observation(observation);
+	double observed = measure([&]
+							  { run_frame(ppu); });
+	ppu.disable_observation();
+	REPORT("ppu: 84x84 observation frame", observed * 1e3, "ms/frame");
+
+	// Every frame skipped: only the CPU-visible side effects are computed
+	ppu.set_frame_skip(0xFFFF);
+	double skipped = measure([&]
+							 { run_frame(ppu); });
+	REPORT("ppu: skipped frame", skipped * 1e3, "ms/frame");
+	REPORT("ppu: frame-skip speedup", seconds / skipped, "x");
+	ppu.set_frame_skip(0);
+
+	// Deferred: the emulation thread only logs, workers compose the frames.
+	// Back-to-back frames are bound by the workers replaying the log.
+	for (int threads : {1, 2, 4})
+	{
+		FrameRenderer renderer(threads);
+		ppu.set_deferred_renderer(&renderer);
+		double deferred = measure([&]
+								  { run_frame(ppu); });
+		renderer.flush();
+		ppu.set_deferred_renderer(nullptr);
+
+		char name[64];
+		std::snprintf(name, sizeof(name), "ppu: deferred frame (%d workers)", threads);
+		REPORT(name, deferred * 1e3, "ms/frame");
+	}
+}
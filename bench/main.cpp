@@ -0,0 +1,9 @@
+#include "bench.h"
+
+int main()
+{
+	bench_ppu();
+	bench_apu();
+	bench_bus();
+	return 0;
+}
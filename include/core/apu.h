@@ -0,0 +1,227 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <vector>
+
+#include "core/blip_buffer.h"
+
+class Bus;
+class AudioRenderer;
+class ExpansionAudio;
+struct APULog;
+
+// 2A03 audio: two pulse channels, triangle, noise and DMC. The APU is not
+// clocked per CPU cycle. It keeps its own time and catches up to the CPU
+// (run_until) whenever a register is accessed, an IRQ or DMC fetch is due, or
+// samples are needed. Between frame sequencer steps every channel runs as one
+// batch, and only the points where its output changes are turned into
+// band-limited steps (see blip_buffer.h).
+class APU
+{
+public:
+	APU();
+	~APU();
+
+	static constexpr double CLOCK_RATE = 1789773.0; // NTSC CPU clock
+
+	void connect_bus(Bus *iBus) { bus = iBus; }
+
+	// Register access at the given CPU cycle
+	void cpu_write(uint64_t cycle, uint16_t address, uint8_t data);
+	uint8_t cpu_read(uint64_t cycle, uint16_t address, bool read_only = false);
+
+	void reset();
+
+	// Cartridge sound chip, run and mixed along with the 2A03 channels
+	// (nullptr for none). Changing it ends a deferred session.
+	void set_expansion(ExpansionAudio *audio);
+	void write_expansion(uint64_t cycle, uint16_t address, uint8_t data);
+	uint8_t read_expansion(uint64_t cycle, uint16_t address);
+
+	// Catches up to the given CPU cycle
+	void run_until(uint64_t cycle);
+	// Earliest CPU cycle at which the CPU could observe a change (frame IRQ or
+	// DMC fetch), so the bus knows when to call run_until without a register access
+	uint64_t next_event_cycle() const;
+
+	bool irq() const { return frame_irq || dmc_irq; }
+	// CPU cycles stolen by DMC sample fetches since the last call
+	uint16_t take_stall_cycles();
+
+	// Audio off: no synthesis or mixing. Only what the CPU can observe keeps
+	// running: length counters, the frame IRQ and DMC fetches/IRQ.
+	void set_audio_enabled(bool enabled);
+	bool get_audio_enabled() const { return audio_enabled; }
+
+	// Deferred audio (see audio_renderer.h): from the next end_frame() on, this
+	// APU runs with audio off and logs its register writes for the renderer's
+	// worker. nullptr goes back to inline synthesis.
+	void set_deferred_renderer(AudioRenderer *audio_renderer);
+
+	// Output: mono samples at the configured rate (48 kHz by default). A new
+	// rate drops the unread samples.
+	void set_sample_rate(uint32_t rate);
+	void set_quality(BlipBuffer::Quality quality) { blip.set_quality(quality); }
+	// Rate control: produces sample_rate * ratio samples per second (see audio_ring.h)
+	void set_rate_ratio(double ratio) { blip.set_ratio(ratio); }
+	uint32_t get_sample_rate() const { return sample_rate; }
+	void end_frame(uint64_t cycle); // Makes every sample up to cycle readable
+	int samples_available() const { return blip.samples_available(); }
+	int read_samples(int16_t *out, int count);
+
+	struct Stats
+	{
+		uint64_t samples_generated = 0;
+		uint64_t samples_dropped = 0; // Not read before the buffer filled up
+		uint64_t blocks = 0;
+		uint64_t dmc_fetches = 0;
+	};
+	Stats get_stats() const { return stats; }
+
+private:
+	friend class AudioRenderer;
+
+	struct Envelope
+	{
+		bool start = false;
+		bool loop = false;
+		bool constant = false;
+		uint8_t period = 0;
+		uint8_t divider = 0;
+		uint8_t decay = 0;
+
+		uint8_t volume() const { return constant ? period : decay; }
+		void clock();
+	};
+
+	struct Pulse
+	{
+		Envelope envelope;
+		uint8_t duty = 0;
+		uint8_t length = 0;
+		uint16_t period = 0;
+		uint8_t step = 0;
+		uint64_t next_clock = 0;
+
+		bool sweep_enabled = false;
+		bool sweep_negate = false;
+		bool sweep_reload = false;
+		uint8_t sweep_period = 0;
+		uint8_t sweep_divider = 0;
+		uint8_t sweep_shift = 0;
+		bool ones_complement = false; // Pulse 1 negates with one's complement
+
+		int output = 0;
+
+		uint16_t sweep_target() const;
+		bool muted() const { return period < 8 || sweep_target() > 0x07FF; }
+		int amplitude() const;
+	};
+
+	struct Triangle
+	{
+		bool control = false; // Also halts the length counter
+		uint8_t linear_reload = 0;
+		uint8_t linear = 0;
+		bool linear_reload_flag = false;
+		uint8_t length = 0;
+		uint16_t period = 0;
+		uint8_t step = 0;
+		uint64_t next_clock = 0;
+		int output = 0;
+	};
+
+	struct Noise
+	{
+		Envelope envelope;
+		uint8_t length = 0;
+		bool mode = false;
+		uint16_t period = 4;
+		uint16_t shift = 1;
+		uint64_t next_clock = 0;
+		int output = 0;
+
+		int amplitude() const { return (length == 0 || (shift & 0x01)) ? 0 : envelope.volume(); }
+	};
+
+	struct DMC
+	{
+		bool irq_enabled = false;
+		bool loop = false;
+		uint16_t period = 428;
+		uint8_t level = 0;
+		uint16_t sample_address = 0xC000;
+		uint16_t sample_length = 1;
+		uint16_t address = 0xC000;
+		uint16_t remaining = 0;
+		uint8_t buffer = 0;
+		bool buffer_full = false;
+		uint8_t shift = 0;
+		uint8_t bits = 8;
+		bool silence = true;
+		uint64_t next_clock = 0;
+		int output = 0;
+	};
+
+	// Channel batches from time to end
+	void run_pulse(Pulse &pulse, int channel, uint64_t end);
+	void run_triangle(uint64_t end);
+	void run_noise(uint64_t end);
+	void run_dmc(uint64_t end);
+	void run_dmc_timing(uint64_t end); // Audio off: byte boundaries only
+	void dmc_fetch();
+
+	void end_deferred_session();
+
+	void clock_frame_sequencer();
+	void clock_quarter_frame();
+	void clock_half_frame();
+	void update_outputs(); // Emits steps for amplitude changes made at the current time
+	void emit(int channel, int &output, int value, uint64_t when)
+	{
+		if (value != output)
+		{
+			blip.add_delta(static_cast<uint32_t>(when - block_start), (value - output) * CHANNEL_WEIGHT[channel]);
+			output = value;
+		}
+	}
+	void end_block();
+
+	// Linear approximation of the 2A03 mixer, per output unit of each channel
+	static constexpr float CHANNEL_WEIGHT[5] = {0.00752f, 0.00752f, 0.00851f, 0.00494f, 0.00335f};
+
+	Bus *bus = nullptr;
+
+	AudioRenderer *renderer = nullptr;
+	APULog *apu_log = nullptr;							// Log of the frame being recorded
+	bool audio_before_deferred = true;
+	const std::vector<uint8_t> *dmc_replay = nullptr; // Shadow APU: logged DMC bytes instead of the bus
+	uint32_t dmc_replay_position = 0;
+
+	Pulse pulse[2];
+	Triangle triangle;
+	Noise noise;
+	DMC dmc;
+	uint8_t enabled = 0x00; // $4015 channel enables, length counters only load while set
+	ExpansionAudio *expansion = nullptr;
+
+	uint64_t time = 0;		  // CPU cycle the APU has caught up to
+	uint64_t block_start = 0; // CPU cycle of the first clock of the current output block
+
+	// Frame sequencer
+	bool five_step = false;
+	bool irq_inhibit = false;
+	bool frame_irq = false;
+	bool dmc_irq = false;
+	uint64_t frame_start = 0; // CPU cycle the current sequence started on
+	uint8_t frame_step = 0;	  // Next step of the sequence
+	uint64_t next_frame_step = 0;
+
+	uint16_t stall_cycles = 0;
+
+	bool audio_enabled = true;
+	BlipBuffer blip;
+	uint32_t sample_rate = 48000;
+	int max_unread = 0;
+	Stats stats;
+};
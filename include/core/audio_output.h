@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "core/audio_ring.h"
+
+class APU;
+class ShmRing;
+
+// Real-time audio path: the emulation thread moves each frame's samples from
+// the APU into an AudioRing and retunes the APU's rate to hold the ring at the
+// target latency. A sink thread drains the ring at the output rate. A device
+// backend reads get_ring() from its own callback; the null sink built in here
+// drains on a timer and either discards the samples or writes them to a file
+// (raw signed 16-bit mono, host byte order), for headless runs and tests.
+class AudioOutput
+{
+public:
+	explicit AudioOutput(uint32_t sample_rate = 48000, int target_ms = 50, int capacity_ms = 200);
+	~AudioOutput();
+
+	// Empty path: discard
+	bool open_null_sink(const std::string &path = "", int period_ms = 5);
+	void close();
+
+	// Emulation thread, after APU::end_frame(). Never blocks. An APU set to
+	// another rate is switched to the output's before anything is read.
+	void push(APU &apu);
+
+	// Also publishes every pushed sample into a shared-memory ring (see shm_ring.h)
+	void set_shm_ring(ShmRing *shm) { shm_ring = shm; }
+
+	AudioRing &get_ring() { return ring; }
+	uint32_t get_sample_rate() const { return sample_rate; }
+
+	struct Stats
+	{
+		AudioRing::Stats ring;
+		double fill_ms = 0.0;
+		double rate_ratio = 1.0;
+		bool write_error = false;
+	};
+	Stats get_stats() const;
+
+private:
+	void sink_loop(int period_samples, int period_ms);
+
+	uint32_t sample_rate;
+	AudioRing ring;
+	AudioRateControl control;
+	std::vector<int16_t> scratch;
+	ShmRing *shm_ring = nullptr;
+	uint64_t samples_pushed = 0; // Tag of the next shared-memory block
+
+	FILE *file = nullptr;
+	std::thread sink;
+	std::atomic<bool> running{false};
+	std::atomic<bool> write_error{false};
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class APU;
+
+// Audio capture: 16-bit mono PCM written as WAV or headerless raw by a
+// dedicated thread. Samples go into a fixed pool of buffers allocated by
+// open(); a full buffer is handed to the writer and the next free one is
+// filled. Nothing is allocated on the emulation thread, and when the writer
+// falls behind the producer waits instead of dropping samples.
+//
+// For lossless analysis, record at the native rate: set the APU's sample rate
+// to APU::CLOCK_RATE (one sample per CPU cycle) and open with the same rate.
+class AudioRecorder
+{
+public:
+	enum class Format
+	{
+		WAV,
+		RAW // Signed 16-bit little-endian
+	};
+
+	explicit AudioRecorder(int buffer_count = 8, int buffer_samples = 16384);
+	~AudioRecorder();
+
+	bool open(const std::string &path, uint32_t sample_rate, Format format = Format::WAV);
+	void close(); // Writes out every queued sample and completes the WAV header
+	bool is_open() const { return file != nullptr; }
+
+	void push_samples(const int16_t *samples, int count);
+	// Reads everything the APU has ready straight into the pool
+	void push(APU &apu);
+
+	struct Stats
+	{
+		uint64_t samples_written = 0;
+		uint64_t buffers_written = 0;
+		uint64_t producer_waits = 0; // Times the producer found every buffer queued
+		bool write_error = false;
+	};
+	Stats get_stats();
+
+private:
+	void writer_loop();
+	int16_t *current_buffer(); // Waits for a free buffer if needed
+	void submit();			   // Queues the current buffer
+
+	FILE *file = nullptr;
+	Format format = Format::WAV;
+	std::thread writer;
+
+	// Ring of buffers; fill[i] is the number of samples in buffer i
+	std::vector<std::vector<int16_t>> pool;
+	std::vector<int> fill;
+	int buffer_count;
+	int buffer_samples;
+	bool have_buffer = false; // The producer owns pool[pushed % size]
+	uint64_t pushed = 0;
+	uint64_t written = 0;
+	bool stopping = false;
+	Stats stats;
+
+	std::mutex lock;
+	std::condition_variable buffer_ready;
+	std::condition_variable buffer_free;
+};
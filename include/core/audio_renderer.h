@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+#include "core/apu.h"
+#include "core/expansion_audio.h"
+
+// One APU register write, stamped with its CPU cycle. Expansion chip reads
+// are logged too, since a Namco 163 data read moves its address.
+struct APUWrite
+{
+	uint64_t cycle;
+	uint16_t address;
+	uint8_t data;
+	bool read = false;
+};
+
+struct APULog
+{
+	std::vector<APUWrite> writes;
+	std::vector<uint8_t> dmc_bytes; // Sample bytes in fetch order; the worker has no bus
+	uint64_t end_cycle = 0;
+
+	void clear()
+	{
+		writes.clear();
+		dmc_bytes.clear();
+		end_cycle = 0;
+	}
+};
+
+// Deferred audio: the emulated APU runs with audio off, so only what the CPU
+// can observe ($4015, IRQs, DMC stalls) is computed on the emulation thread,
+// and it logs each frame's register writes. A worker thread replays the logs
+// in order on a shadow APU that synthesizes and mixes the samples. The shadow
+// starts from a copy of the emulated APU taken when logging begins, and of the
+// cartridge's sound chip if there is one.
+class AudioRenderer
+{
+public:
+	// Called on the worker thread after each frame; read the samples from apu
+	// (AudioOutput::push() fits here). Without a callback the samples are dropped.
+	using SampleCallback = std::function<void(uint64_t frame, APU &apu)>;
+
+	explicit AudioRenderer(int max_pending = 4);
+	~AudioRenderer();
+
+	void set_callback(SampleCallback callback) { on_frame = std::move(callback); }
+
+	// Emulation thread (called by the APU). begin_frame() blocks while
+	// max_pending frames are still waiting for the worker.
+	APULog *begin_frame(const APU &apu);
+	void end_frame(uint64_t cycle);
+	void end_session(); // The next begin_frame() takes a new snapshot
+
+	// Waits until every submitted frame has been delivered
+	void flush();
+
+private:
+	struct Job
+	{
+		std::unique_ptr<APU> snapshot; // Only on the first frame of a session
+		std::unique_ptr<ExpansionAudio> expansion; // With the snapshot
+		APULog log;
+	};
+
+	void worker_loop();
+	void render(Job &job, APU &shadow);
+
+	std::vector<std::unique_ptr<Job>> jobs; // Ring of max_pending slots
+	std::thread worker;
+	SampleCallback on_frame;
+	bool in_session = false;
+	std::unique_ptr<ExpansionAudio> shadow_expansion; // Worker's copy of the chip
+
+	std::mutex lock;
+	std::condition_variable job_ready;
+	std::condition_variable job_done;
+	uint64_t started = 0;
+	uint64_t submitted = 0;
+	uint64_t completed = 0;
+	bool stopping = false;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <vector>
+
+// Lock-free ring of mono samples between the emulation thread (the only
+// writer) and the audio sink (the only reader). Neither side ever waits:
+// samples that do not fit are dropped (overrun), and a read that finds too
+// few samples returns what there is (underrun) for the sink to pad.
+class AudioRing
+{
+public:
+	explicit AudioRing(int capacity = 8192); // Rounded up to a power of two
+
+	// Producer
+	int write(const int16_t *samples, int count);
+	// Consumer
+	int read(int16_t *out, int count);
+
+	int fill() const; // Samples waiting to be read
+	int get_capacity() const { return static_cast<int>(mask + 1); }
+
+	struct Stats
+	{
+		uint64_t samples_written = 0;
+		uint64_t samples_read = 0;
+		uint64_t overruns = 0;		   // Writes that dropped samples
+		uint64_t overrun_samples = 0;
+		uint64_t underruns = 0;		   // Reads that came up short
+		uint64_t underrun_samples = 0; // Samples the sink had to pad
+	};
+	Stats get_stats() const;
+
+private:
+	std::vector<int16_t> data;
+	uint32_t mask = 0;
+
+	// Each index has one writer; keep them on separate cache lines
+	alignas(64) std::atomic<uint64_t> head{0}; // Next sample to write
+	alignas(64) std::atomic<uint64_t> tail{0}; // Next sample to read
+
+	// Producer-owned counters
+	alignas(64) std::atomic<uint64_t> overruns{0};
+	std::atomic<uint64_t> overrun_samples{0};
+	// Consumer-owned counters
+	alignas(64) std::atomic<uint64_t> underruns{0};
+	std::atomic<uint64_t> underrun_samples{0};
+};
+
+// Dynamic rate control: the emulator and the audio device run on different
+// clocks, so the ring would slowly fill up or drain. Once per frame, update()
+// turns the ring fill into a resampling ratio within +-max_adjust (0.5% is
+// inaudible) that produces slightly more samples while the fill is below the
+// target and slightly fewer above it.
+class AudioRateControl
+{
+public:
+	explicit AudioRateControl(int target_fill = 2400, double max_adjust = 0.005);
+
+	double update(int fill);
+	double get_ratio() const { return ratio; }
+	int get_target() const { return target; }
+
+private:
+	int target;
+	double max_adjust;
+	double average = -1.0; // Smoothed fill, so one late frame does not swing the ratio
+	double ratio = 1.0;
+};
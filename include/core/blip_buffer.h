@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <vector>
+
+// Band-limited step synthesis: a waveform is described by the amplitude
+// deltas at the clock times where it changes, and each delta is added to the
+// output as a band-limited step (windowed sinc kernel picked by the sub-sample
+// phase). Nothing is computed for the clocks in between, so a channel costs
+// per change instead of per clock. This is the polyphase resampler from the
+// clock rate to the sample rate.
+//
+// Deltas are queued during a block and filtered in one pass when the block
+// ends. That pass has a scalar and an AVX2 version; Kernel::RESAMPLER in
+// cpu_features.h says which one runs.
+class BlipBuffer
+{
+public:
+	// Kernel length: LOW 8 taps, MEDIUM 16, HIGH 32 with twice the phases
+	enum class Quality
+	{
+		LOW,
+		MEDIUM,
+		HIGH
+	};
+	static constexpr int MAX_TAPS = 32;
+
+	BlipBuffer();
+	~BlipBuffer();
+
+	// Holds up to max_samples samples that have not been read yet
+	void set_rates(double clock_rate, double sample_rate, int max_samples);
+	// Fine-tunes the output rate (sample_rate * ratio) without clearing the buffer
+	void set_ratio(double ratio);
+	void set_quality(Quality quality);
+	Quality get_quality() const { return quality; }
+	void clear();
+
+	// time is in clocks since the start of the current block
+	void add_delta(uint32_t time, float delta) { steps.push_back({time, delta}); }
+
+	// Ends the current block after duration clocks and makes its samples readable
+	void end_block(uint32_t duration);
+
+	int samples_available() const { return static_cast<int>(position >> 32); }
+	// Clocks needed before count more samples are available
+	uint32_t clocks_needed(int count) const;
+
+	// Reads up to count samples; out may be nullptr to drop them
+	int read_samples(int16_t *out, int count);
+	int read_samples(float *out, int count);
+
+	double get_sample_rate() const { return sample_rate; }
+	double get_clock_rate() const { return clock_rate; }
+	int get_taps() const { return taps; }
+
+	struct Step
+	{
+		uint32_t time;
+		float delta;
+	};
+
+private:
+	template <typename T>
+	int read(T *out, int count);
+
+	std::vector<float> buffer;	// Sample deltas, integrated when read
+	std::vector<float> kernels; // phases x taps
+	std::vector<Step> steps;	// Deltas of the current block
+	Quality quality = Quality::MEDIUM;
+	int taps = 16;
+	int phase_bits = 5;
+	uint64_t factor = 0;   // Samples per clock, 32.32 fixed point
+	uint64_t position = 0; // Start of the current block in samples, 32.32 fixed point
+
+	double clock_rate = 1.0;
+	double sample_rate = 1.0;
+	float integrator = 0.0f;
+	float highpass_in = 0.0f;  // Last integrated sample
+	float highpass_out = 0.0f; // Last DC-blocked sample
+	float highpass_pole = 0.0f;
+};
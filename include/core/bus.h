@@ -1,8 +1,15 @@
 #pragma once
 #include <cstdint>
 #include <array>
+#include <memory>
+#include <vector>
 
 #include "core/cpu.h"
+#include "core/ppu.h"
+#include "core/apu.h"
+#include "core/cartridge.h"
+#include "core/mapper.h"
+#include "core/cheat.h"
 
 class Bus
 {
@@ -12,9 +19,58 @@ public:
 
 	// Read and write
 	void write(uint16_t address, uint8_t data);
-	uint8_t read(uint16_t address, bool bReadOnly = false) const;
+	uint8_t read(uint16_t address, bool bReadOnly = false);
+
+	// System interface
+	void reset();
+	void clock();
+	uint64_t get_cpu_cycles() const { return cpu_cycles; }
+
+	// Cartridge: with one inserted, RAM mirrors every 2 KiB and $4020-$FFFF
+	// belongs to the mapper. Without one, memory stays flat. Plain memory is
+	// read and written through the mapper's page table (see MemoryPages).
+	bool insert_cartridge(std::shared_ptr<Cartridge> cartridge); // False if the mapper is not built in
+	void insert_cartridge(std::shared_ptr<Cartridge> cartridge, std::unique_ptr<Mapper> custom_mapper);
+	void eject_cartridge();
+	Mapper *get_mapper() const { return mapper.get(); }
+
+	// Cheats patch CPU reads. Only the pages they land on leave the page
+	// table fast path; they stay installed across bank switches and cartridges.
+	void add_cheat(const Cheat &cheat);
+	bool add_game_genie(const std::string &code); // False if the code is malformed
+	void clear_cheats();
 
 	// Devices on bus
 	CPU cpu; // CPU instance
+	PPU ppu; // PPU instance
+	APU apu; // APU instance
 	std::array<uint8_t, 64 * 1024> memory;
+
+private:
+	uint32_t system_clock_counter = 0; // Counts PPU dots, the CPU runs every third
+	uint64_t ppu_dots = 0;			   // PPU clock() calls, the scanline counter's time base
+	uint16_t dma_cycles = 0;		   // CPU cycles left stalled by an OAM or DMC DMA
+	uint64_t cpu_cycles = 0;		   // CPU cycles since reset, the APU's time base
+	uint64_t apu_sync_cycle = 0;	   // Next CPU cycle at which the APU must catch up
+
+	void sync_apu();
+
+	MemoryPages flat_pages;			 // No cartridge: everything but I/O maps onto memory
+	MemoryPages *pages = &flat_pages; // The mapper's table while a cartridge is inserted
+	void map_ram(MemoryPages &table);
+
+	uint8_t read_io(uint16_t address, bool read_only); // Registers and unmapped memory
+	uint8_t read_patched(uint16_t address, bool read_only);
+	void patch_pages(); // Marks the pages holding cheats in the current table
+	std::vector<Cheat> cheats;
+
+	std::shared_ptr<Cartridge> cartridge;
+	std::unique_ptr<Mapper> mapper;
+	bool scanline_counter = false; // Mapper is clocked per rendered scanline
+	ExpansionAudio *expansion_audio = nullptr; // The mapper's sound chip, if any
+
+	// The next A12 rise is predicted from PPUCTRL/PPUMASK and rescheduled when
+	// either changes, instead of checking the PPU position on every dot
+	uint64_t mapper_clock_dot = UINT64_MAX; // ppu_dots of the next scanline() call
+	void schedule_mapper_clock();
 };
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/ppu.h"
+#include "core/rom_database.h"
+
+// Cartridge contents as loaded from an iNES / NES 2.0 image
+struct Cartridge
+{
+	uint16_t mapper_id = 0;
+	Mirror mirroring = Mirror::HORIZONTAL; // Hard-wired; mappers may override it
+	bool four_screen = false;
+	bool battery = false;
+	Region region = Region::NTSC;
+	bool header_corrected = false; // Fields above come from the ROM database
+
+	std::vector<uint8_t> prg_rom;
+	std::vector<uint8_t> chr;	  // CHR ROM, or CHR RAM when chr_ram is set
+	bool chr_ram = false;
+	std::vector<uint8_t> prg_ram; // $6000-$7FFF
+
+	// With a database, a known dump gets its mapper, mirroring, battery and
+	// region from there instead of the header
+	bool load(const std::vector<uint8_t> &image, const RomDatabase *database = nullptr);
+	bool load_file(const std::string &path, const RomDatabase *database = nullptr);
+};
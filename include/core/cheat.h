@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// A CPU read patch: reads of address return value, or only when the byte
+// that is really there equals compare (compare >= 0). Compare codes are
+// what make Game Genie codes safe with bank switching: the patch only
+// applies while the intended bank is mapped.
+struct Cheat
+{
+	uint16_t address = 0;
+	uint8_t value = 0;
+	int16_t compare = -1;
+};
+
+// 6 letter (address, value) and 8 letter (with compare) Game Genie codes,
+// case-insensitive. False on any other length or letter.
+bool decode_game_genie(const std::string &code, Cheat &cheat);
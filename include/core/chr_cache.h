@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Pre-decoded pattern tiles: every 16 byte CHR tile expanded to 64 bytes, one
+// 2-bit pixel value per byte, so a tile row is a single 8 byte copy. Tiles are
+// decoded on first use and invalidated individually when CHR-RAM is written.
+class ChrCache
+{
+public:
+	explicit ChrCache(uint32_t chr_size = 8 * 1024);
+	~ChrCache();
+
+	// Resizes the cache for a CHR memory of chr_size bytes and drops every tile
+	void resize(uint32_t chr_size);
+
+	// Decoded 8x8 tile, decoding it from chr first if needed
+	const uint8_t *tile(const uint8_t *chr, uint32_t index)
+	{
+		if (valid[index])
+		{
+			hits++;
+			return &pixels[index * 64];
+		}
+		return build(chr, index);
+	}
+
+	void invalidate(uint32_t chr_address)
+	{
+		uint8_t &entry = valid[chr_address >> 4];
+		invalidations += entry;
+		entry = 0;
+	}
+	void invalidate_all();
+
+	struct Stats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t invalidations = 0;
+		uint32_t tiles_valid = 0;
+		uint32_t memory_bytes = 0;
+	};
+	Stats get_stats() const;
+	void reset_stats();
+
+private:
+	const uint8_t *build(const uint8_t *chr, uint32_t index);
+
+	std::vector<uint8_t> pixels;
+	std::vector<uint8_t> valid;
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t invalidations = 0;
+};
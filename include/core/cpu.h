@@ -20,6 +20,7 @@ public:
 	void run();
 	void irq();
 	void nmi();
+	bool instruction_done() const { return cycles == 0; } // Next clock() starts a new instruction
 	void load_and_run(const std::vector<uint8_t> &program);
 
 	// 6502 opcode handler methods
@@ -97,6 +98,9 @@ public:
 	uint16_t read_u16(uint16_t address) const;
 	void write_u16(uint16_t address, uint16_t data);
 
+	void push(uint8_t data);
+	uint8_t pop();
+
 	bool get_flag(FLAGS6502 flag) const;
 	void set_flag(FLAGS6502 flag, bool set);
 
@@ -121,10 +125,15 @@ public:
 	uint8_t get_status() const;
 
 private:
+	bool step();
+	void interrupt(uint16_t vector, bool brk);
+
 	uint8_t a = 0x00;	   // Accumulator
 	uint8_t x = 0x00;	   // X Register
 	uint8_t y = 0x00;	   // Y Register
 	uint16_t pc = 0x0000;  // Program Counter
 	uint8_t sp = 0x00;	   // Stack Pointer
 	uint8_t status = 0x00; // Status Register
+
+	uint8_t cycles = 0; // Cycles left for the current instruction
 };
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+
+// SIMD kernel selection. Each kernel family has its own path, picked at
+// startup as the fastest one it implements on this CPU, so forcing one path
+// (tests, benchmarks) leaves the other kernels alone. The paths are atomics:
+// renderer workers read them while another thread may set them.
+enum class SimdPath
+{
+	SCALAR,
+	SSE2,
+	BMI2,
+	AVX2
+};
+
+enum class Kernel
+{
+	TILE_DECODE,   // tile_decode.h: every path
+	FRAME_CONVERT, // frame_convert.h: scalar and AVX2
+	RESAMPLER,	   // blip_buffer.h: scalar and AVX2
+	COUNT
+};
+
+// Whether the host CPU has the instructions a path needs (SCALAR always)
+bool cpu_supports(SimdPath path);
+
+// The kernel implements the path and the CPU supports it
+bool kernel_path_supported(Kernel kernel, SimdPath path);
+bool set_kernel_path(Kernel kernel, SimdPath path); // False if not supported
+SimdPath get_kernel_path(Kernel kernel);
+
+const char *simd_path_name(SimdPath path);
@@ -0,0 +1,223 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <memory>
+
+class BlipBuffer;
+
+// Sound chip on the cartridge, mixed into the APU's output. Like the 2A03
+// channels it is not clocked per cycle: the APU runs it in batches up to each
+// register access and block boundary (run), and it turns the points where
+// its output changes into band-limited steps in the APU's buffer. Register
+// writes reach it through APU::write_expansion() after the APU has caught up,
+// and are logged for deferred audio like the 2A03's.
+class ExpansionAudio
+{
+public:
+	virtual ~ExpansionAudio() {}
+
+	virtual bool handles(uint16_t address) const = 0;
+	virtual void write(uint16_t address, uint8_t data) = 0;
+	virtual uint8_t read(uint16_t address) { (void)address; return 0x00; }
+	virtual void reset() = 0;
+	// Copy for a shadow APU (deferred audio), to be attached to its buffer
+	virtual std::unique_ptr<ExpansionAudio> clone() const = 0;
+
+	// Runs from time to end (audio on only)
+	virtual void run(uint64_t end) = 0;
+	// Emits the output for state changed by a write at time
+	virtual void update() = 0;
+
+	// APU side: output target, and restarting from now after audio was off
+	void attach(BlipBuffer *output, const uint64_t *output_block_start)
+	{
+		blip = output;
+		block_start = output_block_start;
+	}
+	void restart(uint64_t now);
+
+	uint64_t time = 0; // CPU cycle the chip has caught up to
+
+protected:
+	void emit(int &output, int value, float weight, uint64_t when);
+	virtual void realign() = 0; // Channel clocks to time, outputs to silence
+
+private:
+	BlipBuffer *blip = nullptr;
+	const uint64_t *block_start = nullptr;
+};
+
+// Konami VRC6: two pulses with 16 step duty and a sawtooth. VRC6b (mapper 26)
+// swaps the two low address lines.
+class VRC6Audio final : public ExpansionAudio
+{
+public:
+	explicit VRC6Audio(bool swapped_lines = false) : swapped(swapped_lines) { reset(); }
+
+	bool handles(uint16_t address) const override;
+	void write(uint16_t address, uint8_t data) override;
+	void reset() override;
+	std::unique_ptr<ExpansionAudio> clone() const override { return std::make_unique<VRC6Audio>(*this); }
+	void run(uint64_t end) override;
+	void update() override;
+
+private:
+	void realign() override;
+	void rephase(); // Dividers restart at time; outputs keep their level (halt release)
+
+	struct Pulse
+	{
+		uint8_t volume = 0;
+		uint8_t duty = 0;
+		bool constant = false;
+		bool enabled = false;
+		uint16_t period = 0;
+		uint8_t step = 15;
+		uint64_t next_clock = 0;
+		int output = 0;
+
+		int amplitude() const { return enabled && (constant || step <= duty) ? volume : 0; }
+	};
+	struct Saw
+	{
+		uint8_t rate = 0;
+		bool enabled = false;
+		uint16_t period = 0;
+		uint8_t step = 0;
+		uint8_t accumulator = 0;
+		uint64_t next_clock = 0;
+		int output = 0;
+
+		int amplitude() const { return enabled ? accumulator >> 3 : 0; }
+	};
+
+	uint32_t divider(uint16_t period) const { return (period >> shift) + 1; }
+
+	bool swapped;
+	Pulse pulse[2];
+	Saw saw;
+	bool halt = false;
+	int shift = 0; // $9003 frequency scaling
+};
+
+// Sunsoft 5B (FME-7 with audio): three square tone channels of the YM2149
+// family with logarithmic volume. Noise and the envelope generator are not
+// emulated; the only game using the chip plays tones.
+class Sunsoft5BAudio final : public ExpansionAudio
+{
+public:
+	Sunsoft5BAudio() { reset(); }
+
+	bool handles(uint16_t address) const override;
+	void write(uint16_t address, uint8_t data) override;
+	void reset() override;
+	std::unique_ptr<ExpansionAudio> clone() const override { return std::make_unique<Sunsoft5BAudio>(*this); }
+	void run(uint64_t end) override;
+	void update() override;
+
+private:
+	void realign() override;
+
+	struct Tone
+	{
+		uint16_t period = 0;
+		uint8_t volume = 0;
+		bool tone_enabled = false;
+		bool high = false;
+		uint64_t next_clock = 0;
+		int output = 0;
+	};
+	int amplitude(const Tone &tone) const;
+
+	uint8_t select = 0;
+	std::array<Tone, 3> tones;
+};
+
+// Namco 163: up to eight wavetable channels in 128 bytes of internal RAM. The
+// chip updates one channel every 15 CPU cycles and outputs them in turn; the
+// time-multiplexed output is mixed as the average of the active channels,
+// one step per update.
+class Namco163Audio final : public ExpansionAudio
+{
+public:
+	Namco163Audio() { reset(); }
+
+	bool handles(uint16_t address) const override;
+	void write(uint16_t address, uint8_t data) override;
+	uint8_t read(uint16_t address) override;
+	void reset() override;
+	std::unique_ptr<ExpansionAudio> clone() const override { return std::make_unique<Namco163Audio>(*this); }
+	void run(uint64_t end) override;
+	void update() override;
+
+private:
+	void realign() override;
+	int active_channels() const { return ((ram[0x7F] >> 4) & 0x07) + 1; }
+	int mix() const;
+	void clock_channel(int channel);
+
+	std::array<uint8_t, 128> ram;
+	std::array<int, 8> channel_output{};
+	uint8_t address = 0;
+	bool auto_increment = false;
+	bool disabled = false;
+	int current = 7; // Channel the next update goes to
+	uint64_t next_clock = 0;
+	int output = 0;
+};
+
+// Famicom Disk System: a 64 step wavetable channel with frequency modulation
+// and volume/modulation envelopes. Between events (wave position change,
+// modulator step, envelope tick) it advances in one step.
+class FDSAudio final : public ExpansionAudio
+{
+public:
+	FDSAudio() { reset(); }
+
+	bool handles(uint16_t address) const override;
+	void write(uint16_t address, uint8_t data) override;
+	uint8_t read(uint16_t address) override;
+	void reset() override;
+	std::unique_ptr<ExpansionAudio> clone() const override { return std::make_unique<FDSAudio>(*this); }
+	void run(uint64_t end) override;
+	void update() override;
+
+private:
+	void realign() override;
+
+	struct Envelope
+	{
+		bool direct = true;
+		bool increase = false;
+		uint8_t speed = 0;
+		uint8_t gain = 0;
+		uint32_t timer = 0;
+
+		void write(uint8_t data);
+		uint32_t period(uint8_t master) const { return 8u * master * (speed + 1); }
+	};
+
+	uint32_t pitch() const;
+	int amplitude() const;
+	bool envelopes_running() const { return !halt_wave && !halt_envelopes && envelope_speed != 0; }
+	bool modulator_running() const { return !halt_modulator && modulator_frequency != 0; }
+
+	std::array<uint8_t, 64> wave{};
+	std::array<uint8_t, 64> modulation{};
+	uint16_t frequency = 0;
+	uint32_t wave_accumulator = 0;
+	uint8_t wave_position = 0;
+	bool halt_wave = true;
+	bool halt_envelopes = false;
+	bool wave_write = false;
+	uint8_t master_volume = 0;
+	uint8_t envelope_speed = 0xE8;
+	Envelope volume;
+	Envelope sweep; // Modulation depth
+	uint16_t modulator_frequency = 0;
+	uint32_t modulator_accumulator = 0;
+	uint8_t modulator_position = 0;
+	int8_t counter = 0; // 7-bit signed
+	bool halt_modulator = true;
+	int output = 0;
+};
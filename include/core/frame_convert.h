@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+// Deferred conversion of palette-indexed frames to host pixel formats. Input
+// is one 2C02 colour index (0-63) per pixel plus one byte of emphasis bits
+// (PPUMASK >> 5) per line. Scalar and AVX2 kernels, chosen per conversion
+// call through Kernel::FRAME_CONVERT (cpu_features.h).
+
+// RGBA8888 with R in the lowest byte
+void convert_rgba8888(const uint8_t *indices, const uint8_t *emphasis, int width, int height, uint32_t *out);
+
+void convert_rgb565(const uint8_t *indices, const uint8_t *emphasis, int width, int height, uint16_t *out);
+
+// Planar YUV 4:2:0 (BT.601, limited range); width and height must be even.
+// Chroma is the rounded average of each 2x2 block.
+void convert_yuv420(const uint8_t *indices, const uint8_t *emphasis, int width, int height,
+					uint8_t *y_plane, uint8_t *u_plane, uint8_t *v_plane);
+
+// Single colour lookups
+uint32_t palette_rgba(uint8_t index, uint8_t emphasis);
+uint8_t palette_luma(uint8_t index, uint8_t emphasis);
+
+// 64 full range grayscale values (0.299 R + 0.587 G + 0.114 B) for one emphasis setting
+const uint8_t *palette_gray_table(uint8_t emphasis);
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+// 64-bit frame digests for duplicate and lag frame detection. The PPU hashes
+// each line as it is composed and folds the line hashes into the frame digest,
+// so no second pass over the framebuffer is needed. hash_frame() computes the
+// same digest from a stored frame.
+
+// xxHash64-style hash of one line: four independent lanes over 8 byte words.
+// size must be a multiple of 32.
+uint64_t hash_line(const uint8_t *data, int size, uint64_t seed);
+
+// Folds the next line hash into a running frame digest (order dependent)
+inline uint64_t hash_combine(uint64_t digest, uint64_t line_hash)
+{
+	digest ^= line_hash;
+	digest *= 0x9E3779B185EBCA87ull;
+	return digest ^ (digest >> 29);
+}
+
+constexpr uint64_t FRAME_HASH_SEED = 0x27D4EB2F165667C5ull;
+
+// Digest of a palette-indexed frame with per-line emphasis, as the PPU computes it
+uint64_t hash_frame(const uint8_t *indices, const uint8_t *emphasis, int width, int height);
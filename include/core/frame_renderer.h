@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+#include "core/ppu.h"
+#include "core/observation.h"
+
+class ShmRing;
+
+// One side effect of the CPU on the PPU, stamped with the dot it happened on
+struct PPUEvent
+{
+	enum class Kind : uint8_t
+	{
+		READ,	// $2002/$2007 reads move the write toggle and the VRAM address
+		WRITE,	// Register writes, including PPUDATA
+		OAM_DMA,  // Page data is in FrameLog::dma_pages
+		CHR_PAGE, // Mapper bank switch: page in address, offset in FrameLog::chr_offsets
+		MIRRORING // Mapper mirroring change, the Mirror in data
+	};
+
+	int16_t scanline;
+	int16_t cycle;
+	Kind kind;
+	uint8_t address;
+	uint8_t data;
+};
+
+struct FrameLog
+{
+	std::vector<PPUEvent> events;
+	std::vector<std::array<uint8_t, 256>> dma_pages;
+	std::vector<uint32_t> chr_offsets;
+
+	void clear()
+	{
+		events.clear();
+		dma_pages.clear();
+		chr_offsets.clear();
+	}
+};
+
+// Deferred renderer: the emulated PPU hands over a snapshot of its state at
+// the start of each frame plus the log of everything the CPU did to it, and
+// worker threads replay the log to compose the frame. With several threads
+// each one replays the whole log but composes only its own band of scanlines.
+// Snapshots carry the PPU's registers and memory, not its caches: each worker
+// keeps its own decoded tiles and background lines from frame to frame.
+class FrameRenderer
+{
+public:
+	// Called on a worker thread, in frame order, once a frame is complete
+	using FrameCallback = std::function<void(uint64_t frame, const uint8_t *indices, const uint8_t *emphasis)>;
+
+	explicit FrameRenderer(int threads = 1, int max_pending = 3);
+	~FrameRenderer();
+
+	void set_callback(FrameCallback callback) { on_frame = std::move(callback); }
+
+	// Output stage, for the frames the emulated PPU no longer composes: the
+	// shared-memory ring, the frame hash and the observation are produced here
+	// before the callback runs. Set them before frames are submitted or after
+	// flush(); read the hash and the observation from the callback.
+	void set_frame_ring(ShmRing *ring) { frame_ring = ring; }
+	void set_frame_hashing(bool enabled) { frame_hashing = enabled; }
+	uint64_t get_frame_hash() const { return frame_hash; }
+	void set_observation(const Observation::Config &config);
+	void disable_observation() { observation_enabled = false; }
+	const Observation &get_observation() const { return observation; }
+
+	// Emulation thread: start recording a frame from the PPU's current state.
+	// Blocks while max_pending frames are still being rendered.
+	FrameLog *begin_frame(const PPU &ppu);
+	void end_frame();
+
+	// Waits until every submitted frame has been delivered
+	void flush();
+
+	int get_threads() const { return static_cast<int>(workers.size()); }
+
+private:
+	struct Job
+	{
+		PPU::RenderState snapshot;
+		FrameLog log;
+		std::array<uint8_t, PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT> frame;
+		std::array<uint8_t, PPU::SCREEN_HEIGHT> emphasis;
+		int bands_done = 0;
+	};
+
+	void worker_loop(int band);
+	void render_band(Job &job, PPU &shadow, int band);
+	void finish_frame(const Job &job);
+
+	std::vector<std::unique_ptr<Job>> jobs; // Ring of max_pending slots
+	std::vector<std::thread> workers;
+	FrameCallback on_frame;
+
+	ShmRing *frame_ring = nullptr;
+	bool frame_hashing = false;
+	uint64_t frame_hash = 0;
+	Observation observation;
+	bool observation_enabled = false;
+
+	std::mutex lock;
+	std::condition_variable job_ready;
+	std::condition_variable job_done;
+	uint64_t started = 0;	// Frames handed to begin_frame()
+	uint64_t submitted = 0; // Frames closed by end_frame()
+	uint64_t completed = 0; // Frames delivered to the callback
+	bool stopping = false;
+};
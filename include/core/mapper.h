@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <memory>
+
+#include "core/cartridge.h"
+#include "core/expansion_audio.h"
+#include "core/ppu.h"
+
+// Built-in mappers; anything else is OTHER. The bus uses the kind to tell
+// which mappers need clocking per scanline.
+enum class MapperKind
+{
+	NROM,
+	MMC1,
+	UXROM,
+	CNROM,
+	AXROM,
+	MMC3,
+	OTHER
+};
+
+// CPU address space in 2 KiB pages. Reads and writes that land on a mapped
+// page go straight to memory; a null entry sends the access to the bus's
+// register path (PPU, APU, mapper registers). Bank switching only rewrites
+// entries, so no data moves.
+struct MemoryPages
+{
+	static constexpr int PAGE_BITS = 11;
+	static constexpr uint16_t PAGE_MASK = (1 << PAGE_BITS) - 1;
+	static constexpr int COUNT = 1 << (16 - PAGE_BITS);
+
+	std::array<const uint8_t *, COUNT> read{};
+	std::array<uint8_t *, COUNT> write{};
+
+	// Cheat overlays (see Bus::add_cheat): a patched page keeps its memory in
+	// mapped but reads through the bus's patch path, so only reads from
+	// patched pages pay for the cheat lookup and bank switches keep the patch
+	std::array<const uint8_t *, COUNT> mapped{};
+	uint32_t patched = 0;
+
+	void map_read(int page, const uint8_t *memory)
+	{
+		mapped[page] = memory;
+		read[page] = (patched >> page) & 0x01 ? nullptr : memory;
+	}
+	void set_patched(uint32_t pages)
+	{
+		patched = pages;
+		for (int page = 0; page < COUNT; page++)
+			read[page] = (patched >> page) & 0x01 ? nullptr : mapped[page];
+	}
+};
+
+// Cartridge space of the CPU bus ($4020-$FFFF) and the CHR/mirroring wiring.
+// The mapper owns the CPU page table (the bus fills in the RAM pages): PRG RAM
+// is mapped at $6000-$7FFF and PRG ROM read-only at $8000-$FFFF, so ROM writes
+// reach cpu_write() as register writes. CHR banks map PPU pattern pages onto
+// the cartridge's CHR ROM, or onto the PPU's own 8 KiB for CHR RAM.
+class Mapper
+{
+public:
+	Mapper(Cartridge &cartridge, PPU &ppu, MapperKind kind);
+	virtual ~Mapper();
+
+	// Only called for addresses without a page, e.g. $4020-$5FFF
+	virtual uint8_t cpu_read(uint16_t address) { return read_standard(address); }
+	virtual void cpu_write(uint16_t address, uint8_t data) = 0;
+	virtual void reset() {}
+	// Clocked once per rendered scanline (PPU dot 260) when the mapper counts scanlines
+	virtual void scanline() {}
+
+	MapperKind get_kind() const { return kind; }
+	Cartridge &get_cartridge() { return cart; }
+	// Sound chip on the cartridge, run by the APU; its registers are written
+	// there before the mapper sees the same write
+	ExpansionAudio *get_audio() const { return audio.get(); }
+	MemoryPages pages;
+	bool irq = false; // Cartridge IRQ line
+
+protected:
+	std::unique_ptr<ExpansionAudio> audio;
+
+	uint8_t read_standard(uint16_t address) const
+	{
+		const uint8_t *page = pages.mapped[address >> MemoryPages::PAGE_BITS];
+		return page ? page[address & MemoryPages::PAGE_MASK] : 0x00; // Open bus
+	}
+
+	// Negative banks count from the end of the ROM
+	void map_prg_8k(int slot, int bank);
+	void map_prg_16k(int slot, int bank);
+	void map_prg_32k(int bank);
+	void map_chr_1k(int slot, int bank);
+	void map_chr_2k(int slot, int bank);
+	void map_chr_4k(int slot, int bank);
+	void map_chr_8k(int bank);
+	void set_mirroring(Mirror mirroring) { ppu.set_mirroring(mirroring); }
+
+	Cartridge &cart;
+	PPU &ppu;
+
+private:
+	MapperKind kind;
+	int prg_banks; // 8 KiB banks
+	int chr_banks; // 1 KiB banks
+};
+
+// 0: fixed 16 or 32 KiB PRG, 8 KiB CHR
+class NROM : public Mapper
+{
+public:
+	NROM(Cartridge &cartridge, PPU &ppu);
+	void cpu_write(uint16_t, uint8_t) override {} // No registers
+};
+
+// 1: serial-loaded control, CHR and PRG registers
+class MMC1 : public Mapper
+{
+public:
+	MMC1(Cartridge &cartridge, PPU &ppu);
+	void cpu_write(uint16_t address, uint8_t data) override;
+	void reset() override;
+
+private:
+	void update_banks();
+
+	uint8_t shift = 0x10; // The marker bit reaches bit 0 on the fifth write
+	uint8_t control = 0x0C;
+	uint8_t chr_bank[2] = {0, 0};
+	uint8_t prg_bank = 0;
+};
+
+// 2: switchable 16 KiB at $8000, last bank fixed at $C000
+class UxROM : public Mapper
+{
+public:
+	UxROM(Cartridge &cartridge, PPU &ppu);
+	void cpu_write(uint16_t address, uint8_t data) override;
+};
+
+// 3: switchable 8 KiB CHR
+class CNROM : public Mapper
+{
+public:
+	CNROM(Cartridge &cartridge, PPU &ppu);
+	void cpu_write(uint16_t address, uint8_t data) override;
+};
+
+// 7: switchable 32 KiB PRG and one-screen mirroring
+class AxROM : public Mapper
+{
+public:
+	AxROM(Cartridge &cartridge, PPU &ppu);
+	void cpu_write(uint16_t address, uint8_t data) override;
+};
+
+// 4: eight bank registers and a scanline IRQ counter
+class MMC3 : public Mapper
+{
+public:
+	MMC3(Cartridge &cartridge, PPU &ppu);
+	void cpu_write(uint16_t address, uint8_t data) override;
+	void reset() override;
+	void scanline() override;
+
+private:
+	void update_banks();
+	void update_chr_banks();
+	void update_prg_banks();
+
+	uint8_t bank_select = 0;
+	uint8_t registers[8] = {0, 2, 4, 5, 6, 7, 0, 1};
+	uint8_t irq_latch = 0;
+	uint8_t irq_counter = 0;
+	bool irq_reload = false;
+	bool irq_enabled = false;
+};
+
+// nullptr if the cartridge's mapper is not built in
+std::unique_ptr<Mapper> create_mapper(Cartridge &cartridge, PPU &ppu);
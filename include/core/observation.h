@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Downsampled grayscale frame built line by line as the PPU outputs them, for
+// agents that want e.g. 84x84 or 128x120 observations instead of the full
+// 256x240 frame. Each output pixel is the box-filtered average of the source
+// pixels mapping to it; with max pooling it is the maximum of that average
+// over the last two frames, which hides sprite flicker.
+class Observation
+{
+public:
+	struct Config
+	{
+		int width = 84;
+		int height = 84;
+
+		// Source pixels removed from each edge before scaling
+		int crop_left = 0;
+		int crop_top = 0;
+		int crop_right = 0;
+		int crop_bottom = 0;
+
+		bool max_pool = true;
+	};
+
+	Observation();
+	~Observation();
+
+	void configure(const Config &config);
+	const Config &get_config() const { return config; }
+
+	// One composed line of 2C02 colour indices and its emphasis bits
+	void add_line(int line, const uint8_t *indices, uint8_t emphasis);
+
+	// width * height bytes, row major
+	const uint8_t *data() const { return output.data(); }
+	int get_width() const { return config.width; }
+	int get_height() const { return config.height; }
+
+private:
+	void finish_row(int row);
+
+	Config config;
+
+	// Source line/column -> output row/column, -1 when cropped away
+	std::vector<int16_t> line_row;
+	std::vector<int16_t> column;
+	std::vector<uint16_t> column_width; // Source columns in each output column
+	std::vector<uint8_t> row_last;		// Last source line of its output row
+
+	std::vector<uint32_t> sum;
+	int lines_summed = 0;
+
+	std::vector<uint8_t> previous; // Last frame before pooling
+	std::vector<uint8_t> output;
+};
@@ -0,0 +1,344 @@
+#pragma once
+#include <cstdint>
+#include <array>
+
+#include "core/chr_cache.h"
+#include "core/observation.h"
+
+class FrameRenderer;
+struct FrameLog;
+class ShmRing;
+
+enum class Mirror
+{
+	HORIZONTAL,
+	VERTICAL,
+	ONESCREEN_LO,
+	ONESCREEN_HI,
+	FOUR_SCREEN // Extra nametable RAM on the board, nothing mirrored
+};
+
+class PPU
+{
+public:
+	PPU();
+	~PPU();
+
+	static constexpr int SCREEN_WIDTH = 256;
+	static constexpr int SCREEN_HEIGHT = 240;
+
+	// Communication with the main bus ($2000-$2007, mirrored every 8 bytes)
+	uint8_t cpu_read(uint16_t address, bool read_only = false);
+	void cpu_write(uint16_t address, uint8_t data);
+
+	// Communication with the PPU bus ($0000-$3FFF)
+	uint8_t ppu_read(uint16_t address) const;
+	void ppu_write(uint16_t address, uint8_t data);
+
+	// OAM DMA ($4014): copies a full 256 byte page starting at OAMADDR
+	void oam_dma(const uint8_t *page);
+
+	void clock();
+	void reset();
+
+	void set_mirroring(Mirror mode)
+	{
+		if (frame_log)
+			log_mirroring(mode);
+		mirroring = mode;
+		nametable_generation++;
+	}
+
+	// Frame skip: only one frame in every frames + 1 is composed. Skipped
+	// frames still update everything the CPU can observe (vblank, NMI, sprite 0
+	// hit, sprite overflow and the scroll registers) but leave the framebuffer alone.
+	void set_frame_skip(uint16_t frames) { frame_skip = frames; }
+	bool is_frame_rendered() const { return frame_rendered; } // Whether the last completed frame was composed
+
+	// Deferred rendering: the PPU composes nothing itself and instead logs
+	// every register access with its dot for the renderer's worker threads.
+	// Pass nullptr to go back to rendering inline. A frame being recorded is
+	// closed and still delivered, and inline rendering starts with the next one.
+	// The frame ring, hashing and observation below only see composed frames:
+	// in deferred mode set them on the renderer instead (frame_renderer.h).
+	void set_deferred_renderer(FrameRenderer *frame_renderer);
+
+	// The frame holds one 2C02 colour index (0-63) per pixel; the PPUMASK
+	// emphasis bits are kept per scanline. See frame_convert.h for RGB/YUV.
+	const std::array<uint8_t, SCREEN_WIDTH * SCREEN_HEIGHT> &get_frame() const { return frame; }
+	const std::array<uint8_t, SCREEN_HEIGHT> &get_frame_emphasis() const { return frame_emphasis; }
+
+	// Observation mode: composed lines go to a downsampled grayscale buffer
+	// instead of the framebuffer, which is then left untouched
+	void set_observation(const Observation::Config &config);
+	void disable_observation() { observation_enabled = false; }
+	const Observation &get_observation() const { return observation; }
+
+	// Publishes every composed frame into a shared-memory ring (see shm_ring.h)
+	void set_frame_ring(ShmRing *ring) { frame_ring = ring; }
+
+	// Digest of the last composed frame, built line by line (see frame_hash.h)
+	void set_frame_hashing(bool enabled) { frame_hashing = enabled; }
+	uint64_t get_frame_hash() const { return frame_hash; }
+
+	int16_t get_scanline() const { return scanline; }
+	int16_t get_cycle() const { return cycle; }
+
+	// Instrumentation
+	struct Stats
+	{
+		ChrCache::Stats chr_cache;
+		uint64_t background_line_hits = 0;	 // Background lines reused from an earlier frame
+		uint64_t background_line_misses = 0; // Background lines fetched and decoded
+	};
+	Stats get_stats() const;
+	void reset_stats();
+
+	// Cartridge CHR: the pattern tables are eight 1 KiB pages, each an offset
+	// into CHR memory, so a bank switch is a store and no data moves. nullptr
+	// selects the PPU's own pattern memory (no cartridge, or CHR RAM). Decoded
+	// tiles are keyed by CHR offset and stay valid across bank switches.
+	// CHR ROM ignores $2007 writes. Page and mirroring changes are logged for
+	// deferred rendering like register writes.
+	void set_chr_memory(const uint8_t *chr, uint32_t size);
+	void map_chr_page(int page, uint32_t offset)
+	{
+		if (chr_page[page] != offset)
+		{
+			if (frame_log)
+				log_chr_page(page, offset);
+			chr_page[page] = offset;
+			chr_generation++; // Background lines were built from the old bank
+		}
+	}
+	void set_chr_writable(bool writable) { chr_writable = writable; }
+	bool is_rendering() const { return rendering_enabled(); }
+
+	// Scanline counters (MMC3) are clocked by PPU A12 rising once per rendered
+	// line: at dot 260 when sprites are fetched from $1000 (or are 8x16), at dot
+	// 324 when only the background is. Returns the dot, or -1 when A12 never
+	// rises, and how many clock() calls away the next rise is from here.
+	int16_t a12_rise_dot() const;
+	uint32_t dots_until_a12_rise() const;
+
+	// Drops decoded tiles after writing to pattern directly instead of through ppu_write()
+	void invalidate_pattern_cache()
+	{
+		chr_cache.invalidate_all();
+		chr_generation++;
+	}
+
+	// Same for oam, which is otherwise only rescanned after $2004 writes and OAM DMA
+	void invalidate_sprite_buckets() { sprite_buckets_dirty = true; }
+
+	bool nmi = false;			 // Raised at the start of vblank, cleared by the bus
+	bool frame_complete = false; // Raised at the start of vblank, cleared by the consumer
+
+	enum class CTRL
+	{
+		NAMETABLE_X = (1 << 0),
+		NAMETABLE_Y = (1 << 1),
+		INCREMENT_MODE = (1 << 2),
+		PATTERN_SPRITE = (1 << 3),
+		PATTERN_BACKGROUND = (1 << 4),
+		SPRITE_SIZE = (1 << 5),
+		SLAVE_MODE = (1 << 6),
+		ENABLE_NMI = (1 << 7)
+	};
+
+	enum class MASK
+	{
+		GRAYSCALE = (1 << 0),
+		RENDER_BACKGROUND_LEFT = (1 << 1),
+		RENDER_SPRITES_LEFT = (1 << 2),
+		RENDER_BACKGROUND = (1 << 3),
+		RENDER_SPRITES = (1 << 4),
+		ENHANCE_RED = (1 << 5),
+		ENHANCE_GREEN = (1 << 6),
+		ENHANCE_BLUE = (1 << 7)
+	};
+
+	enum class STATUS
+	{
+		SPRITE_OVERFLOW = (1 << 5),
+		SPRITE_ZERO_HIT = (1 << 6),
+		VERTICAL_BLANK = (1 << 7)
+	};
+
+	std::array<uint8_t, 8 * 1024> pattern; // Internal CHR memory, see set_chr_memory()
+	std::array<uint8_t, 4 * 1024> vram;	   // Nametables; the upper 2 KiB only with FOUR_SCREEN
+	std::array<uint8_t, 32> palette;
+	std::array<uint8_t, 256> oam;
+
+private:
+	friend class FrameRenderer;
+
+	bool get_ctrl(CTRL flag) const { return (ctrl & static_cast<uint8_t>(flag)) != 0; }
+	bool get_mask(MASK flag) const { return (mask & static_cast<uint8_t>(flag)) != 0; }
+	bool rendering_enabled() const { return (mask & 0x18) != 0; }
+
+	uint16_t mirror_nametable(uint16_t address) const;
+	uint16_t mirror_palette(uint16_t address) const;
+
+	// Scanline renderer
+	void render_scanline();
+	void compose_scanline(uint8_t *out, uint8_t color_mask);
+	void render_background(std::array<uint8_t, SCREEN_WIDTH> &line);
+	void render_sprites(std::array<uint8_t, SCREEN_WIDTH> &line);
+	void detect_sprite_zero_hit();
+	void fetch_background(int first, int count, uint8_t *pixels);
+	void evaluate_sprites(int16_t target_line);
+	void fetch_tile_row(uint16_t address);
+
+	// Loopy scroll register updates
+	void increment_y();
+	void transfer_x();
+	void transfer_y();
+
+	// Registers
+	uint8_t ctrl = 0x00;
+	uint8_t mask = 0x00;
+	uint8_t status = 0x00;
+	uint8_t oam_addr = 0x00;
+	uint8_t data_buffer = 0x00;
+
+	uint16_t v = 0x0000; // Current VRAM address
+	uint16_t t = 0x0000; // Temporary VRAM address
+	uint8_t fine_x = 0x00;
+	bool w = false; // Write toggle
+
+	// Timing
+	int16_t scanline = 0;
+	int16_t cycle = 0;
+	bool odd_frame = false;
+	int16_t sprite_zero_hit_cycle = -1; // Dot on the current line where sprite 0 hits, -1 if none
+	uint32_t frame_number = 0;
+
+	uint16_t frame_skip = 0;
+	bool skip_frame = false;	 // Current frame is not composed
+	bool frame_rendered = false; // Last completed frame was composed
+
+	// Deferred rendering
+	// What a deferred frame is replayed from: registers, timing, the cache
+	// generations and memory, but none of the caches or outputs. Pattern
+	// memory is only carried while the PPU's own (CHR RAM) is in use.
+	struct RenderState
+	{
+		uint8_t ctrl, mask, status, oam_addr, data_buffer;
+		uint16_t v, t;
+		uint8_t fine_x;
+		bool w;
+		int16_t scanline, cycle;
+		bool odd_frame;
+		uint32_t frame_number;
+		Mirror mirroring;
+		bool chr_writable;
+		const uint8_t *external_chr;
+		uint32_t chr_size;
+		std::array<uint32_t, 8> chr_page;
+		std::array<std::array<uint32_t, 32>, 4> nametable_row_generation;
+		uint32_t chr_generation;
+		uint32_t nametable_generation;
+		std::array<uint8_t, 4 * 1024> vram;
+		std::array<uint8_t, 32> palette;
+		std::array<uint8_t, 256> oam;
+		std::array<uint8_t, 8 * 1024> pattern;
+	};
+	void save_render_state(RenderState &state) const;
+	void load_render_state(const RenderState &state);
+
+	FrameRenderer *renderer = nullptr;
+	FrameLog *frame_log = nullptr;				// Log of the frame being recorded
+	int16_t band_first = 0;						// Lines outside [band_first, band_last)
+	int16_t band_last = SCREEN_HEIGHT;			// are not composed
+	void log_event(uint8_t kind, uint16_t address, uint8_t data);
+	void end_deferred_frame(); // Submits the frame being recorded, if any
+	void log_chr_page(int page, uint32_t offset);
+	void log_mirroring(Mirror mode);
+
+	Mirror mirroring = Mirror::VERTICAL;
+	bool chr_writable = true;
+
+	// An offset per page rather than a pointer so that copies of the PPU
+	// (renderer snapshots) keep reading their own pattern memory
+	const uint8_t *external_chr = nullptr;
+	uint32_t chr_size = 8 * 1024;
+	std::array<uint32_t, 8> chr_page{0x0000, 0x0400, 0x0800, 0x0C00, 0x1000, 0x1400, 0x1800, 0x1C00};
+	const uint8_t *chr_data() const { return external_chr ? external_chr : pattern.data(); }
+	uint32_t chr_offset(uint16_t address) const { return chr_page[address >> 10] | (address & 0x03FF); }
+
+	// Sprites selected for the next line by evaluate_sprites()
+	struct SpriteEntry
+	{
+		uint8_t row; // Row of the sprite that lands on the next line
+		uint8_t tile;
+		uint8_t attribute;
+		uint8_t x;
+		bool sprite_zero;
+	};
+	std::array<SpriteEntry, 8> line_sprites;
+	uint8_t line_sprite_count = 0;
+
+	uint64_t sprite_row(const SpriteEntry &sprite);
+
+	// Sprite buckets: the first eight OAM indices on each line, rebuilt after
+	// OAM or the sprite size changes instead of scanning OAM on every line
+	void rebuild_sprite_buckets(uint8_t height);
+	std::array<std::array<uint8_t, 8>, SCREEN_HEIGHT> sprite_bucket;
+	std::array<uint8_t, SCREEN_HEIGHT> sprite_bucket_count{};
+	uint8_t sprite_bucket_height = 8;
+	bool sprite_buckets_dirty = true;
+
+	// Tile-fetch cache: nametable and attribute fetches for one row of 33
+	// tiles, shared by the 8 scanlines of a tile row. Keyed by the scroll
+	// address without fine Y and invalidated by any nametable write.
+	struct TileFetch
+	{
+		uint8_t tile;
+		uint8_t palette;
+	};
+	std::array<TileFetch, 33> tile_row;
+	uint16_t tile_row_address = 0xFFFF;
+	uint32_t nametable_generation = 0;
+	uint32_t tile_row_generation = 0;
+
+	// Background line cache: the background pixels of every visible line of
+	// the last frame, reused when nothing they were built from has changed.
+	// Nametable writes only dirty the tile rows they touch, per physical table;
+	// attribute writes dirty the four tile rows under the attribute byte.
+	struct BackgroundKey
+	{
+		uint16_t v;
+		uint8_t fine_x;
+		uint8_t pattern_table;
+		Mirror mirroring;
+		uint32_t row_generation[2]; // This row in the table and its horizontal neighbour
+		uint32_t chr_generation;
+
+		bool operator==(const BackgroundKey &) const = default;
+	};
+	BackgroundKey background_key() const;
+	void mark_nametable_dirty(uint16_t vram_address);
+
+	std::array<std::array<uint32_t, 32>, 4> nametable_row_generation{};
+	uint32_t chr_generation = 0;
+	std::array<BackgroundKey, SCREEN_HEIGHT> background_keys{};
+	std::array<uint8_t, SCREEN_WIDTH * SCREEN_HEIGHT> background_lines;
+	std::array<bool, SCREEN_HEIGHT> background_valid{};
+	uint64_t background_line_hits = 0;
+	uint64_t background_line_misses = 0;
+
+	ChrCache chr_cache;
+
+	std::array<uint8_t, SCREEN_WIDTH * SCREEN_HEIGHT> frame;
+	std::array<uint8_t, SCREEN_HEIGHT> frame_emphasis;
+
+	Observation observation;
+	bool observation_enabled = false;
+
+	ShmRing *frame_ring = nullptr;
+
+	bool frame_hashing = false;
+	uint64_t frame_digest = 0; // Lines composed so far this frame
+	uint64_t frame_hash = 0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class Region : uint8_t
+{
+	NTSC,
+	PAL,
+	DUAL,
+	DENDY
+};
+
+// One known dump. The file is an array of these after a 16 byte header
+// ("NESROMDB", version, count), sorted by crc32, little-endian.
+struct RomRecord
+{
+	enum Flags : uint8_t
+	{
+		VERTICAL = 0x01, // Hard-wired mirroring, horizontal otherwise
+		FOUR_SCREEN = 0x02,
+		BATTERY = 0x04
+	};
+
+	uint32_t crc32;	  // Of PRG ROM followed by CHR ROM, without header or trainer
+	uint8_t sha1[20]; // Same data; all zero for CRC-only entries
+	uint16_t mapper;
+	uint8_t flags;
+	Region region;
+	uint32_t reserved;
+};
+static_assert(sizeof(RomRecord) == 32, "RomRecord is the on-disk layout");
+
+// Header corrections keyed by ROM hash. The file is mapped read-only and
+// searched in place, so opening it costs nothing per entry. Only the CRC-32
+// is needed to rule an image out; SHA-1 is computed just for CRC hits.
+class RomDatabase
+{
+public:
+	RomDatabase();
+	~RomDatabase();
+	RomDatabase(const RomDatabase &) = delete;
+	RomDatabase &operator=(const RomDatabase &) = delete;
+
+	bool open(const std::string &path); // False if missing or malformed
+	void close();
+	// In-memory table, e.g. compiled in; sorted here
+	void set_records(std::vector<RomRecord> records);
+	static bool write(const std::string &path, std::vector<RomRecord> records);
+
+	size_t size() const { return count; }
+
+	// Record for PRG + CHR ROM, or nullptr
+	const RomRecord *find(const uint8_t *prg, size_t prg_size, const uint8_t *chr, size_t chr_size) const;
+
+	struct Stats
+	{
+		uint64_t lookups = 0;
+		uint64_t crc_hits = 0; // SHA-1 computed
+		uint64_t matches = 0;
+	};
+	Stats get_stats() const { return stats; }
+
+private:
+	const RomRecord *records = nullptr;
+	size_t count = 0;
+	void *mapped = nullptr;
+	size_t mapped_size = 0;
+	std::vector<RomRecord> owned;
+	mutable Stats stats;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Hashes for identifying ROM images (see rom_database.h).
+//
+// crc32() is the zlib/iNES CRC-32 (reflected polynomial 0xEDB88320). On x86
+// with PCLMULQDQ it folds 64 bytes per step with carry-less multiplies;
+// otherwise it uses slicing-by-8 tables. The SSE4.2 crc32 instruction is not
+// usable here: it computes CRC-32C, a different polynomial.
+// Pass the previous result as crc to continue over several buffers.
+uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0);
+uint32_t crc32_scalar(const uint8_t *data, size_t size, uint32_t crc = 0);
+bool crc32_accelerated();
+
+// SHA-1, incremental
+class Sha1
+{
+public:
+	Sha1();
+
+	void update(const uint8_t *data, size_t size);
+	void finish(uint8_t digest[20]);
+
+private:
+	void block(const uint8_t *data);
+
+	uint32_t state[5];
+	uint8_t buffer[64];
+	size_t buffered = 0;
+	uint64_t length = 0;
+};
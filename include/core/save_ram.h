@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct Cartridge;
+
+// Battery-backed PRG RAM kept in a save file. The game's RAM writes stay
+// plain stores through the bus page table; nothing is tracked per write.
+// Every flush_interval frames end_frame() compares the RAM with the last
+// saved copy, and when it changed hands a snapshot to a writer thread. The
+// writer puts it in path + ".tmp", syncs it and renames it over path, so a
+// crash leaves either the old save or the new one, never a torn file.
+class SaveRam
+{
+public:
+	explicit SaveRam(int flush_interval = 60);
+	~SaveRam();
+	SaveRam(const SaveRam &) = delete;
+	SaveRam &operator=(const SaveRam &) = delete;
+
+	// Loads an existing save into the cartridge's PRG RAM. A missing file is
+	// a new save; false if it exists but cannot be read.
+	bool open(std::shared_ptr<Cartridge> cartridge, const std::string &path);
+	void close(); // Saves any change and waits for the writer
+	bool is_open() const { return cartridge != nullptr; }
+
+	void end_frame();
+	void flush(); // Saves any change now and waits until it is on disk
+
+	struct Stats
+	{
+		uint64_t checks = 0;
+		uint64_t saves = 0;		// Files written
+		uint64_t coalesced = 0; // Snapshots replaced before the writer got to them
+		bool write_error = false;
+	};
+	Stats get_stats();
+
+private:
+	void check();
+	void writer_loop();
+	bool write_file(const std::vector<uint8_t> &data);
+
+	std::shared_ptr<Cartridge> cartridge;
+	std::string path;
+	int flush_interval;
+	int frames = 0;
+	std::vector<uint8_t> saved; // Contents as of the last snapshot
+
+	std::thread writer;
+	std::vector<uint8_t> pending; // Snapshot waiting for the writer
+	bool have_pending = false;
+	bool writing = false;
+	bool stopping = false;
+	Stats stats;
+
+	std::mutex lock;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+};
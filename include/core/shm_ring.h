@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <string>
+
+// Ring of fixed-size slots in POSIX shared memory, for handing finished frames
+// and audio blocks to other processes. One producer, any number of consumers:
+//
+//  - Every slot carries a sequence word. The producer makes it odd while it
+//    fills the slot and sets it to 2 * (sequence + 1) once the slot is published.
+//  - Consumers read the payload in place, then call validate() to make sure
+//    the producer did not start overwriting the slot meanwhile (seqlock).
+//  - The producer never waits. A consumer that falls more than slot_count
+//    behind just finds its sequence gone and skips ahead.
+class ShmRing
+{
+public:
+	ShmRing();
+	~ShmRing();
+	ShmRing(const ShmRing &) = delete;
+	ShmRing &operator=(const ShmRing &) = delete;
+
+	// Producer: creates (or replaces) the segment, which is unlinked again on destruction
+	bool create(const std::string &name, uint32_t slot_count, uint32_t slot_size);
+	// Consumer: maps an existing segment read-only
+	bool open(const std::string &name);
+	void close();
+
+	bool is_open() const { return header != nullptr; }
+	uint32_t get_slot_count() const;
+	uint32_t get_slot_size() const;
+
+	// Producer: fill the slot returned by begin_write(), then commit() it
+	uint8_t *begin_write();
+	void commit(uint32_t size, uint64_t tag);
+
+	// Number of slots published so far; the newest is get_published() - 1
+	uint64_t get_published() const;
+
+	// Consumer: payload of the given sequence, or nullptr if it is not
+	// published yet or already overwritten. Check validate() after reading it.
+	const uint8_t *acquire(uint64_t sequence, uint32_t &size, uint64_t &tag) const;
+	bool validate(uint64_t sequence) const;
+
+private:
+	struct Header;
+	struct Slot;
+	Slot *slot(uint64_t sequence) const;
+
+	Header *header = nullptr;
+	size_t mapped_size = 0;
+	std::string segment_name;
+	bool owner = false;
+	uint64_t writing = 0; // Producer's next sequence
+};
+
+// Frame slots hold the palette indices followed by the per-line emphasis bits
+constexpr uint32_t SHM_FRAME_SIZE = 256 * 240 + 240;
+
+bool publish_frame(ShmRing &ring, uint64_t frame, const uint8_t *indices, const uint8_t *emphasis);
+
+// Audio slots hold signed 16-bit mono samples, as many as fit, and are tagged
+// with the index of their first sample so a lapped consumer can tell the gap
+bool publish_audio(ShmRing &ring, uint64_t first_sample, const int16_t *samples, int count);
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+
+#include "core/cpu_features.h"
+
+// Pattern-table decode: combines the two bitplanes of 2bpp tile rows into one
+// byte per pixel, leftmost pixel first. Opaque pixels get the row's attribute
+// byte OR'd in, transparent pixels stay 0x00.
+using DecodePath = SimdPath;
+
+using DecodeFn = void (*)(const uint8_t *lo, const uint8_t *hi, const uint8_t *attribute, int count, uint8_t *out);
+using MergeFn = void (*)(uint8_t *pixels, const uint8_t *attribute, int count);
+
+// Decodes count tile rows into count * 8 pixels using the selected path
+void decode_tile_rows(const uint8_t *lo, const uint8_t *hi, const uint8_t *attribute, int count, uint8_t *out);
+
+// ORs attribute[i] into the opaque pixels of the already decoded row i
+void merge_tile_attributes(uint8_t *pixels, const uint8_t *attribute, int count);
+
+// The fastest supported path is selected at startup; tests and benchmarks can
+// override it (Kernel::TILE_DECODE in cpu_features.h)
+inline bool decode_path_supported(DecodePath path) { return kernel_path_supported(Kernel::TILE_DECODE, path); }
+inline bool set_decode_path(DecodePath path) { return set_kernel_path(Kernel::TILE_DECODE, path); }
+inline DecodePath get_decode_path() { return get_kernel_path(Kernel::TILE_DECODE); }
+inline const char *decode_path_name(DecodePath path) { return simd_path_name(path); }
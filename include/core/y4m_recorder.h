@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Raw video capture: frames are handed over as palette indices and converted
+// to YUV 4:2:0 and written as a Y4M stream by a dedicated thread. The caller
+// only copies the frame into a free queue buffer; when the encoder falls
+// behind, push_frame() waits instead of dropping frames.
+class Y4mRecorder
+{
+public:
+	explicit Y4mRecorder(int queue_frames = 8);
+	~Y4mRecorder();
+
+	// NTSC NES frame rate by default: 39375000 / 655171 (~60.0988 Hz)
+	bool open(const std::string &path, uint32_t rate_num = 39375000, uint32_t rate_den = 655171);
+	void close(); // Writes out every queued frame first
+	bool is_open() const { return file != nullptr; }
+
+	// Same layout as PPU::get_frame() and PPU::get_frame_emphasis()
+	void push_frame(const uint8_t *indices, const uint8_t *emphasis);
+
+	struct Stats
+	{
+		uint64_t frames_written = 0;
+		uint64_t producer_waits = 0; // push_frame() calls that found the queue full
+		bool write_error = false;
+	};
+	Stats get_stats();
+
+private:
+	void encoder_loop();
+
+	FILE *file = nullptr;
+	std::thread encoder;
+
+	// Ring of frame buffers, indices followed by emphasis
+	std::vector<std::vector<uint8_t>> queue;
+	uint64_t pushed = 0;
+	uint64_t written = 0;
+	bool stopping = false;
+	Stats stats;
+
+	std::mutex lock;
+	std::condition_variable frame_ready;
+	std::condition_variable slot_free;
+};
@@ -0,0 +1,703 @@
+#include <algorithm>
+#include <limits>
+
+#include "core/apu.h"
+#include "core/bus.h"
+#include "core/audio_renderer.h"
+#include "core/expansion_audio.h"
+
+/* Tables (NTSC) */
+static const uint8_t LENGTH_TABLE[32] = {
+	10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+	12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30};
+
+static const uint8_t DUTY_TABLE[4][8] = {
+	{0, 1, 0, 0, 0, 0, 0, 0},
+	{0, 1, 1, 0, 0, 0, 0, 0},
+	{0, 1, 1, 1, 1, 0, 0, 0},
+	{1, 0, 0, 1, 1, 1, 1, 1}};
+
+static const uint8_t TRIANGLE_TABLE[32] = {
+	15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+static const uint16_t NOISE_PERIOD[16] = {
+	4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068};
+
+static const uint16_t DMC_PERIOD[16] = {
+	428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54};
+
+// Frame sequencer steps in CPU cycles from the start of the sequence, and the sequence length
+static const uint32_t FRAME_STEPS[2][5] = {
+	{7457, 14913, 22371, 29829, 0},
+	{7457, 14913, 22371, 29829, 37281}};
+static const uint32_t FRAME_PERIOD[2] = {29830, 37282};
+
+// Longest stretch between two frame sequencer steps, or from a $4017 write to
+// the first step, which bounds a block
+static constexpr uint32_t MAX_BLOCK_CYCLES = 7461;
+
+APU::APU()
+{
+	set_sample_rate(sample_rate);
+	reset();
+}
+
+APU::~APU()
+{
+}
+
+void APU::reset()
+{
+	end_deferred_session(); // Cycle numbers start over
+	pulse[0] = Pulse();
+	pulse[1] = Pulse();
+	pulse[0].ones_complement = true;
+	triangle = Triangle();
+	triangle.output = TRIANGLE_TABLE[0]; // Resting level, not a step
+	noise = Noise();
+	dmc = DMC();
+	enabled = 0x00;
+
+	time = 0;
+	block_start = 0;
+	five_step = false;
+	irq_inhibit = false;
+	frame_irq = false;
+	dmc_irq = false;
+	frame_start = 0;
+	frame_step = 0;
+	next_frame_step = FRAME_STEPS[0][0];
+	stall_cycles = 0;
+
+	blip.clear();
+	if (expansion)
+	{
+		expansion->reset();
+		expansion->restart(0);
+	}
+}
+
+void APU::set_sample_rate(uint32_t rate)
+{
+	end_deferred_session(); // The shadow resamples at the old rate
+	sample_rate = rate;
+
+	// A quarter second of unread samples, plus room for the block being built
+	max_unread = static_cast<int>(rate / 4);
+	int block_samples = static_cast<int>(MAX_BLOCK_CYCLES * (rate / CLOCK_RATE)) + 2;
+	blip.set_rates(CLOCK_RATE, rate, max_unread + block_samples);
+}
+
+/* Envelope, sweep */
+void APU::Envelope::clock()
+{
+	if (start)
+	{
+		start = false;
+		decay = 15;
+		divider = period;
+	}
+	else if (divider == 0)
+	{
+		divider = period;
+		if (decay > 0)
+			decay--;
+		else if (loop)
+			decay = 15;
+	}
+	else
+	{
+		divider--;
+	}
+}
+
+uint16_t APU::Pulse::sweep_target() const
+{
+	uint16_t change = period >> sweep_shift;
+	if (!sweep_negate)
+		return period + change;
+	if (ones_complement)
+		change++;
+	return change > period ? 0 : period - change;
+}
+
+int APU::Pulse::amplitude() const
+{
+	if (length == 0 || muted() || !DUTY_TABLE[duty][step])
+		return 0;
+	return envelope.volume();
+}
+
+/* Registers */
+void APU::cpu_write(uint64_t cycle, uint16_t address, uint8_t data)
+{
+	run_until(cycle);
+	if (apu_log)
+		apu_log->writes.push_back({cycle, address, data});
+
+	switch (address)
+	{
+	case 0x4000:
+	case 0x4004:
+	{
+		Pulse &p = pulse[(address >> 2) & 0x01];
+		p.duty = data >> 6;
+		p.envelope.loop = data & 0x20;
+		p.envelope.constant = data & 0x10;
+		p.envelope.period = data & 0x0F;
+		break;
+	}
+	case 0x4001:
+	case 0x4005:
+	{
+		Pulse &p = pulse[(address >> 2) & 0x01];
+		p.sweep_enabled = data & 0x80;
+		p.sweep_period = (data >> 4) & 0x07;
+		p.sweep_negate = data & 0x08;
+		p.sweep_shift = data & 0x07;
+		p.sweep_reload = true;
+		break;
+	}
+	case 0x4002:
+	case 0x4006:
+	{
+		Pulse &p = pulse[(address >> 2) & 0x01];
+		p.period = (p.period & 0x0700) | data;
+		break;
+	}
+	case 0x4003:
+	case 0x4007:
+	{
+		int channel = (address >> 2) & 0x01;
+		Pulse &p = pulse[channel];
+		p.period = (p.period & 0x00FF) | ((data & 0x07) << 8);
+		if (enabled & (1 << channel))
+			p.length = LENGTH_TABLE[data >> 3];
+		p.step = 0;
+		p.envelope.start = true;
+		break;
+	}
+	case 0x4008:
+		triangle.control = data & 0x80;
+		triangle.linear_reload = data & 0x7F;
+		break;
+	case 0x400A:
+		triangle.period = (triangle.period & 0x0700) | data;
+		break;
+	case 0x400B:
+		triangle.period = (triangle.period & 0x00FF) | ((data & 0x07) << 8);
+		if (enabled & 0x04)
+			triangle.length = LENGTH_TABLE[data >> 3];
+		triangle.linear_reload_flag = true;
+		break;
+	case 0x400C:
+		noise.envelope.loop = data & 0x20;
+		noise.envelope.constant = data & 0x10;
+		noise.envelope.period = data & 0x0F;
+		break;
+	case 0x400E:
+		noise.mode = data & 0x80;
+		noise.period = NOISE_PERIOD[data & 0x0F];
+		break;
+	case 0x400F:
+		if (enabled & 0x08)
+			noise.length = LENGTH_TABLE[data >> 3];
+		noise.envelope.start = true;
+		break;
+	case 0x4010:
+		dmc.irq_enabled = data & 0x80;
+		dmc.loop = data & 0x40;
+		dmc.period = DMC_PERIOD[data & 0x0F];
+		if (!dmc.irq_enabled)
+			dmc_irq = false;
+		break;
+	case 0x4011:
+		dmc.level = data & 0x7F;
+		break;
+	case 0x4012:
+		dmc.sample_address = 0xC000 + data * 64;
+		break;
+	case 0x4013:
+		dmc.sample_length = data * 16 + 1;
+		break;
+	case 0x4015:
+		enabled = data & 0x1F;
+		if (!(data & 0x01))
+			pulse[0].length = 0;
+		if (!(data & 0x02))
+			pulse[1].length = 0;
+		if (!(data & 0x04))
+			triangle.length = 0;
+		if (!(data & 0x08))
+			noise.length = 0;
+		dmc_irq = false;
+		if (!(data & 0x10))
+		{
+			dmc.remaining = 0;
+		}
+		else if (dmc.remaining == 0)
+		{
+			dmc.address = dmc.sample_address;
+			dmc.remaining = dmc.sample_length;
+			dmc_fetch();
+		}
+		break;
+	case 0x4017:
+		five_step = data & 0x80;
+		irq_inhibit = data & 0x40;
+		if (irq_inhibit)
+			frame_irq = false;
+
+		// The sequence restarts 3 or 4 cycles later; 5-step mode clocks everything at once.
+		// The block so far ends here, so none outlasts MAX_BLOCK_CYCLES
+		end_block();
+		frame_start = cycle + ((cycle & 0x01) ? 4 : 3);
+		frame_step = 0;
+		next_frame_step = frame_start + FRAME_STEPS[five_step][0];
+		if (five_step)
+		{
+			clock_quarter_frame();
+			clock_half_frame();
+		}
+		break;
+	default:
+		break;
+	}
+
+	update_outputs();
+}
+
+uint8_t APU::cpu_read(uint64_t cycle, uint16_t address, bool read_only)
+{
+	if (address != 0x4015)
+		return 0x00;
+
+	run_until(cycle);
+	uint8_t data = (pulse[0].length ? 0x01 : 0x00) |
+				   (pulse[1].length ? 0x02 : 0x00) |
+				   (triangle.length ? 0x04 : 0x00) |
+				   (noise.length ? 0x08 : 0x00) |
+				   (dmc.remaining ? 0x10 : 0x00) |
+				   (frame_irq ? 0x40 : 0x00) |
+				   (dmc_irq ? 0x80 : 0x00);
+	if (!read_only)
+		frame_irq = false;
+	return data;
+}
+
+/* Expansion audio */
+void APU::set_expansion(ExpansionAudio *audio)
+{
+	end_deferred_session(); // The next session copies the new chip
+	expansion = audio;
+	if (expansion)
+	{
+		expansion->attach(&blip, &block_start);
+		expansion->restart(time);
+	}
+}
+
+void APU::write_expansion(uint64_t cycle, uint16_t address, uint8_t data)
+{
+	run_until(cycle);
+	if (apu_log)
+		apu_log->writes.push_back({cycle, address, data});
+	expansion->write(address, data);
+	if (audio_enabled)
+		expansion->update();
+}
+
+uint8_t APU::read_expansion(uint64_t cycle, uint16_t address)
+{
+	run_until(cycle);
+	if (apu_log)
+		apu_log->writes.push_back({cycle, address, 0x00, true});
+	return expansion->read(address);
+}
+
+uint16_t APU::take_stall_cycles()
+{
+	uint16_t cycles = stall_cycles;
+	stall_cycles = 0;
+	return cycles;
+}
+
+/* Catch-up */
+void APU::run_until(uint64_t cycle)
+{
+	// Everything scheduled before cycle happens; events on cycle itself wait for the next call
+	while (true)
+	{
+		// Channels run in one batch up to the next frame sequencer step
+		uint64_t end = std::min(cycle, next_frame_step);
+		if (end > time && audio_enabled)
+		{
+			run_pulse(pulse[0], 0, end);
+			run_pulse(pulse[1], 1, end);
+			run_triangle(end);
+			run_noise(end);
+			run_dmc(end);
+			if (expansion)
+				expansion->run(end);
+		}
+		else if (end > time)
+		{
+			run_dmc_timing(end);
+		}
+		time = std::max(time, end);
+
+		if (next_frame_step >= cycle)
+			break;
+		clock_frame_sequencer();
+		update_outputs();
+		end_block();
+	}
+}
+
+uint64_t APU::next_event_cycle() const
+{
+	uint64_t next = std::numeric_limits<uint64_t>::max();
+
+	// In 4-step mode the IRQ step is always still ahead in the current sequence
+	if (!five_step && !irq_inhibit && !frame_irq)
+		next = frame_start + FRAME_STEPS[0][3];
+
+	// The next fetch happens when the output unit empties the sample buffer
+	if (dmc.remaining > 0)
+		next = std::min(next, dmc.next_clock + static_cast<uint64_t>(dmc.bits - 1) * dmc.period);
+
+	// run_until() applies an event once it is past it
+	return next == std::numeric_limits<uint64_t>::max() ? next : next + 1;
+}
+
+void APU::clock_frame_sequencer()
+{
+	if (!five_step)
+	{
+		clock_quarter_frame();
+		if (frame_step & 0x01)
+			clock_half_frame();
+		if (frame_step == 3 && !irq_inhibit)
+			frame_irq = true;
+	}
+	else if (frame_step != 3)
+	{
+		clock_quarter_frame();
+		if (frame_step == 1 || frame_step == 4)
+			clock_half_frame();
+	}
+
+	frame_step++;
+	if (frame_step == (five_step ? 5 : 4))
+	{
+		frame_start += FRAME_PERIOD[five_step];
+		frame_step = 0;
+	}
+	next_frame_step = frame_start + FRAME_STEPS[five_step][frame_step];
+}
+
+void APU::clock_quarter_frame()
+{
+	pulse[0].envelope.clock();
+	pulse[1].envelope.clock();
+	noise.envelope.clock();
+
+	if (triangle.linear_reload_flag)
+		triangle.linear = triangle.linear_reload;
+	else if (triangle.linear > 0)
+		triangle.linear--;
+	if (!triangle.control)
+		triangle.linear_reload_flag = false;
+}
+
+void APU::clock_half_frame()
+{
+	for (Pulse &p : pulse)
+	{
+		if (!p.envelope.loop && p.length > 0)
+			p.length--;
+
+		if (p.sweep_divider == 0 && p.sweep_enabled && p.sweep_shift > 0 && !p.muted())
+			p.period = p.sweep_target();
+		if (p.sweep_divider == 0 || p.sweep_reload)
+		{
+			p.sweep_divider = p.sweep_period;
+			p.sweep_reload = false;
+		}
+		else
+		{
+			p.sweep_divider--;
+		}
+	}
+
+	if (!triangle.control && triangle.length > 0)
+		triangle.length--;
+	if (!noise.envelope.loop && noise.length > 0)
+		noise.length--;
+}
+
+void APU::update_outputs()
+{
+	if (!audio_enabled)
+		return;
+	emit(0, pulse[0].output, pulse[0].amplitude(), time);
+	emit(1, pulse[1].output, pulse[1].amplitude(), time);
+	emit(2, triangle.output, TRIANGLE_TABLE[triangle.step], time);
+	emit(3, noise.output, noise.amplitude(), time);
+	emit(4, dmc.output, dmc.level, time);
+}
+
+/* Channels */
+void APU::run_pulse(Pulse &p, int channel, uint64_t end)
+{
+	if (p.next_clock >= end)
+		return;
+
+	uint32_t period = (p.period + 1) * 2;
+	int volume = (p.length == 0 || p.muted()) ? 0 : p.envelope.volume();
+	if (volume == 0)
+	{
+		// Silent: only the sequencer position matters later
+		uint64_t steps = (end - p.next_clock + period - 1) / period;
+		p.step = (p.step + steps) & 0x07;
+		p.next_clock += steps * period;
+		return;
+	}
+
+	const uint8_t *duty = DUTY_TABLE[p.duty];
+	while (p.next_clock < end)
+	{
+		p.step = (p.step + 1) & 0x07;
+		emit(channel, p.output, duty[p.step] ? volume : 0, p.next_clock);
+		p.next_clock += period;
+	}
+}
+
+void APU::run_triangle(uint64_t end)
+{
+	if (triangle.next_clock >= end)
+		return;
+
+	uint32_t period = triangle.period + 1;
+
+	// The sequencer only moves while both counters are non-zero; periods
+	// below 2 are ultrasonic and held instead of aliasing
+	if (triangle.linear == 0 || triangle.length == 0 || triangle.period < 2)
+	{
+		uint64_t steps = (end - triangle.next_clock + period - 1) / period;
+		triangle.next_clock += steps * period;
+		return;
+	}
+
+	while (triangle.next_clock < end)
+	{
+		triangle.step = (triangle.step + 1) & 0x1F;
+		emit(2, triangle.output, TRIANGLE_TABLE[triangle.step], triangle.next_clock);
+		triangle.next_clock += period;
+	}
+}
+
+void APU::run_noise(uint64_t end)
+{
+	int volume = noise.length ? noise.envelope.volume() : 0;
+	int tap = noise.mode ? 6 : 1;
+
+	while (noise.next_clock < end)
+	{
+		uint16_t feedback = (noise.shift ^ (noise.shift >> tap)) & 0x01;
+		noise.shift = (noise.shift >> 1) | (feedback << 14);
+		if (volume)
+			emit(3, noise.output, (noise.shift & 0x01) ? 0 : volume, noise.next_clock);
+		noise.next_clock += noise.period;
+	}
+}
+
+void APU::run_dmc(uint64_t end)
+{
+	while (dmc.next_clock < end)
+	{
+		if (!dmc.silence)
+		{
+			if (dmc.shift & 0x01)
+			{
+				if (dmc.level <= 125)
+					dmc.level += 2;
+			}
+			else if (dmc.level >= 2)
+			{
+				dmc.level -= 2;
+			}
+			emit(4, dmc.output, dmc.level, dmc.next_clock);
+		}
+		dmc.shift >>= 1;
+
+		if (--dmc.bits == 0)
+		{
+			dmc.bits = 8;
+			dmc.silence = !dmc.buffer_full;
+			if (dmc.buffer_full)
+			{
+				dmc.shift = dmc.buffer;
+				dmc.buffer_full = false;
+				dmc_fetch();
+			}
+		}
+		dmc.next_clock += dmc.period;
+	}
+}
+
+void APU::run_dmc_timing(uint64_t end)
+{
+	// Only the clock that empties the shift register matters, one step per byte
+	while (dmc.next_clock < end)
+	{
+		uint64_t last_bit = dmc.next_clock + static_cast<uint64_t>(dmc.bits - 1) * dmc.period;
+		if (last_bit >= end)
+		{
+			uint64_t clocks = (end - dmc.next_clock + dmc.period - 1) / dmc.period;
+			dmc.bits -= static_cast<uint8_t>(clocks);
+			dmc.next_clock += clocks * dmc.period;
+			return;
+		}
+
+		dmc.bits = 8;
+		dmc.silence = !dmc.buffer_full;
+		if (dmc.buffer_full)
+		{
+			dmc.shift = dmc.buffer;
+			dmc.buffer_full = false;
+			dmc_fetch();
+		}
+		dmc.next_clock = last_bit + dmc.period;
+	}
+}
+
+// Memory reader: refills the sample buffer, stalling the CPU
+void APU::dmc_fetch()
+{
+	if (dmc.buffer_full || dmc.remaining == 0)
+		return;
+
+	if (dmc_replay)
+	{
+		dmc.buffer = dmc_replay_position < dmc_replay->size() ? (*dmc_replay)[dmc_replay_position++] : 0x00;
+	}
+	else
+	{
+		dmc.buffer = bus ? bus->read(dmc.address) : 0x00;
+		if (apu_log)
+			apu_log->dmc_bytes.push_back(dmc.buffer);
+	}
+	dmc.buffer_full = true;
+	stall_cycles += 4;
+	stats.dmc_fetches++;
+	dmc.address = dmc.address == 0xFFFF ? 0x8000 : dmc.address + 1;
+
+	if (--dmc.remaining == 0)
+	{
+		if (dmc.loop)
+		{
+			dmc.address = dmc.sample_address;
+			dmc.remaining = dmc.sample_length;
+		}
+		else if (dmc.irq_enabled)
+		{
+			dmc_irq = true;
+		}
+	}
+}
+
+/* Output */
+void APU::set_audio_enabled(bool enabled)
+{
+	if (enabled == audio_enabled)
+		return;
+	audio_enabled = enabled;
+
+	// Waveform state was left behind: restart the channels from now with
+	// silence, and drop whatever was buffered
+	for (Pulse &p : pulse)
+	{
+		p.next_clock = std::max(p.next_clock, time);
+		p.output = 0;
+	}
+	triangle.next_clock = std::max(triangle.next_clock, time);
+	triangle.output = TRIANGLE_TABLE[triangle.step];
+	noise.next_clock = std::max(noise.next_clock, time);
+	noise.output = 0;
+	dmc.output = dmc.level;
+	if (expansion)
+		expansion->restart(time);
+	blip.clear();
+	block_start = time;
+}
+
+void APU::end_block()
+{
+	if (!audio_enabled)
+	{
+		block_start = time;
+		return;
+	}
+
+	// Nobody is reading: drop the oldest samples instead of overflowing
+	int available = blip.samples_available();
+	if (available > max_unread)
+		stats.samples_dropped += blip.read_samples(static_cast<int16_t *>(nullptr), available - max_unread);
+
+	int before = blip.samples_available();
+	blip.end_block(static_cast<uint32_t>(time - block_start));
+	block_start = time;
+	stats.samples_generated += blip.samples_available() - before;
+	stats.blocks++;
+}
+
+void APU::end_frame(uint64_t cycle)
+{
+	run_until(cycle);
+	if (time > block_start)
+		end_block();
+
+	if (!renderer)
+		return;
+	if (apu_log)
+	{
+		renderer->end_frame(cycle);
+	}
+	else
+	{
+		// First deferred frame: the snapshot goes out with audio still on
+		audio_before_deferred = audio_enabled;
+		apu_log = renderer->begin_frame(*this);
+		set_audio_enabled(false);
+		return;
+	}
+	apu_log = renderer->begin_frame(*this);
+}
+
+/* Deferred audio */
+void APU::set_deferred_renderer(AudioRenderer *audio_renderer)
+{
+	if (audio_renderer == renderer)
+		return;
+	end_deferred_session();
+	renderer = audio_renderer;
+}
+
+void APU::end_deferred_session()
+{
+	if (!apu_log)
+		return;
+
+	// The partial frame is still delivered
+	renderer->end_frame(time);
+	renderer->end_session();
+	apu_log = nullptr;
+	set_audio_enabled(audio_before_deferred);
+}
+
+int APU::read_samples(int16_t *out, int count)
+{
+	return blip.read_samples(out, count);
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <chrono>
+
+#include "core/audio_output.h"
+#include "core/apu.h"
+#include "core/shm_ring.h"
+
+AudioOutput::AudioOutput(uint32_t sample_rate, int target_ms, int capacity_ms)
+	: sample_rate(sample_rate),
+	  ring(static_cast<int>(sample_rate * capacity_ms / 1000)),
+	  control(static_cast<int>(sample_rate * target_ms / 1000))
+{
+	scratch.resize(sample_rate / 10);
+}
+
+AudioOutput::~AudioOutput()
+{
+	close();
+}
+
+/* Emulation thread */
+void AudioOutput::push(APU &apu)
+{
+	// The ring and the device run at our rate; samples made at another one are dropped
+	if (apu.get_sample_rate() != sample_rate)
+		apu.set_sample_rate(sample_rate);
+
+	int count;
+	while ((count = apu.read_samples(scratch.data(), static_cast<int>(scratch.size()))) > 0)
+	{
+		ring.write(scratch.data(), count);
+		if (shm_ring)
+			publish_audio(*shm_ring, samples_pushed, scratch.data(), count);
+		samples_pushed += count;
+	}
+
+	apu.set_rate_ratio(control.update(ring.fill()));
+}
+
+AudioOutput::Stats AudioOutput::get_stats() const
+{
+	Stats stats;
+	stats.ring = ring.get_stats();
+	stats.fill_ms = ring.fill() * 1000.0 / sample_rate;
+	stats.rate_ratio = control.get_ratio();
+	stats.write_error = write_error.load();
+	return stats;
+}
+
+/* Null sink */
+bool AudioOutput::open_null_sink(const std::string &path, int period_ms)
+{
+	close();
+
+	if (!path.empty())
+	{
+		file = std::fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+	}
+
+	if (period_ms < 1)
+		period_ms = 1;
+	running = true;
+	sink = std::thread(&AudioOutput::sink_loop, this, static_cast<int>(sample_rate * period_ms / 1000), period_ms);
+	return true;
+}
+
+void AudioOutput::close()
+{
+	if (sink.joinable())
+	{
+		running = false;
+		sink.join();
+	}
+	if (file)
+	{
+		std::fclose(file);
+		file = nullptr;
+	}
+}
+
+void AudioOutput::sink_loop(int period_samples, int period_ms)
+{
+	using clock = std::chrono::steady_clock;
+	std::vector<int16_t> period(period_samples);
+	auto next = clock::now();
+
+	// Consumes one period per tick like a device would, padding underruns with silence
+	while (running)
+	{
+		next += std::chrono::milliseconds(period_ms);
+		std::this_thread::sleep_until(next);
+
+		int count = ring.read(period.data(), period_samples);
+		std::fill(period.begin() + count, period.end(), 0);
+		if (file && std::fwrite(period.data(), sizeof(int16_t), period.size(), file) != period.size())
+			write_error = true;
+	}
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cstring>
+
+#include "core/audio_recorder.h"
+#include "core/apu.h"
+
+AudioRecorder::AudioRecorder(int buffer_count, int buffer_samples)
+	: buffer_count(std::max(buffer_count, 2)), buffer_samples(std::max(buffer_samples, 256))
+{
+}
+
+AudioRecorder::~AudioRecorder()
+{
+	close();
+}
+
+/* WAV header */
+static void put16(uint8_t *out, uint16_t value)
+{
+	out[0] = value & 0xFF;
+	out[1] = value >> 8;
+}
+
+static void put32(uint8_t *out, uint32_t value)
+{
+	put16(out, value & 0xFFFF);
+	put16(out + 2, value >> 16);
+}
+
+// Canonical 44-byte header; the sizes are filled in by close()
+static void wav_header(uint8_t *out, uint32_t sample_rate, uint32_t data_bytes)
+{
+	std::memcpy(out, "RIFF", 4);
+	put32(out + 4, 36 + data_bytes);
+	std::memcpy(out + 8, "WAVEfmt ", 8);
+	put32(out + 16, 16);
+	put16(out + 20, 1); // PCM
+	put16(out + 22, 1); // Mono
+	put32(out + 24, sample_rate);
+	put32(out + 28, sample_rate * 2);
+	put16(out + 32, 2);
+	put16(out + 34, 16);
+	std::memcpy(out + 36, "data", 4);
+	put32(out + 40, data_bytes);
+}
+
+bool AudioRecorder::open(const std::string &path, uint32_t sample_rate, Format new_format)
+{
+	close();
+
+	file = std::fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+	format = new_format;
+	if (format == Format::WAV)
+	{
+		uint8_t header[44];
+		wav_header(header, sample_rate, 0);
+		std::fwrite(header, 1, sizeof(header), file);
+	}
+
+	pool.assign(buffer_count, std::vector<int16_t>(buffer_samples));
+	fill.assign(buffer_count, 0);
+	have_buffer = false;
+	pushed = 0;
+	written = 0;
+	stopping = false;
+	stats = Stats();
+	writer = std::thread(&AudioRecorder::writer_loop, this);
+	return true;
+}
+
+void AudioRecorder::close()
+{
+	if (!file)
+		return;
+
+	if (have_buffer && fill[pushed % pool.size()] > 0)
+		submit();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	buffer_ready.notify_all();
+	writer.join();
+
+	// Sizes are only known now; a data chunk over 4 GiB cannot be described
+	if (format == Format::WAV)
+	{
+		uint64_t bytes = std::min<uint64_t>(stats.samples_written * 2, 0xFFFFFFFFull - 36);
+		uint8_t size[4];
+		put32(size, static_cast<uint32_t>(36 + bytes));
+		bool ok = std::fseek(file, 4, SEEK_SET) == 0 && std::fwrite(size, 1, 4, file) == 4;
+		put32(size, static_cast<uint32_t>(bytes));
+		ok = ok && std::fseek(file, 40, SEEK_SET) == 0 && std::fwrite(size, 1, 4, file) == 4;
+		stats.write_error = stats.write_error || !ok;
+	}
+
+	stats.write_error = std::fclose(file) != 0 || stats.write_error;
+	file = nullptr;
+	pool.clear();
+}
+
+/* Emulation thread */
+int16_t *AudioRecorder::current_buffer()
+{
+	size_t slot = pushed % pool.size();
+	if (!have_buffer)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		if (pushed - written == pool.size())
+		{
+			stats.producer_waits++;
+			buffer_free.wait(guard, [this] { return pushed - written < pool.size(); });
+		}
+		have_buffer = true;
+		fill[slot] = 0;
+	}
+	return pool[slot].data();
+}
+
+void AudioRecorder::submit()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pushed++;
+	}
+	have_buffer = false;
+	buffer_ready.notify_one();
+}
+
+void AudioRecorder::push_samples(const int16_t *samples, int count)
+{
+	if (!file)
+		return;
+
+	while (count > 0)
+	{
+		int16_t *buffer = current_buffer();
+		int &used = fill[pushed % pool.size()];
+		int n = std::min(count, buffer_samples - used);
+		std::memcpy(buffer + used, samples, n * sizeof(int16_t));
+		used += n;
+		samples += n;
+		count -= n;
+		if (used == buffer_samples)
+			submit();
+	}
+}
+
+void AudioRecorder::push(APU &apu)
+{
+	if (!file)
+		return;
+
+	while (apu.samples_available() > 0)
+	{
+		int16_t *buffer = current_buffer();
+		int &used = fill[pushed % pool.size()];
+		used += apu.read_samples(buffer + used, buffer_samples - used);
+		if (used == buffer_samples)
+			submit();
+	}
+}
+
+AudioRecorder::Stats AudioRecorder::get_stats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
+
+/* Writer thread */
+void AudioRecorder::writer_loop()
+{
+	while (true)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		buffer_ready.wait(guard, [this] { return stopping || written < pushed; });
+		if (written == pushed)
+			return;
+		size_t slot = written % pool.size();
+		guard.unlock();
+
+		// WAV and raw are both little-endian, like every host this builds on
+		size_t count = fill[slot];
+		bool ok = std::fwrite(pool[slot].data(), sizeof(int16_t), count, file) == count;
+
+		guard.lock();
+		written++;
+		stats.samples_written += count;
+		stats.buffers_written++;
+		stats.write_error = stats.write_error || !ok;
+		guard.unlock();
+		buffer_free.notify_one();
+	}
+}
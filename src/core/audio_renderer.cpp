@@ -0,0 +1,131 @@
+#include "core/audio_renderer.h"
+
+AudioRenderer::AudioRenderer(int max_pending)
+{
+	if (max_pending < 1)
+		max_pending = 1;
+
+	for (int i = 0; i < max_pending; i++)
+		jobs.push_back(std::make_unique<Job>());
+	worker = std::thread(&AudioRenderer::worker_loop, this);
+}
+
+AudioRenderer::~AudioRenderer()
+{
+	flush();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	job_ready.notify_all();
+	worker.join();
+}
+
+/* Emulation thread */
+APULog *AudioRenderer::begin_frame(const APU &apu)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	job_done.wait(guard, [this] { return started - completed < jobs.size(); });
+	Job &job = *jobs[started % jobs.size()];
+	started++;
+	guard.unlock();
+
+	if (!in_session)
+	{
+		job.snapshot = std::make_unique<APU>(apu);
+		job.expansion = apu.expansion ? apu.expansion->clone() : nullptr;
+		in_session = true;
+	}
+	else
+	{
+		job.snapshot.reset();
+		job.expansion.reset();
+	}
+	job.log.clear();
+	return &job.log;
+}
+
+void AudioRenderer::end_frame(uint64_t cycle)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs[submitted % jobs.size()]->log.end_cycle = cycle;
+		submitted++;
+	}
+	job_ready.notify_all();
+}
+
+void AudioRenderer::end_session()
+{
+	in_session = false;
+}
+
+void AudioRenderer::flush()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	job_done.wait(guard, [this] { return completed == submitted; });
+}
+
+/* Worker */
+void AudioRenderer::worker_loop()
+{
+	std::unique_ptr<APU> shadow = std::make_unique<APU>();
+	uint64_t next = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			job_ready.wait(guard, [&] { return stopping || next < submitted; });
+			if (next >= submitted)
+				return;
+		}
+
+		Job &job = *jobs[next % jobs.size()];
+		render(job, *shadow);
+		if (on_frame)
+			on_frame(next, *shadow);
+		else
+			shadow->read_samples(nullptr, shadow->samples_available());
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			completed++;
+		}
+		job_done.notify_all();
+		next++;
+	}
+}
+
+void AudioRenderer::render(Job &job, APU &shadow)
+{
+	if (job.snapshot)
+	{
+		shadow = *job.snapshot;
+		shadow.bus = nullptr;
+		shadow.renderer = nullptr;
+		shadow.apu_log = nullptr;
+
+		// The chip's outputs match the copied buffer, so it carries on from there
+		shadow_expansion = std::move(job.expansion);
+		shadow.expansion = shadow_expansion.get();
+		if (shadow.expansion)
+			shadow.expansion->attach(&shadow.blip, &shadow.block_start);
+		shadow.set_audio_enabled(true);
+	}
+
+	shadow.dmc_replay = &job.log.dmc_bytes;
+	shadow.dmc_replay_position = 0;
+	for (const APUWrite &write : job.log.writes)
+	{
+		if (write.read)
+			shadow.read_expansion(write.cycle, write.address);
+		else if (shadow.expansion && shadow.expansion->handles(write.address))
+			shadow.write_expansion(write.cycle, write.address, write.data);
+		else
+			shadow.cpu_write(write.cycle, write.address, write.data);
+	}
+	shadow.end_frame(job.log.end_cycle);
+	shadow.take_stall_cycles();
+	shadow.dmc_replay = nullptr;
+}
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cstring>
+
+#include "core/audio_ring.h"
+
+/* Ring */
+AudioRing::AudioRing(int capacity)
+{
+	uint32_t size = 1;
+	while (size < static_cast<uint32_t>(std::max(capacity, 1)))
+		size <<= 1;
+	data.assign(size, 0);
+	mask = size - 1;
+}
+
+int AudioRing::write(const int16_t *samples, int count)
+{
+	uint64_t w = head.load(std::memory_order_relaxed);
+	uint64_t r = tail.load(std::memory_order_acquire);
+	int space = get_capacity() - static_cast<int>(w - r);
+	int n = std::min(count, space);
+	if (n < count)
+	{
+		overruns.fetch_add(1, std::memory_order_relaxed);
+		overrun_samples.fetch_add(count - n, std::memory_order_relaxed);
+	}
+
+	// At most two pieces: up to the end of the buffer, then from the start
+	uint32_t start = static_cast<uint32_t>(w) & mask;
+	int first = std::min(n, get_capacity() - static_cast<int>(start));
+	std::memcpy(&data[start], samples, first * sizeof(int16_t));
+	std::memcpy(&data[0], samples + first, (n - first) * sizeof(int16_t));
+
+	head.store(w + n, std::memory_order_release);
+	return n;
+}
+
+int AudioRing::read(int16_t *out, int count)
+{
+	uint64_t r = tail.load(std::memory_order_relaxed);
+	uint64_t w = head.load(std::memory_order_acquire);
+	int n = std::min(count, static_cast<int>(w - r));
+	if (n < count)
+	{
+		underruns.fetch_add(1, std::memory_order_relaxed);
+		underrun_samples.fetch_add(count - n, std::memory_order_relaxed);
+	}
+
+	uint32_t start = static_cast<uint32_t>(r) & mask;
+	int first = std::min(n, get_capacity() - static_cast<int>(start));
+	std::memcpy(out, &data[start], first * sizeof(int16_t));
+	std::memcpy(out + first, &data[0], (n - first) * sizeof(int16_t));
+
+	tail.store(r + n, std::memory_order_release);
+	return n;
+}
+
+int AudioRing::fill() const
+{
+	uint64_t r = tail.load(std::memory_order_acquire);
+	uint64_t w = head.load(std::memory_order_acquire);
+	return w > r ? static_cast<int>(w - r) : 0;
+}
+
+AudioRing::Stats AudioRing::get_stats() const
+{
+	Stats stats;
+	stats.samples_written = head.load(std::memory_order_acquire);
+	stats.samples_read = tail.load(std::memory_order_acquire);
+	stats.overruns = overruns.load(std::memory_order_relaxed);
+	stats.overrun_samples = overrun_samples.load(std::memory_order_relaxed);
+	stats.underruns = underruns.load(std::memory_order_relaxed);
+	stats.underrun_samples = underrun_samples.load(std::memory_order_relaxed);
+	return stats;
+}
+
+/* Rate control */
+AudioRateControl::AudioRateControl(int target_fill, double max_adjust)
+	: target(std::max(target_fill, 1)), max_adjust(max_adjust)
+{
+}
+
+double AudioRateControl::update(int fill)
+{
+	average = average < 0.0 ? fill : average + (fill - average) * 0.1;
+
+	// Linear in the distance from the target, saturating at an empty ring
+	double error = std::clamp((target - average) / target, -1.0, 1.0);
+	ratio = 1.0 + max_adjust * error;
+	return ratio;
+}
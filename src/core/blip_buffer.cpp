@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#include "core/blip_buffer.h"
+#include "core/cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NES_X86 1
+#endif
+
+/* Kernel pass: adds every step of a block to the buffer */
+using StepFn = void (*)(float *buffer, size_t size, const BlipBuffer::Step *steps, size_t count,
+						const float *kernels, int taps, int phase_bits, uint64_t position, uint64_t factor);
+
+static void add_steps_scalar(float *buffer, size_t size, const BlipBuffer::Step *steps, size_t count,
+							 const float *kernels, int taps, int phase_bits, uint64_t position, uint64_t factor)
+{
+	const uint32_t phase_mask = (1u << phase_bits) - 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t fixed = position + steps[i].time * factor;
+		size_t index = static_cast<size_t>(fixed >> 32);
+		if (index + taps > size)
+			continue; // Block too long for the buffer
+		const float *kernel = kernels + ((fixed >> (32 - phase_bits)) & phase_mask) * taps;
+		float *out = buffer + index;
+		for (int k = 0; k < taps; k++)
+			out[k] += kernel[k] * steps[i].delta;
+	}
+}
+
+#ifdef NES_X86
+/* AVX2: eight taps per register */
+__attribute__((target("avx2"))) static void add_steps_avx2(float *buffer, size_t size, const BlipBuffer::Step *steps, size_t count,
+														  const float *kernels, int taps, int phase_bits, uint64_t position, uint64_t factor)
+{
+	const uint32_t phase_mask = (1u << phase_bits) - 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t fixed = position + steps[i].time * factor;
+		size_t index = static_cast<size_t>(fixed >> 32);
+		if (index + taps > size)
+			continue;
+		const float *kernel = kernels + ((fixed >> (32 - phase_bits)) & phase_mask) * taps;
+		float *out = buffer + index;
+		__m256 delta = _mm256_set1_ps(steps[i].delta);
+		for (int k = 0; k < taps; k += 8)
+		{
+			// Multiply then add, not FMA, so the result matches the scalar pass bit for bit
+			__m256 sum = _mm256_add_ps(_mm256_loadu_ps(out + k), _mm256_mul_ps(_mm256_loadu_ps(kernel + k), delta));
+			_mm256_storeu_ps(out + k, sum);
+		}
+	}
+}
+#endif
+
+BlipBuffer::BlipBuffer()
+{
+	set_quality(Quality::MEDIUM);
+}
+
+BlipBuffer::~BlipBuffer()
+{
+}
+
+void BlipBuffer::set_quality(Quality new_quality)
+{
+	// Longer kernels get a sharper cutoff and, at HIGH, finer phases
+	static const int QUALITY_TAPS[3] = {8, 16, 32};
+	static const int QUALITY_PHASE_BITS[3] = {5, 5, 6};
+	static const double QUALITY_CUTOFF[3] = {0.80, 0.90, 0.95};
+
+	quality = new_quality;
+	int level = static_cast<int>(quality);
+	taps = QUALITY_TAPS[level];
+	phase_bits = QUALITY_PHASE_BITS[level];
+	const int phases = 1 << phase_bits;
+	const double cutoff = QUALITY_CUTOFF[level];
+
+	// One band-limited step derivative per sub-sample phase: a Blackman
+	// windowed sinc with its cutoff a little below Nyquist, normalized to 1
+	const double pi = 3.14159265358979323846;
+	kernels.assign(static_cast<size_t>(phases) * taps, 0.0f);
+	std::vector<double> row(taps);
+	for (int phase = 0; phase < phases; phase++)
+	{
+		double sum = 0.0;
+		for (int k = 0; k < taps; k++)
+		{
+			double x = k - (taps / 2 - 1) - static_cast<double>(phase) / phases;
+			double sinc = x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+			double w = (x + taps / 2.0) / taps; // 0..1 across the kernel
+			double window = 0.42 - 0.5 * std::cos(2.0 * pi * w) + 0.08 * std::cos(4.0 * pi * w);
+			row[k] = sinc * window;
+			sum += row[k];
+		}
+		for (int k = 0; k < taps; k++)
+			kernels[phase * taps + k] = static_cast<float>(row[k] / sum);
+	}
+}
+
+void BlipBuffer::set_rates(double new_clock_rate, double new_sample_rate, int max_samples)
+{
+	clock_rate = new_clock_rate;
+	sample_rate = new_sample_rate;
+	factor = static_cast<uint64_t>(sample_rate / clock_rate * 4294967296.0 + 0.5);
+	buffer.assign(max_samples + MAX_TAPS, 0.0f);
+
+	// DC blocker around 40 Hz
+	highpass_pole = static_cast<float>(std::exp(-2.0 * 3.14159265358979323846 * 40.0 / sample_rate));
+	clear();
+}
+
+void BlipBuffer::set_ratio(double ratio)
+{
+	factor = static_cast<uint64_t>(sample_rate * ratio / clock_rate * 4294967296.0 + 0.5);
+}
+
+void BlipBuffer::clear()
+{
+	std::fill(buffer.begin(), buffer.end(), 0.0f);
+	steps.clear();
+	position = 0;
+	integrator = 0.0f;
+	highpass_in = 0.0f;
+	highpass_out = 0.0f;
+}
+
+void BlipBuffer::end_block(uint32_t duration)
+{
+	StepFn add_steps = add_steps_scalar;
+#ifdef NES_X86
+	if (get_kernel_path(Kernel::RESAMPLER) == SimdPath::AVX2)
+		add_steps = add_steps_avx2;
+#endif
+	add_steps(buffer.data(), buffer.size(), steps.data(), steps.size(), kernels.data(), taps, phase_bits, position, factor);
+	steps.clear();
+	position += duration * factor;
+}
+
+uint32_t BlipBuffer::clocks_needed(int count) const
+{
+	uint64_t target = static_cast<uint64_t>(count) << 32;
+	if (target <= position)
+		return 0;
+	return static_cast<uint32_t>((target - position + factor - 1) / factor);
+}
+
+template <typename T>
+int BlipBuffer::read(T *out, int count)
+{
+	// Never past the buffer, even if a block ran longer than it was sized for
+	int available = std::min(samples_available(), static_cast<int>(buffer.size()) - MAX_TAPS);
+	count = std::min(count, available);
+	float sum = integrator;
+	float in = highpass_in;
+	float dc = highpass_out;
+	for (int i = 0; i < count; i++)
+	{
+		sum += buffer[i];
+		dc = sum - in + highpass_pole * dc;
+		in = sum;
+		if (out)
+		{
+			if constexpr (std::is_same_v<T, int16_t>)
+				out[i] = static_cast<int16_t>(std::clamp(dc * 32767.0f, -32768.0f, 32767.0f));
+			else
+				out[i] = dc;
+		}
+	}
+	integrator = sum;
+	highpass_in = in;
+	highpass_out = dc;
+
+	// Slide the unread part, including the tails of the last kernels, to the front
+	size_t used = std::min(buffer.size(), static_cast<size_t>(available + MAX_TAPS + 1));
+	std::memmove(buffer.data(), buffer.data() + count, (used - count) * sizeof(float));
+	std::fill(buffer.begin() + (used - count), buffer.begin() + used, 0.0f);
+	position -= static_cast<uint64_t>(count) << 32;
+	return count;
+}
+
+int BlipBuffer::read_samples(int16_t *out, int count)
+{
+	return read(out, count);
+}
+
+int BlipBuffer::read_samples(float *out, int count)
+{
+	return read(out, count);
+}
@@ -6,7 +6,17 @@ Bus::Bus()
 	for (auto &i : memory)
 		i = 0x00;
 
+	// Flat memory, except the pages holding the PPU and APU/IO registers
+	for (int page = 0; page < MemoryPages::COUNT; page++)
+	{
+		uint16_t base = static_cast<uint16_t>(page << MemoryPages::PAGE_BITS);
+		bool io = base >= 0x2000 && base < 0x4800;
+		flat_pages.map_read(page, io ? nullptr : &memory[base]);
+		flat_pages.write[page] = io ? nullptr : &memory[base];
+	}
+
 	cpu.connect_bus(this);
+	apu.connect_bus(this);
 }
 
 Bus::~Bus()
@@ -15,17 +25,245 @@ Bus::~Bus()
 
 void Bus::write(uint16_t address, uint8_t data)
 {
-	if (address < memory.size())
+	if (uint8_t *page = pages->write[address >> MemoryPages::PAGE_BITS])
+	{
+		page[address & MemoryPages::PAGE_MASK] = data;
+		return;
+	}
+	if (mapper && address >= 0x4020)
+	{
+		if (expansion_audio && expansion_audio->handles(address))
+		{
+			apu.write_expansion(cpu_cycles, address, data);
+			sync_apu();
+		}
+		mapper->cpu_write(address, data); // Registers; RAM and ROM pages never get here
+		return;
+	}
+
+	if (address >= 0x2000 && address <= 0x3FFF)
+	{
+		ppu.cpu_write(address & 0x0007, data);
+		if (scanline_counter && (address & 0x0007) <= 0x0001)
+			schedule_mapper_clock();
+	}
+	else if (address == 0x4014)
+	{
+		// OAM DMA: copy a whole CPU page into OAM and stall the CPU for 513/514 cycles
+		std::array<uint8_t, 256> page;
+		for (uint16_t i = 0; i < 256; i++)
+			page[i] = read((static_cast<uint16_t>(data) << 8) | i);
+		ppu.oam_dma(page.data());
+		dma_cycles = 513 + ((system_clock_counter / 3) & 0x01);
+	}
+	else if ((address >= 0x4000 && address <= 0x4013) || address == 0x4015 || address == 0x4017)
+	{
+		apu.cpu_write(cpu_cycles, address, data);
+		sync_apu();
+	}
+	else if (address < memory.size())
 	{
 		memory[address] = data;
 	}
 }
 
-uint8_t Bus::read(uint16_t address, bool read_only) const
+uint8_t Bus::read(uint16_t address, bool read_only)
 {
+	if (const uint8_t *page = pages->read[address >> MemoryPages::PAGE_BITS])
+		return page[address & MemoryPages::PAGE_MASK];
+	if ((pages->patched >> (address >> MemoryPages::PAGE_BITS)) & 0x01)
+		return read_patched(address, read_only);
+	return read_io(address, read_only);
+}
+
+uint8_t Bus::read_io(uint16_t address, bool read_only)
+{
+	if (mapper && address >= 0x4020)
+	{
+		// Peeks skip the chip: Namco 163 reads move its address
+		if (expansion_audio && !read_only && expansion_audio->handles(address))
+		{
+			uint8_t data = apu.read_expansion(cpu_cycles, address);
+			sync_apu();
+			return data;
+		}
+		return mapper->cpu_read(address);
+	}
+
+	if (address >= 0x2000 && address <= 0x3FFF)
+	{
+		return ppu.cpu_read(address & 0x0007, read_only);
+	}
+	if (address == 0x4015)
+	{
+		uint8_t data = apu.cpu_read(cpu_cycles, address, read_only);
+		sync_apu();
+		return data;
+	}
 	if (address < memory.size())
 	{
 		return memory[address];
 	}
 	return 0x00; //  Out of bounds
-}
\ No newline at end of file
+}
+
+/* Cheats */
+uint8_t Bus::read_patched(uint16_t address, bool read_only)
+{
+	const uint8_t *page = pages->mapped[address >> MemoryPages::PAGE_BITS];
+	uint8_t data = page ? page[address & MemoryPages::PAGE_MASK] : read_io(address, read_only);
+
+	// Compares see the byte of whatever bank is mapped right now
+	for (const Cheat &cheat : cheats)
+		if (cheat.address == address && (cheat.compare < 0 || cheat.compare == data))
+			return cheat.value;
+	return data;
+}
+
+void Bus::add_cheat(const Cheat &cheat)
+{
+	cheats.push_back(cheat);
+	patch_pages();
+}
+
+bool Bus::add_game_genie(const std::string &code)
+{
+	Cheat cheat;
+	if (!decode_game_genie(code, cheat))
+		return false;
+	add_cheat(cheat);
+	return true;
+}
+
+void Bus::clear_cheats()
+{
+	cheats.clear();
+	patch_pages();
+}
+
+void Bus::patch_pages()
+{
+	uint32_t patched = 0;
+	for (const Cheat &cheat : cheats)
+		patched |= 1u << (cheat.address >> MemoryPages::PAGE_BITS);
+	pages->set_patched(patched);
+}
+
+/* Cartridge */
+bool Bus::insert_cartridge(std::shared_ptr<Cartridge> new_cartridge)
+{
+	std::unique_ptr<Mapper> built_in = create_mapper(*new_cartridge, ppu);
+	if (!built_in)
+		return false;
+	insert_cartridge(std::move(new_cartridge), std::move(built_in));
+	return true;
+}
+
+void Bus::insert_cartridge(std::shared_ptr<Cartridge> new_cartridge, std::unique_ptr<Mapper> custom_mapper)
+{
+	apu.set_expansion(nullptr);
+	mapper.reset(); // Before the cartridge it refers to
+	cartridge = std::move(new_cartridge);
+	mapper = std::move(custom_mapper);
+	expansion_audio = mapper->get_audio();
+	apu.set_expansion(expansion_audio);
+	map_ram(mapper->pages);
+	pages = &mapper->pages;
+	patch_pages();
+	MapperKind kind = mapper->get_kind();
+	scanline_counter = kind == MapperKind::MMC3 || kind == MapperKind::OTHER;
+	schedule_mapper_clock();
+}
+
+// 2 KiB of RAM mirrored across $0000-$1FFF
+void Bus::map_ram(MemoryPages &table)
+{
+	for (int page = 0; page < (0x2000 >> MemoryPages::PAGE_BITS); page++)
+	{
+		table.map_read(page, memory.data());
+		table.write[page] = memory.data();
+	}
+}
+
+void Bus::eject_cartridge()
+{
+	pages = &flat_pages;
+	patch_pages();
+	apu.set_expansion(nullptr);
+	expansion_audio = nullptr;
+	mapper.reset();
+	cartridge.reset();
+	scanline_counter = false;
+	mapper_clock_dot = UINT64_MAX;
+	ppu.set_chr_memory(nullptr, 0);
+	ppu.set_chr_writable(true);
+}
+
+void Bus::reset()
+{
+	if (mapper)
+		mapper->reset();
+	cpu.reset();
+	ppu.reset();
+	apu.reset();
+	system_clock_counter = 0;
+	dma_cycles = 0;
+	cpu_cycles = 0;
+	apu_sync_cycle = apu.next_event_cycle();
+	schedule_mapper_clock();
+}
+
+void Bus::schedule_mapper_clock()
+{
+	uint32_t dots = scanline_counter ? ppu.dots_until_a12_rise() : 0;
+	mapper_clock_dot = dots ? ppu_dots + dots : UINT64_MAX;
+}
+
+// Applies what the APU did since the last catch-up: DMC stalls, and when the next catch-up is due
+void Bus::sync_apu()
+{
+	dma_cycles += apu.take_stall_cycles();
+	apu_sync_cycle = apu.next_event_cycle();
+}
+
+void Bus::clock()
+{
+	ppu.clock();
+	ppu_dots++;
+
+	if (ppu_dots == mapper_clock_dot)
+	{
+		mapper->scanline();
+		schedule_mapper_clock();
+	}
+
+	if (system_clock_counter % 3 == 0)
+	{
+		if (cpu_cycles >= apu_sync_cycle)
+		{
+			apu.run_until(cpu_cycles);
+			sync_apu();
+		}
+
+		if (dma_cycles > 0)
+		{
+			dma_cycles--;
+		}
+		else
+		{
+			// IRQ is level triggered and taken between instructions
+			if ((apu.irq() || (mapper && mapper->irq)) && cpu.instruction_done())
+				cpu.irq();
+			cpu.clock();
+		}
+		cpu_cycles++;
+	}
+
+	if (ppu.nmi)
+	{
+		ppu.nmi = false;
+		cpu.nmi();
+	}
+
+	system_clock_counter++;
+}
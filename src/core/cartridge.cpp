@@ -0,0 +1,75 @@
+#include <cstring>
+#include <fstream>
+
+#include "core/cartridge.h"
+
+bool Cartridge::load(const std::vector<uint8_t> &image, const RomDatabase *database)
+{
+	if (image.size() < 16 || std::memcmp(image.data(), "NES\x1A", 4) != 0)
+		return false;
+
+	const uint8_t *header = image.data();
+	bool nes2 = (header[7] & 0x0C) == 0x08;
+	size_t prg_size = header[4] * 16 * 1024;
+	size_t chr_size = header[5] * 8 * 1024;
+	if (nes2)
+	{
+		// Only the plain size encoding; the exponent form is for odd ROM sizes
+		prg_size += ((header[9] & 0x0F) << 8) * 16 * 1024;
+		chr_size += ((header[9] >> 4) << 8) * 8 * 1024;
+	}
+
+	mapper_id = (header[6] >> 4) | (header[7] & 0xF0);
+	if (nes2)
+		mapper_id |= (header[8] & 0x0F) << 8;
+	mirroring = (header[6] & 0x01) ? Mirror::VERTICAL : Mirror::HORIZONTAL;
+	battery = header[6] & 0x02;
+	four_screen = header[6] & 0x08;
+	region = Region::NTSC;
+	if (nes2)
+		region = static_cast<Region>(header[12] & 0x03);
+	else if (header[9] & 0x01)
+		region = Region::PAL;
+	header_corrected = false;
+
+	size_t offset = 16 + ((header[6] & 0x04) ? 512 : 0); // Skip the trainer
+	if (prg_size == 0 || image.size() < offset + prg_size + chr_size)
+		return false;
+
+	prg_rom.assign(image.begin() + offset, image.begin() + offset + prg_size);
+	offset += prg_size;
+	chr_ram = chr_size == 0;
+	if (chr_ram)
+		chr.assign(8 * 1024, 0x00);
+	else
+		chr.assign(image.begin() + offset, image.begin() + offset + chr_size);
+	prg_ram.assign(8 * 1024, 0x00);
+
+	if (database)
+	{
+		const RomRecord *record = database->find(prg_rom.data(), prg_rom.size(), chr_ram ? nullptr : chr.data(), chr_ram ? 0 : chr.size());
+		if (record)
+		{
+			mapper_id = record->mapper;
+			mirroring = (record->flags & RomRecord::VERTICAL) ? Mirror::VERTICAL : Mirror::HORIZONTAL;
+			four_screen = record->flags & RomRecord::FOUR_SCREEN;
+			battery = record->flags & RomRecord::BATTERY;
+			region = record->region;
+			header_corrected = true;
+		}
+	}
+	return true;
+}
+
+bool Cartridge::load_file(const std::string &path, const RomDatabase *database)
+{
+	// One sized read rather than a byte-wise stream copy
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if (!in)
+		return false;
+	std::vector<uint8_t> image(static_cast<size_t>(in.tellg()));
+	in.seekg(0);
+	if (!in.read(reinterpret_cast<char *>(image.data()), image.size()))
+		return false;
+	return load(image, database);
+}
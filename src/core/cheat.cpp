@@ -0,0 +1,36 @@
+#include <cctype>
+#include <cstring>
+
+#include "core/cheat.h"
+
+bool decode_game_genie(const std::string &code, Cheat &cheat)
+{
+	static const char LETTERS[] = "APZLGITYEOXUKSVN";
+
+	if (code.size() != 6 && code.size() != 8)
+		return false;
+	uint8_t n[8];
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		const char *letter = std::strchr(LETTERS, std::toupper(static_cast<unsigned char>(code[i])));
+		if (!letter || *letter == '\0')
+			return false;
+		n[i] = static_cast<uint8_t>(letter - LETTERS);
+	}
+
+	// The bits of each field are scattered over the letters
+	cheat.address = static_cast<uint16_t>(0x8000 | ((n[3] & 7) << 12) | ((n[5] & 7) << 8) | ((n[4] & 8) << 8) |
+										  ((n[2] & 7) << 4) | ((n[1] & 8) << 4) | (n[4] & 7) | (n[3] & 8));
+	cheat.value = static_cast<uint8_t>(((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7));
+	if (code.size() == 6)
+	{
+		cheat.value |= n[5] & 8;
+		cheat.compare = -1;
+	}
+	else
+	{
+		cheat.value |= n[7] & 8;
+		cheat.compare = static_cast<int16_t>(((n[7] & 7) << 4) | ((n[6] & 8) << 4) | (n[6] & 7) | (n[5] & 8));
+	}
+	return true;
+}
@@ -0,0 +1,57 @@
+#include <algorithm>
+
+#include "core/chr_cache.h"
+#include "core/tile_decode.h"
+
+ChrCache::ChrCache(uint32_t chr_size)
+{
+	resize(chr_size);
+}
+
+ChrCache::~ChrCache()
+{
+}
+
+void ChrCache::resize(uint32_t chr_size)
+{
+	uint32_t tiles = chr_size / 16;
+	pixels.assign(tiles * 64, 0x00);
+	valid.assign(tiles, 0);
+}
+
+void ChrCache::invalidate_all()
+{
+	std::fill(valid.begin(), valid.end(), 0);
+}
+
+const uint8_t *ChrCache::build(const uint8_t *chr, uint32_t index)
+{
+	// The 8 low-plane rows are followed by the 8 high-plane rows, so a whole
+	// tile decodes as one batch of eight rows
+	static const uint8_t no_attribute[8] = {};
+	const uint8_t *tile_data = chr + index * 16;
+	uint8_t *out = &pixels[index * 64];
+	decode_tile_rows(tile_data, tile_data + 8, no_attribute, 8, out);
+
+	valid[index] = 1;
+	misses++;
+	return out;
+}
+
+ChrCache::Stats ChrCache::get_stats() const
+{
+	Stats stats;
+	stats.hits = hits;
+	stats.misses = misses;
+	stats.invalidations = invalidations;
+	stats.tiles_valid = static_cast<uint32_t>(std::count(valid.begin(), valid.end(), 1));
+	stats.memory_bytes = static_cast<uint32_t>(pixels.size() + valid.size());
+	return stats;
+}
+
+void ChrCache::reset_stats()
+{
+	hits = 0;
+	misses = 0;
+	invalidations = 0;
+}
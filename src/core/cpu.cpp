@@ -56,6 +56,18 @@ void CPU::write_u16(uint16_t address, uint16_t data)
 	write(address + 1, (data >> 8) & 0xFF); // Write high byte
 }
 
+void CPU::push(uint8_t data)
+{
+	write(0x0100 + sp, data);
+	sp--;
+}
+
+uint8_t CPU::pop()
+{
+	sp++;
+	return read(0x0100 + sp);
+}
+
 /* Utility */
 uint16_t CPU::get_operand_address(AddressingMode mode) const
 {
@@ -118,6 +130,33 @@ void CPU::reset()
 	y = 0;
 	status = 0b100100;
 	pc = read_u16(0xFFFC);
+	cycles = 8;
+}
+
+/* Interrupts */
+void CPU::interrupt(uint16_t vector, bool brk)
+{
+	push((pc >> 8) & 0xFF);
+	push(pc & 0xFF);
+	push((status & ~static_cast<uint8_t>(FLAGS6502::BREAK)) |
+		 static_cast<uint8_t>(FLAGS6502::UNUSED) |
+		 (brk ? static_cast<uint8_t>(FLAGS6502::BREAK) : 0x00));
+	set_flag(FLAGS6502::INTERRUPT_DISABLE, true);
+	pc = read_u16(vector);
+}
+
+void CPU::irq()
+{
+	if (get_flag(FLAGS6502::INTERRUPT_DISABLE))
+		return;
+	interrupt(0xFFFE, false);
+	cycles = 7;
+}
+
+void CPU::nmi()
+{
+	interrupt(0xFFFA, false);
+	cycles = 8;
 }
 
 void CPU::load_and_run(const std::vector<uint8_t> &program)
@@ -357,46 +396,69 @@ void CPU::bne(AddressingMode mode) {}
 void CPU::beq(AddressingMode mode) {}
 void CPU::cld(AddressingMode mode) {}
 void CPU::sed(AddressingMode mode) {}
-void CPU::cli(AddressingMode mode) {}
-void CPU::sei(AddressingMode mode) {}
+void CPU::cli(AddressingMode mode) { set_flag(FLAGS6502::INTERRUPT_DISABLE, false); }
+void CPU::sei(AddressingMode mode) { set_flag(FLAGS6502::INTERRUPT_DISABLE, true); }
 void CPU::clv(AddressingMode mode) {}
 void CPU::pha(AddressingMode mode) {}
 void CPU::pla(AddressingMode mode) {}
 void CPU::php(AddressingMode mode) {}
 void CPU::plp(AddressingMode mode) {}
 
-void CPU::run()
+// Executes one instruction, returns false when it hits BRK
+bool CPU::step()
 {
-	while (1)
+	uint8_t code = read(pc);
+	pc++;
+	uint16_t current_pc = pc;
+	const Opcode &opcode = OPCODES[code];
+	cycles = opcode.cycles;
+
+	// Check if the handler exists
+	if (opcode.handler)
+	{
+		// Call the handler function pointer
+		(this->*opcode.handler)(opcode.mode);
+	}
+	else if (code == 0xEA)
+	{ // NOP
+		return true;
+	}
+	else if (code == 0x00)
+	{ // BRK
+		return false;
+	}
+	else
 	{
-		uint8_t code = read(pc);
-		pc++;
-		uint16_t current_pc = pc;
-		const Opcode &opcode = OPCODES[code];
+		THROW_CPU_EXCEPTION("Unsupported or invalid opcode");
+	}
 
-		// Check if the handler exists
-		if (opcode.handler)
-		{
-			// Call the handler function pointer
-			(this->*opcode.handler)(opcode.mode);
-		}
-		else if (code == 0xEA)
-		{ // NOP
-			continue;
-		}
-		else if (code == 0x00)
-		{ // BRK
-			return;
-		}
-		else
-		{
-			THROW_CPU_EXCEPTION("Unsupported or invalid opcode");
-		}
+	// We only increment the program counter if the opcode is not a branch or jump
+	if (current_pc == pc)
+	{
+		pc += opcode.length - 1;
+	}
+	return true;
+}
+
+void CPU::run()
+{
+	while (step())
+	{
+	}
+}
 
-		// We only increment the program counter if the opcode is not a branch or jump
-		if (current_pc == pc)
+// Cycle-stepped execution used by the bus: the whole instruction runs on its
+// first cycle and the remaining cycles are idled away
+void CPU::clock()
+{
+	if (cycles == 0)
+	{
+		if (!step())
 		{
-			pc += opcode.length - 1;
+			// BRK when clocked by the system: skip the padding byte and take the IRQ vector
+			pc++;
+			interrupt(0xFFFE, true);
 		}
 	}
+	cycles--;
 }
\ No newline at end of file
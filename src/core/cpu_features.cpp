@@ -0,0 +1,84 @@
+#include <atomic>
+
+#include "core/cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NES_X86 1
+#endif
+
+bool cpu_supports(SimdPath path)
+{
+	switch (path)
+	{
+	case SimdPath::SCALAR:
+		return true;
+#ifdef NES_X86
+	case SimdPath::SSE2:
+		__builtin_cpu_init(); // Also called during static initialisation
+		return __builtin_cpu_supports("sse2");
+	case SimdPath::BMI2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("bmi2");
+	case SimdPath::AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return false;
+	}
+}
+
+bool kernel_path_supported(Kernel kernel, SimdPath path)
+{
+	if (kernel != Kernel::TILE_DECODE && (path == SimdPath::SSE2 || path == SimdPath::BMI2))
+		return false;
+	return cpu_supports(path);
+}
+
+// BMI2 is never the default: the tile decoder's SSE2 path beats it
+static SimdPath best_path(Kernel kernel)
+{
+	for (SimdPath path : {SimdPath::AVX2, SimdPath::SSE2})
+	{
+		if (kernel_path_supported(kernel, path))
+			return path;
+	}
+	return SimdPath::SCALAR;
+}
+
+// Built on first use, so kernels can read it during static initialisation
+static std::atomic<SimdPath> *kernel_paths()
+{
+	static std::atomic<SimdPath> paths[static_cast<int>(Kernel::COUNT)] = {
+		best_path(Kernel::TILE_DECODE), best_path(Kernel::FRAME_CONVERT), best_path(Kernel::RESAMPLER)};
+	return paths;
+}
+
+bool set_kernel_path(Kernel kernel, SimdPath path)
+{
+	if (!kernel_path_supported(kernel, path))
+		return false;
+	kernel_paths()[static_cast<int>(kernel)].store(path, std::memory_order_relaxed);
+	return true;
+}
+
+SimdPath get_kernel_path(Kernel kernel)
+{
+	return kernel_paths()[static_cast<int>(kernel)].load(std::memory_order_relaxed);
+}
+
+const char *simd_path_name(SimdPath path)
+{
+	switch (path)
+	{
+	case SimdPath::SCALAR:
+		return "scalar";
+	case SimdPath::SSE2:
+		return "sse2";
+	case SimdPath::BMI2:
+		return "bmi2";
+	case SimdPath::AVX2:
+		return "avx2";
+	}
+	return "unknown";
+}
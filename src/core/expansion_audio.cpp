@@ -0,0 +1,595 @@
+#include <algorithm>
+#include <cmath>
+
+#include "core/expansion_audio.h"
+#include "core/blip_buffer.h"
+
+// Output per unit, on the scale of the 2A03 weights in apu.h
+static constexpr float VRC6_WEIGHT = 0.00752f; // Pulse volume and saw level alike
+static constexpr float SUNSOFT_5B_WEIGHT = 0.0006f;
+static constexpr float NAMCO_163_WEIGHT = 0.00015f;
+static constexpr float FDS_WEIGHT = 0.00012f;
+
+/* Base */
+void ExpansionAudio::restart(uint64_t now)
+{
+	time = now;
+	realign();
+}
+
+void ExpansionAudio::emit(int &output, int value, float weight, uint64_t when)
+{
+	if (value != output)
+	{
+		if (blip)
+			blip->add_delta(static_cast<uint32_t>(when - *block_start), (value - output) * weight);
+		output = value;
+	}
+}
+
+/* VRC6 */
+bool VRC6Audio::handles(uint16_t address) const
+{
+	return address >= 0x9000 && address <= 0xBFFF;
+}
+
+void VRC6Audio::reset()
+{
+	pulse[0] = Pulse();
+	pulse[1] = Pulse();
+	saw = Saw();
+	halt = false;
+	shift = 0;
+}
+
+void VRC6Audio::write(uint16_t address, uint8_t data)
+{
+	int reg = address & 0x03;
+	if (swapped)
+		reg = ((reg & 0x01) << 1) | (reg >> 1);
+
+	if (address < 0xB000)
+	{
+		if (address < 0xA000 && reg == 3)
+		{
+			// Frequency control, shared by all three channels
+			bool was_halted = halt;
+			halt = data & 0x01;
+			shift = (data & 0x04) ? 8 : (data & 0x02) ? 4 : 0;
+			if (was_halted && !halt)
+				rephase();
+			return;
+		}
+
+		Pulse &p = pulse[address < 0xA000 ? 0 : 1];
+		switch (reg)
+		{
+		case 0:
+			p.constant = data & 0x80;
+			p.duty = (data >> 4) & 0x07;
+			p.volume = data & 0x0F;
+			break;
+		case 1:
+			p.period = (p.period & 0x0F00) | data;
+			break;
+		case 2:
+			p.period = (p.period & 0x00FF) | ((data & 0x0F) << 8);
+			if (!(data & 0x80))
+				p.step = 15; // Disabling resets the duty sequence
+			else if (!p.enabled)
+				p.next_clock = time + divider(p.period);
+			p.enabled = data & 0x80;
+			break;
+		}
+		return;
+	}
+
+	switch (reg)
+	{
+	case 0:
+		saw.rate = data & 0x3F;
+		break;
+	case 1:
+		saw.period = (saw.period & 0x0F00) | data;
+		break;
+	case 2:
+		saw.period = (saw.period & 0x00FF) | ((data & 0x0F) << 8);
+		if (!(data & 0x80))
+		{
+			saw.step = 0;
+			saw.accumulator = 0;
+		}
+		else if (!saw.enabled)
+		{
+			saw.next_clock = time + divider(saw.period);
+		}
+		saw.enabled = data & 0x80;
+		break;
+	}
+}
+
+void VRC6Audio::run(uint64_t end)
+{
+	if (!halt && end > time)
+	{
+		for (Pulse &p : pulse)
+		{
+			if (!p.enabled || p.next_clock >= end)
+				continue;
+			uint32_t period = divider(p.period);
+			if (p.volume == 0 || p.constant)
+			{
+				// Level does not follow the sequence: only its position matters later
+				uint64_t steps = (end - p.next_clock + period - 1) / period;
+				p.step = (p.step - steps) & 0x0F;
+				p.next_clock += steps * period;
+				continue;
+			}
+			while (p.next_clock < end)
+			{
+				p.step = (p.step - 1) & 0x0F;
+				emit(p.output, p.amplitude(), VRC6_WEIGHT, p.next_clock);
+				p.next_clock += period;
+			}
+		}
+
+		if (saw.enabled)
+		{
+			uint32_t period = divider(saw.period);
+			while (saw.next_clock < end)
+			{
+				// The rate is added on every second clock, and the 7th addition resets
+				if (++saw.step == 14)
+				{
+					saw.step = 0;
+					saw.accumulator = 0;
+				}
+				else if (!(saw.step & 0x01))
+				{
+					saw.accumulator += saw.rate;
+				}
+				emit(saw.output, saw.amplitude(), VRC6_WEIGHT, saw.next_clock);
+				saw.next_clock += period;
+			}
+		}
+	}
+	time = std::max(time, end);
+}
+
+void VRC6Audio::update()
+{
+	emit(pulse[0].output, pulse[0].amplitude(), VRC6_WEIGHT, time);
+	emit(pulse[1].output, pulse[1].amplitude(), VRC6_WEIGHT, time);
+	emit(saw.output, saw.amplitude(), VRC6_WEIGHT, time);
+}
+
+void VRC6Audio::realign()
+{
+	rephase();
+	pulse[0].output = 0;
+	pulse[1].output = 0;
+	saw.output = 0;
+}
+
+void VRC6Audio::rephase()
+{
+	for (Pulse &p : pulse)
+		p.next_clock = time + divider(p.period);
+	saw.next_clock = time + divider(saw.period);
+}
+
+/* Sunsoft 5B */
+// 3 dB per volume step, 0 is silent
+static const std::array<int, 16> SUNSOFT_VOLUME = []
+{
+	std::array<int, 16> table{};
+	for (int volume = 1; volume < 16; volume++)
+		table[volume] = static_cast<int>(std::lround(255.0 * std::pow(10.0, -(15 - volume) * 3.0 / 20.0)));
+	return table;
+}();
+
+bool Sunsoft5BAudio::handles(uint16_t address) const
+{
+	return address >= 0xC000;
+}
+
+void Sunsoft5BAudio::reset()
+{
+	select = 0;
+	tones.fill(Tone());
+}
+
+void Sunsoft5BAudio::write(uint16_t address, uint8_t data)
+{
+	if (address < 0xE000)
+	{
+		select = data & 0x0F;
+		return;
+	}
+
+	if (select <= 5)
+	{
+		Tone &tone = tones[select >> 1];
+		if (select & 0x01)
+			tone.period = (tone.period & 0x00FF) | ((data & 0x0F) << 8);
+		else
+			tone.period = (tone.period & 0x0F00) | data;
+	}
+	else if (select == 7)
+	{
+		// Mixer bits are active low
+		for (int i = 0; i < 3; i++)
+			tones[i].tone_enabled = !(data & (1 << i));
+	}
+	else if (select >= 8 && select <= 10)
+	{
+		tones[select - 8].volume = data & 0x0F; // Bit 4 (envelope) is not emulated
+	}
+}
+
+int Sunsoft5BAudio::amplitude(const Tone &tone) const
+{
+	// A disabled tone holds the channel high
+	if (tone.tone_enabled && !tone.high)
+		return 0;
+	return SUNSOFT_VOLUME[tone.volume];
+}
+
+void Sunsoft5BAudio::run(uint64_t end)
+{
+	for (Tone &tone : tones)
+	{
+		if (tone.next_clock >= end)
+			continue;
+		uint32_t period = 16u * std::max<uint16_t>(tone.period, 1);
+		if (!tone.tone_enabled || tone.volume == 0)
+		{
+			uint64_t steps = (end - tone.next_clock + period - 1) / period;
+			tone.high ^= steps & 0x01;
+			tone.next_clock += steps * period;
+			continue;
+		}
+		while (tone.next_clock < end)
+		{
+			tone.high = !tone.high;
+			emit(tone.output, amplitude(tone), SUNSOFT_5B_WEIGHT, tone.next_clock);
+			tone.next_clock += period;
+		}
+	}
+	time = std::max(time, end);
+}
+
+void Sunsoft5BAudio::update()
+{
+	for (Tone &tone : tones)
+		emit(tone.output, amplitude(tone), SUNSOFT_5B_WEIGHT, time);
+}
+
+void Sunsoft5BAudio::realign()
+{
+	for (Tone &tone : tones)
+	{
+		tone.next_clock = time + 16u * std::max<uint16_t>(tone.period, 1);
+		tone.output = 0;
+	}
+}
+
+/* Namco 163 */
+bool Namco163Audio::handles(uint16_t address) const
+{
+	uint16_t port = address & 0xF800;
+	return port == 0x4800 || port == 0xE000 || port == 0xF800;
+}
+
+void Namco163Audio::reset()
+{
+	ram.fill(0x00);
+	channel_output.fill(0);
+	address = 0;
+	auto_increment = false;
+	disabled = false;
+	current = 7;
+}
+
+void Namco163Audio::write(uint16_t port, uint8_t data)
+{
+	switch (port & 0xF800)
+	{
+	case 0x4800:
+		ram[address] = data;
+		if (auto_increment)
+			address = (address + 1) & 0x7F;
+		break;
+	case 0xE000:
+		disabled = data & 0x40; // The rest selects a PRG bank
+		break;
+	case 0xF800:
+		address = data & 0x7F;
+		auto_increment = data & 0x80;
+		break;
+	}
+}
+
+uint8_t Namco163Audio::read(uint16_t port)
+{
+	if ((port & 0xF800) != 0x4800)
+		return 0x00;
+	uint8_t data = ram[address];
+	if (auto_increment)
+		address = (address + 1) & 0x7F;
+	return data;
+}
+
+// Channel registers at $40 + 8 * channel: frequency (18 bits), phase (24 bits),
+// wave length and address, volume
+void Namco163Audio::clock_channel(int channel)
+{
+	uint8_t *reg = &ram[0x40 + channel * 8];
+	uint32_t frequency = reg[0] | (reg[2] << 8) | ((reg[4] & 0x03) << 16);
+	uint32_t phase = reg[1] | (reg[3] << 8) | (reg[5] << 16);
+	uint32_t length = 256 - (reg[4] & 0xFC);
+
+	phase = (phase + frequency) % (length << 16);
+	reg[1] = phase & 0xFF;
+	reg[3] = (phase >> 8) & 0xFF;
+	reg[5] = (phase >> 16) & 0xFF;
+
+	uint8_t index = (reg[6] + (phase >> 16)) & 0xFF;
+	int sample = (ram[index >> 1] >> ((index & 0x01) * 4)) & 0x0F;
+	channel_output[channel] = (sample - 8) * (reg[7] & 0x0F);
+}
+
+int Namco163Audio::mix() const
+{
+	if (disabled)
+		return 0;
+	int count = active_channels();
+	int sum = 0;
+	for (int channel = 8 - count; channel < 8; channel++)
+		sum += channel_output[channel];
+	return sum * 8 / count;
+}
+
+void Namco163Audio::run(uint64_t end)
+{
+	if (disabled)
+	{
+		// Nothing is updated while the sound is off
+		if (next_clock < end)
+			next_clock += (end - next_clock + 14) / 15 * 15;
+	}
+	while (next_clock < end)
+	{
+		clock_channel(current);
+		current = current <= 8 - active_channels() ? 7 : current - 1;
+		emit(output, mix(), NAMCO_163_WEIGHT, next_clock);
+		next_clock += 15;
+	}
+	time = std::max(time, end);
+}
+
+void Namco163Audio::update()
+{
+	if (current < 8 - active_channels())
+		current = 7; // Fewer channels now
+	emit(output, mix(), NAMCO_163_WEIGHT, time);
+}
+
+void Namco163Audio::realign()
+{
+	next_clock = time + 15;
+	output = 0;
+}
+
+/* FDS */
+static const int8_t MODULATION_STEP[8] = {0, 1, 2, 4, 0, -4, -2, -1};
+static const int MASTER_VOLUME[4] = {30, 20, 15, 12}; // In 30ths
+
+bool FDSAudio::handles(uint16_t address) const
+{
+	return address >= 0x4040 && address <= 0x4092;
+}
+
+void FDSAudio::reset()
+{
+	wave.fill(0);
+	modulation.fill(0);
+	frequency = 0;
+	wave_accumulator = 0;
+	wave_position = 0;
+	halt_wave = true;
+	halt_envelopes = false;
+	wave_write = false;
+	master_volume = 0;
+	envelope_speed = 0xE8;
+	volume = Envelope();
+	sweep = Envelope();
+	modulator_frequency = 0;
+	modulator_accumulator = 0;
+	modulator_position = 0;
+	counter = 0;
+	halt_modulator = true;
+}
+
+void FDSAudio::Envelope::write(uint8_t data)
+{
+	direct = data & 0x80;
+	increase = data & 0x40;
+	speed = data & 0x3F;
+	if (direct)
+		gain = speed;
+	timer = 0; // Reloaded on the next run
+}
+
+void FDSAudio::write(uint16_t address, uint8_t data)
+{
+	if (address < 0x4080)
+	{
+		if (wave_write)
+			wave[address - 0x4040] = data & 0x3F;
+		return;
+	}
+
+	switch (address)
+	{
+	case 0x4080:
+		volume.write(data);
+		break;
+	case 0x4082:
+		frequency = (frequency & 0x0F00) | data;
+		break;
+	case 0x4083:
+		frequency = (frequency & 0x00FF) | ((data & 0x0F) << 8);
+		halt_envelopes = data & 0x40;
+		halt_wave = data & 0x80;
+		if (halt_wave)
+		{
+			wave_accumulator = 0;
+			wave_position = 0;
+		}
+		break;
+	case 0x4084:
+		sweep.write(data);
+		break;
+	case 0x4085:
+		counter = static_cast<int8_t>(static_cast<uint8_t>(data << 1)) >> 1;
+		break;
+	case 0x4086:
+		modulator_frequency = (modulator_frequency & 0x0F00) | data;
+		break;
+	case 0x4087:
+		modulator_frequency = (modulator_frequency & 0x00FF) | ((data & 0x0F) << 8);
+		halt_modulator = data & 0x80;
+		if (halt_modulator)
+			modulator_accumulator = 0;
+		break;
+	case 0x4088:
+		// The table is written two entries at a time while the modulator is halted
+		if (halt_modulator)
+		{
+			modulation[modulator_position] = data & 0x07;
+			modulation[(modulator_position + 1) & 0x3F] = data & 0x07;
+			modulator_position = (modulator_position + 2) & 0x3F;
+		}
+		break;
+	case 0x4089:
+		wave_write = data & 0x80;
+		master_volume = data & 0x03;
+		break;
+	case 0x408A:
+		envelope_speed = data;
+		break;
+	}
+}
+
+uint8_t FDSAudio::read(uint16_t address)
+{
+	if (address < 0x4080)
+		return wave[address - 0x4040] | 0x40;
+	if (address == 0x4090)
+		return volume.gain | 0x40;
+	if (address == 0x4092)
+		return sweep.gain | 0x40;
+	return 0x00;
+}
+
+// Wave frequency bent by the modulator counter and depth
+uint32_t FDSAudio::pitch() const
+{
+	if (!modulator_running())
+		return frequency;
+
+	int temp = counter * sweep.gain;
+	int remainder = temp & 0x0F;
+	temp >>= 4;
+	if (remainder > 0 && !(temp & 0x80))
+		temp += counter < 0 ? -1 : 2;
+	if (temp >= 192)
+		temp -= 256;
+	else if (temp < -64)
+		temp += 256;
+
+	temp *= frequency;
+	remainder = temp & 0x3F;
+	temp >>= 6;
+	if (remainder >= 32)
+		temp++;
+	return static_cast<uint32_t>(std::max(0, frequency + temp));
+}
+
+int FDSAudio::amplitude() const
+{
+	if (wave_write)
+		return output; // The output holds while the wave is rewritten
+	int gain = std::min<int>(volume.gain, 32);
+	return wave[wave_position] * gain * MASTER_VOLUME[master_volume] / 30;
+}
+
+void FDSAudio::run(uint64_t end)
+{
+	while (time < end)
+	{
+		// Advance to the next event in one step
+		uint64_t step = end - time;
+		uint32_t wave_pitch = halt_wave ? 0 : pitch();
+		if (wave_pitch)
+			step = std::min<uint64_t>(step, (0x10000 - (wave_accumulator & 0xFFFF) + wave_pitch - 1) / wave_pitch);
+		if (modulator_running())
+			step = std::min<uint64_t>(step, (0x10000 - modulator_accumulator + modulator_frequency - 1) / modulator_frequency);
+		bool envelopes = envelopes_running();
+		if (envelopes)
+		{
+			for (Envelope *envelope : {&volume, &sweep})
+			{
+				if (envelope->direct)
+					continue;
+				if (envelope->timer == 0)
+					envelope->timer = envelope->period(envelope_speed);
+				step = std::min<uint64_t>(step, envelope->timer);
+			}
+		}
+		time += step;
+
+		if (wave_pitch)
+		{
+			wave_accumulator = (wave_accumulator + wave_pitch * static_cast<uint32_t>(step)) & 0x3FFFFF;
+			wave_position = (wave_accumulator >> 16) & 0x3F;
+		}
+		if (modulator_running())
+		{
+			modulator_accumulator += modulator_frequency * static_cast<uint32_t>(step);
+			if (modulator_accumulator >= 0x10000)
+			{
+				modulator_accumulator &= 0xFFFF;
+				uint8_t value = modulation[modulator_position];
+				modulator_position = (modulator_position + 1) & 0x3F;
+				int next = value == 4 ? 0 : counter + MODULATION_STEP[value];
+				counter = static_cast<int8_t>(((next + 64) & 0x7F) - 64);
+			}
+		}
+		if (envelopes)
+		{
+			for (Envelope *envelope : {&volume, &sweep})
+			{
+				if (envelope->direct || (envelope->timer -= static_cast<uint32_t>(step)) != 0)
+					continue;
+				envelope->timer = envelope->period(envelope_speed);
+				if (envelope->increase && envelope->gain < 32)
+					envelope->gain++;
+				else if (!envelope->increase && envelope->gain > 0)
+					envelope->gain--;
+			}
+		}
+		emit(output, amplitude(), FDS_WEIGHT, time);
+	}
+}
+
+void FDSAudio::update()
+{
+	emit(output, amplitude(), FDS_WEIGHT, time);
+}
+
+void FDSAudio::realign()
+{
+	output = 0;
+}
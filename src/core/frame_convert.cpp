@@ -0,0 +1,282 @@
+#include <array>
+
+#include "core/frame_convert.h"
+#include "core/cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NES_X86 1
+#endif
+
+/* 2C02 system palette */
+static const uint8_t SYSTEM_PALETTE[64][3] = {
+	{84, 84, 84}, {0, 30, 116}, {8, 16, 144}, {48, 0, 136}, {68, 0, 100}, {92, 0, 48}, {84, 4, 0}, {60, 24, 0},
+	{32, 42, 0}, {8, 58, 0}, {0, 64, 0}, {0, 60, 0}, {0, 50, 60}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+
+	{152, 150, 152}, {8, 76, 196}, {48, 50, 236}, {92, 30, 228}, {136, 20, 176}, {160, 20, 100}, {152, 34, 32}, {120, 60, 0},
+	{84, 90, 0}, {40, 114, 0}, {8, 124, 0}, {0, 118, 40}, {0, 102, 120}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+
+	{236, 238, 236}, {76, 154, 236}, {120, 124, 236}, {176, 98, 236}, {228, 84, 236}, {236, 88, 180}, {236, 106, 100}, {212, 136, 32},
+	{160, 170, 0}, {116, 196, 0}, {76, 208, 32}, {56, 204, 108}, {56, 180, 204}, {60, 60, 60}, {0, 0, 0}, {0, 0, 0},
+
+	{236, 238, 236}, {168, 204, 236}, {188, 188, 236}, {212, 178, 236}, {236, 174, 236}, {236, 174, 212}, {236, 180, 176}, {228, 196, 144},
+	{204, 210, 120}, {180, 222, 120}, {168, 226, 144}, {152, 226, 180}, {160, 214, 228}, {160, 162, 160}, {0, 0, 0}, {0, 0, 0}};
+
+// Lookup tables for all 8 emphasis settings, 64 colours each
+struct PaletteTables
+{
+	std::array<uint32_t, 512> rgba;
+	std::array<uint32_t, 512> rgb565; // Widened so the AVX2 path can gather it
+	std::array<uint8_t, 512> y;
+	std::array<uint8_t, 512> u;
+	std::array<uint8_t, 512> v;
+	std::array<uint8_t, 512> gray; // Full range BT.601 luma
+
+	PaletteTables()
+	{
+		for (int e = 0; e < 8; e++)
+		{
+			for (int i = 0; i < 64; i++)
+			{
+				double r = SYSTEM_PALETTE[i][0];
+				double g = SYSTEM_PALETTE[i][1];
+				double b = SYSTEM_PALETTE[i][2];
+
+				// Emphasis darkens the channels that are not emphasized (approximation
+				// of the NTSC attenuation); columns $E/$F are black and unaffected
+				if (e != 0 && (i & 0x0F) < 0x0E)
+				{
+					const double attenuation = 0.75;
+					if (!(e & 0x01))
+						r *= attenuation;
+					if (!(e & 0x02))
+						g *= attenuation;
+					if (!(e & 0x04))
+						b *= attenuation;
+				}
+
+				uint8_t r8 = static_cast<uint8_t>(r + 0.5);
+				uint8_t g8 = static_cast<uint8_t>(g + 0.5);
+				uint8_t b8 = static_cast<uint8_t>(b + 0.5);
+				int index = e * 64 + i;
+
+				rgba[index] = 0xFF000000u | (b8 << 16) | (g8 << 8) | r8;
+				rgb565[index] = ((r8 >> 3) << 11) | ((g8 >> 2) << 5) | (b8 >> 3);
+				y[index] = static_cast<uint8_t>(16.0 + 0.257 * r8 + 0.504 * g8 + 0.098 * b8 + 0.5);
+				u[index] = static_cast<uint8_t>(128.0 - 0.148 * r8 - 0.291 * g8 + 0.439 * b8 + 0.5);
+				v[index] = static_cast<uint8_t>(128.0 + 0.439 * r8 - 0.368 * g8 - 0.071 * b8 + 0.5);
+				gray[index] = static_cast<uint8_t>(0.299 * r8 + 0.587 * g8 + 0.114 * b8 + 0.5);
+			}
+		}
+	}
+};
+
+static const PaletteTables &tables()
+{
+	static const PaletteTables instance;
+	return instance;
+}
+
+uint32_t palette_rgba(uint8_t index, uint8_t emphasis)
+{
+	return tables().rgba[(emphasis & 0x07) * 64 + (index & 0x3F)];
+}
+
+uint8_t palette_luma(uint8_t index, uint8_t emphasis)
+{
+	return tables().y[(emphasis & 0x07) * 64 + (index & 0x3F)];
+}
+
+const uint8_t *palette_gray_table(uint8_t emphasis)
+{
+	return &tables().gray[(emphasis & 0x07) * 64];
+}
+
+/* Scalar */
+template <typename T>
+static void lookup_scalar(const T *table, const uint8_t *indices, int count, T *out)
+{
+	for (int x = 0; x < count; x++)
+		out[x] = table[indices[x] & 0x3F];
+}
+
+static void lookup565_scalar(const uint32_t *table, const uint8_t *indices, int count, uint16_t *out)
+{
+	for (int x = 0; x < count; x++)
+		out[x] = static_cast<uint16_t>(table[indices[x] & 0x3F]);
+}
+
+// Averages each 2x2 block of two looked-up lines
+static void chroma_scalar(const uint8_t *table, const uint8_t *row0, const uint8_t *row1, int width, uint8_t *out)
+{
+	for (int x = 0; x < width; x += 2)
+	{
+		int left = (table[row0[x] & 0x3F] + table[row1[x] & 0x3F] + 1) >> 1;
+		int right = (table[row0[x + 1] & 0x3F] + table[row1[x + 1] & 0x3F] + 1) >> 1;
+		out[x / 2] = static_cast<uint8_t>((left + right + 1) >> 1);
+	}
+}
+
+#ifdef NES_X86
+/* AVX2 */
+// 32-bit gathers, 8 pixels per step
+__attribute__((target("avx2"))) static void lookup32_avx2(const uint32_t *table, const uint8_t *indices, int count, uint32_t *out)
+{
+	const __m256i index_mask = _mm256_set1_epi32(0x3F);
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + x)));
+		index = _mm256_and_si256(index, index_mask);
+		__m256i colour = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), index, 4);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), colour);
+	}
+	lookup_scalar(table, indices + x, count - x, out + x);
+}
+
+__attribute__((target("avx2"))) static void lookup565_avx2(const uint32_t *table, const uint8_t *indices, int count, uint16_t *out)
+{
+	const __m256i index_mask = _mm256_set1_epi32(0x3F);
+
+	int x = 0;
+	for (; x + 16 <= count; x += 16)
+	{
+		__m256i index0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + x)));
+		__m256i index1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + x + 8)));
+		__m256i c0 = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), _mm256_and_si256(index0, index_mask), 4);
+		__m256i c1 = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), _mm256_and_si256(index1, index_mask), 4);
+		// packus works per 128-bit lane, so restore the pixel order afterwards
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(c0, c1), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), packed);
+	}
+	lookup565_scalar(table, indices + x, count - x, out + x);
+}
+
+// 64-entry byte table lookup with four in-lane shuffles, 32 pixels per step
+__attribute__((target("avx2"))) static inline __m256i lookup8_step_avx2(const __m256i *lut, __m256i index)
+{
+	const __m256i low_mask = _mm256_set1_epi8(0x0F);
+	__m256i low = _mm256_and_si256(index, low_mask);
+	__m256i high = _mm256_and_si256(_mm256_srli_epi16(index, 4), _mm256_set1_epi8(0x03));
+
+	__m256i result = _mm256_setzero_si256();
+	for (int i = 0; i < 4; i++)
+	{
+		__m256i select = _mm256_cmpeq_epi8(high, _mm256_set1_epi8(static_cast<char>(i)));
+		result = _mm256_or_si256(result, _mm256_and_si256(select, _mm256_shuffle_epi8(lut[i], low)));
+	}
+	return result;
+}
+
+__attribute__((target("avx2"))) static void load_lut_avx2(const uint8_t *table, __m256i *lut)
+{
+	for (int i = 0; i < 4; i++)
+		lut[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(table + i * 16)));
+}
+
+__attribute__((target("avx2"))) static void lookup8_avx2(const uint8_t *table, const uint8_t *indices, int count, uint8_t *out)
+{
+	__m256i lut[4];
+	load_lut_avx2(table, lut);
+
+	int x = 0;
+	for (; x + 32 <= count; x += 32)
+	{
+		__m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices + x));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), lookup8_step_avx2(lut, index));
+	}
+	lookup_scalar(table, indices + x, count - x, out + x);
+}
+
+__attribute__((target("avx2"))) static void chroma_avx2(const uint8_t *table, const uint8_t *row0, const uint8_t *row1, int width, uint8_t *out)
+{
+	__m256i lut[4];
+	load_lut_avx2(table, lut);
+	const __m256i ones = _mm256_set1_epi8(1);
+	const __m256i one16 = _mm256_set1_epi16(1);
+
+	int x = 0;
+	for (; x + 64 <= width; x += 64)
+	{
+		__m256i sums[2];
+		for (int half = 0; half < 2; half++)
+		{
+			__m256i a = lookup8_step_avx2(lut, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row0 + x + half * 32)));
+			__m256i b = lookup8_step_avx2(lut, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1 + x + half * 32)));
+			__m256i vertical = _mm256_avg_epu8(a, b);
+			// Horizontal pairs summed to 16 bits, then rounded like the scalar path
+			__m256i pairs = _mm256_maddubs_epi16(vertical, ones);
+			sums[half] = _mm256_srli_epi16(_mm256_add_epi16(pairs, one16), 1);
+		}
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x / 2), packed);
+	}
+	if (x < width)
+		chroma_scalar(table, row0 + x, row1 + x, width - x, out + x / 2);
+}
+#endif
+
+using Lookup32Fn = void (*)(const uint32_t *table, const uint8_t *indices, int count, uint32_t *out);
+using Lookup565Fn = void (*)(const uint32_t *table, const uint8_t *indices, int count, uint16_t *out);
+using Lookup8Fn = void (*)(const uint8_t *table, const uint8_t *indices, int count, uint8_t *out);
+using ChromaFn = void (*)(const uint8_t *table, const uint8_t *row0, const uint8_t *row1, int width, uint8_t *out);
+
+static bool use_avx2()
+{
+	return get_kernel_path(Kernel::FRAME_CONVERT) == SimdPath::AVX2;
+}
+
+void convert_rgba8888(const uint8_t *indices, const uint8_t *emphasis, int width, int height, uint32_t *out)
+{
+	Lookup32Fn lookup = lookup_scalar<uint32_t>;
+#ifdef NES_X86
+	if (use_avx2())
+		lookup = lookup32_avx2;
+#endif
+
+	const PaletteTables &t = tables();
+	for (int line = 0; line < height; line++)
+		lookup(&t.rgba[(emphasis[line] & 0x07) * 64], indices + line * width, width, out + line * width);
+}
+
+void convert_rgb565(const uint8_t *indices, const uint8_t *emphasis, int width, int height, uint16_t *out)
+{
+	Lookup565Fn lookup = lookup565_scalar;
+#ifdef NES_X86
+	if (use_avx2())
+		lookup = lookup565_avx2;
+#endif
+
+	const PaletteTables &t = tables();
+	for (int line = 0; line < height; line++)
+		lookup(&t.rgb565[(emphasis[line] & 0x07) * 64], indices + line * width, width, out + line * width);
+}
+
+void convert_yuv420(const uint8_t *indices, const uint8_t *emphasis, int width, int height,
+					uint8_t *y_plane, uint8_t *u_plane, uint8_t *v_plane)
+{
+	Lookup8Fn lookup = lookup_scalar<uint8_t>;
+	ChromaFn chroma = chroma_scalar;
+#ifdef NES_X86
+	if (use_avx2())
+	{
+		lookup = lookup8_avx2;
+		chroma = chroma_avx2;
+	}
+#endif
+
+	const PaletteTables &t = tables();
+	for (int line = 0; line < height; line++)
+		lookup(&t.y[(emphasis[line] & 0x07) * 64], indices + line * width, width, y_plane + line * width);
+
+	// Chroma uses the emphasis of the upper line of each pair
+	for (int line = 0; line + 1 < height; line += 2)
+	{
+		const uint8_t *row0 = indices + line * width;
+		const uint8_t *row1 = row0 + width;
+		int offset = (emphasis[line] & 0x07) * 64;
+		chroma(&t.u[offset], row0, row1, width, u_plane + (line / 2) * (width / 2));
+		chroma(&t.v[offset], row0, row1, width, v_plane + (line / 2) * (width / 2));
+	}
+}
@@ -0,0 +1,54 @@
+#include <cstring>
+
+#include "core/frame_hash.h"
+
+static constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME2;
+	return rotl(acc, 31) * PRIME1;
+}
+
+uint64_t hash_line(const uint8_t *data, int size, uint64_t seed)
+{
+	// Independent lanes keep four multiplies in flight
+	uint64_t lane[4] = {seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1};
+	for (int i = 0; i < size; i += 32)
+	{
+		uint64_t word[4];
+		std::memcpy(word, data + i, 32);
+		lane[0] = hash_round(lane[0], word[0]);
+		lane[1] = hash_round(lane[1], word[1]);
+		lane[2] = hash_round(lane[2], word[2]);
+		lane[3] = hash_round(lane[3], word[3]);
+	}
+
+	uint64_t hash = rotl(lane[0], 1) + rotl(lane[1], 7) + rotl(lane[2], 12) + rotl(lane[3], 18);
+	for (uint64_t value : lane)
+		hash = (hash ^ hash_round(0, value)) * PRIME1 + PRIME4;
+	hash += static_cast<uint64_t>(size);
+
+	// Final avalanche
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	return hash ^ (hash >> 32);
+}
+
+uint64_t hash_frame(const uint8_t *indices, const uint8_t *emphasis, int width, int height)
+{
+	uint64_t digest = FRAME_HASH_SEED;
+	for (int y = 0; y < height; y++)
+		digest = hash_combine(digest, hash_line(indices + y * width, width, emphasis[y]));
+	return digest;
+}
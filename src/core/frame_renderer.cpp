@@ -0,0 +1,186 @@
+#include "core/frame_renderer.h"
+#include "core/frame_hash.h"
+#include "core/shm_ring.h"
+#include <cstring>
+
+FrameRenderer::FrameRenderer(int threads, int max_pending)
+{
+	if (threads < 1)
+		threads = 1;
+	if (max_pending < 1)
+		max_pending = 1;
+
+	for (int i = 0; i < max_pending; i++)
+		jobs.push_back(std::make_unique<Job>());
+	for (int band = 0; band < threads; band++)
+		workers.emplace_back(&FrameRenderer::worker_loop, this, band);
+}
+
+FrameRenderer::~FrameRenderer()
+{
+	flush();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	job_ready.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+/* Emulation thread */
+FrameLog *FrameRenderer::begin_frame(const PPU &ppu)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	// The slot is free once the frame that last used it has been delivered
+	job_done.wait(guard, [this] { return started - completed < jobs.size(); });
+	Job &job = *jobs[started % jobs.size()];
+	started++;
+	guard.unlock();
+
+	ppu.save_render_state(job.snapshot);
+	job.log.clear();
+	job.bands_done = 0;
+	return &job.log;
+}
+
+void FrameRenderer::end_frame()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		submitted++;
+	}
+	job_ready.notify_all();
+}
+
+void FrameRenderer::flush()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	job_done.wait(guard, [this] { return completed == submitted; });
+}
+
+/* Workers */
+void FrameRenderer::worker_loop(int band)
+{
+	// Each worker keeps its own PPU to replay into
+	std::unique_ptr<PPU> shadow = std::make_unique<PPU>();
+	uint64_t next = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			job_ready.wait(guard, [&] { return stopping || next < submitted; });
+			if (next >= submitted)
+				return;
+		}
+
+		Job &job = *jobs[next % jobs.size()];
+		render_band(job, *shadow, band);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			last = ++job.bands_done == static_cast<int>(workers.size());
+		}
+
+		// The last band to finish delivers the frame. Frames stay in order because
+		// every worker finishes frame n before it starts frame n + 1.
+		if (last)
+		{
+			finish_frame(job);
+			if (on_frame)
+				on_frame(next, job.frame.data(), job.emphasis.data());
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				completed++;
+			}
+			job_done.notify_all();
+		}
+		next++;
+	}
+}
+
+// The outputs the PPU produces inline at the end of a composed frame
+void FrameRenderer::finish_frame(const Job &job)
+{
+	const uint8_t *indices = job.frame.data();
+	if (frame_hashing)
+		frame_hash = hash_frame(indices, job.emphasis.data(), PPU::SCREEN_WIDTH, PPU::SCREEN_HEIGHT);
+	if (observation_enabled)
+	{
+		for (int line = 0; line < PPU::SCREEN_HEIGHT; line++)
+			observation.add_line(line, indices + line * PPU::SCREEN_WIDTH, job.emphasis[line]);
+	}
+	else if (frame_ring)
+	{
+		publish_frame(*frame_ring, job.snapshot.frame_number, indices, job.emphasis.data());
+	}
+}
+
+void FrameRenderer::set_observation(const Observation::Config &config)
+{
+	observation.configure(config);
+	observation_enabled = true;
+}
+
+// Position in frame order: the pre-render line comes first
+static int frame_position(int scanline, int cycle)
+{
+	return (scanline == 261 ? -1 : scanline) * 341 + cycle;
+}
+
+void FrameRenderer::render_band(Job &job, PPU &shadow, int band)
+{
+	const int bands = static_cast<int>(workers.size());
+	const int first = band * PPU::SCREEN_HEIGHT / bands;
+	const int last = (band + 1) * PPU::SCREEN_HEIGHT / bands;
+
+	shadow.load_render_state(job.snapshot);
+	shadow.band_first = static_cast<int16_t>(first);
+	shadow.band_last = static_cast<int16_t>(last);
+
+	const std::vector<PPUEvent> &events = job.log.events;
+	size_t next_event = 0;
+	size_t next_page = 0;
+	size_t next_offset = 0;
+	const int end = frame_position(240, 1);
+
+	while (true)
+	{
+		const int position = frame_position(shadow.scanline, shadow.cycle);
+
+		// Events were stamped with the dot the PPU was about to run
+		while (next_event < events.size() && frame_position(events[next_event].scanline, events[next_event].cycle) <= position)
+		{
+			const PPUEvent &event = events[next_event++];
+			switch (event.kind)
+			{
+			case PPUEvent::Kind::READ:
+				shadow.cpu_read(event.address);
+				break;
+			case PPUEvent::Kind::WRITE:
+				shadow.cpu_write(event.address, event.data);
+				break;
+			case PPUEvent::Kind::OAM_DMA:
+				shadow.oam_dma(job.log.dma_pages[next_page++].data());
+				break;
+			case PPUEvent::Kind::CHR_PAGE:
+				shadow.map_chr_page(event.address, job.log.chr_offsets[next_offset++]);
+				break;
+			case PPUEvent::Kind::MIRRORING:
+				shadow.set_mirroring(static_cast<Mirror>(event.data));
+				break;
+			}
+		}
+
+		if (position >= end)
+			break;
+		shadow.clock();
+	}
+
+	const int width = PPU::SCREEN_WIDTH;
+	std::memcpy(job.frame.data() + first * width, shadow.frame.data() + first * width, (last - first) * width);
+	std::memcpy(job.emphasis.data() + first, shadow.frame_emphasis.data() + first, last - first);
+}
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cstring>
+
+#include "core/mapper.h"
+
+/* Banking */
+Mapper::Mapper(Cartridge &cartridge, PPU &ppu, MapperKind kind)
+	: cart(cartridge), ppu(ppu), kind(kind)
+{
+	// PRG RAM is plain memory
+	for (int i = 0; i < 4; i++)
+	{
+		pages.map_read((0x6000 >> MemoryPages::PAGE_BITS) + i, &cart.prg_ram[i * 0x0800]);
+		pages.write[(0x6000 >> MemoryPages::PAGE_BITS) + i] = &cart.prg_ram[i * 0x0800];
+	}
+	prg_banks = static_cast<int>(cart.prg_rom.size() / 0x2000);
+	map_prg_32k(0);
+
+	// CHR RAM stays inside the PPU (8 KiB); CHR ROM is read in place
+	if (cart.chr_ram)
+	{
+		ppu.set_chr_memory(nullptr, 0x2000);
+		std::memcpy(ppu.pattern.data(), cart.chr.data(), std::min<size_t>(cart.chr.size(), ppu.pattern.size()));
+		ppu.invalidate_pattern_cache();
+	}
+	else
+		ppu.set_chr_memory(cart.chr.data(), static_cast<uint32_t>(cart.chr.size()));
+	chr_banks = cart.chr_ram ? 8 : static_cast<int>(cart.chr.size() / 0x0400);
+	ppu.set_chr_writable(cart.chr_ram);
+	ppu.set_mirroring(cart.four_screen ? Mirror::FOUR_SCREEN : cart.mirroring);
+}
+
+Mapper::~Mapper()
+{
+}
+
+static int wrap_bank(int bank, int count)
+{
+	if ((count & (count - 1)) == 0)
+		return bank & (count - 1); // Also wraps negative banks from the end
+	if (bank < 0)
+		bank += count;
+	return ((bank % count) + count) % count;
+}
+
+void Mapper::map_prg_8k(int slot, int bank)
+{
+	const uint8_t *base = cart.prg_rom.data() + wrap_bank(bank, prg_banks) * 0x2000;
+	int first = (0x8000 >> MemoryPages::PAGE_BITS) + slot * 4;
+	for (int i = 0; i < 4; i++)
+	{
+		pages.map_read(first + i, base + i * 0x0800);
+		pages.write[first + i] = nullptr; // ROM: writes are register writes
+	}
+}
+
+void Mapper::map_prg_16k(int slot, int bank)
+{
+	bank = wrap_bank(bank, std::max(1, prg_banks / 2));
+	map_prg_8k(slot * 2, bank * 2);
+	map_prg_8k(slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::map_prg_32k(int bank)
+{
+	map_prg_16k(0, bank * 2);
+	map_prg_16k(1, bank * 2 + 1);
+}
+
+void Mapper::map_chr_1k(int slot, int bank)
+{
+	ppu.map_chr_page(slot, static_cast<uint32_t>(wrap_bank(bank, chr_banks)) * 0x0400);
+}
+
+void Mapper::map_chr_2k(int slot, int bank)
+{
+	map_chr_1k(slot * 2, bank * 2);
+	map_chr_1k(slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::map_chr_4k(int slot, int bank)
+{
+	for (int i = 0; i < 4; i++)
+		map_chr_1k(slot * 4 + i, bank * 4 + i);
+}
+
+void Mapper::map_chr_8k(int bank)
+{
+	for (int i = 0; i < 8; i++)
+		map_chr_1k(i, bank * 8 + i);
+}
+
+/* NROM */
+NROM::NROM(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::NROM)
+{
+	map_prg_16k(0, 0);
+	map_prg_16k(1, -1); // Mirrors the first bank on 16 KiB boards
+}
+
+/* MMC1 */
+MMC1::MMC1(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::MMC1)
+{
+	reset();
+}
+
+void MMC1::reset()
+{
+	shift = 0x10;
+	control = 0x0C;
+	chr_bank[0] = chr_bank[1] = 0;
+	prg_bank = 0;
+	update_banks();
+}
+
+void MMC1::cpu_write(uint16_t address, uint8_t data)
+{
+	if (address < 0x8000)
+		return;
+
+	if (data & 0x80)
+	{
+		shift = 0x10;
+		control |= 0x0C;
+		update_banks();
+		return;
+	}
+
+	bool last = shift & 0x01;
+	shift = (shift >> 1) | ((data & 0x01) << 4);
+	if (!last)
+		return;
+
+	switch ((address >> 13) & 0x03)
+	{
+	case 0:
+		control = shift;
+		break;
+	case 1:
+		chr_bank[0] = shift;
+		break;
+	case 2:
+		chr_bank[1] = shift;
+		break;
+	case 3:
+		prg_bank = shift & 0x0F;
+		break;
+	}
+	shift = 0x10;
+	update_banks();
+}
+
+void MMC1::update_banks()
+{
+	static const Mirror MIRRORING[4] = {Mirror::ONESCREEN_LO, Mirror::ONESCREEN_HI, Mirror::VERTICAL, Mirror::HORIZONTAL};
+	set_mirroring(MIRRORING[control & 0x03]);
+
+	if (control & 0x10)
+	{
+		map_chr_4k(0, chr_bank[0]);
+		map_chr_4k(1, chr_bank[1]);
+	}
+	else
+	{
+		map_chr_8k(chr_bank[0] >> 1);
+	}
+
+	switch ((control >> 2) & 0x03)
+	{
+	case 0:
+	case 1:
+		map_prg_32k(prg_bank >> 1);
+		break;
+	case 2: // First bank fixed at $8000
+		map_prg_16k(0, 0);
+		map_prg_16k(1, prg_bank);
+		break;
+	case 3: // Last bank fixed at $C000
+		map_prg_16k(0, prg_bank);
+		map_prg_16k(1, -1);
+		break;
+	}
+}
+
+/* UxROM */
+UxROM::UxROM(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::UXROM)
+{
+	map_prg_16k(0, 0);
+	map_prg_16k(1, -1);
+}
+
+void UxROM::cpu_write(uint16_t address, uint8_t data)
+{
+	if (address >= 0x8000)
+		map_prg_16k(0, data);
+}
+
+/* CNROM */
+CNROM::CNROM(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::CNROM)
+{
+	map_prg_16k(0, 0);
+	map_prg_16k(1, -1);
+}
+
+void CNROM::cpu_write(uint16_t address, uint8_t data)
+{
+	if (address >= 0x8000)
+		map_chr_8k(data);
+}
+
+/* AxROM */
+AxROM::AxROM(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::AXROM)
+{
+	map_prg_32k(0);
+	set_mirroring(Mirror::ONESCREEN_LO);
+}
+
+void AxROM::cpu_write(uint16_t address, uint8_t data)
+{
+	if (address < 0x8000)
+		return;
+	map_prg_32k(data & 0x07);
+	set_mirroring((data & 0x10) ? Mirror::ONESCREEN_HI : Mirror::ONESCREEN_LO);
+}
+
+/* MMC3 */
+MMC3::MMC3(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::MMC3)
+{
+	reset();
+}
+
+void MMC3::reset()
+{
+	static const uint8_t INITIAL[8] = {0, 2, 4, 5, 6, 7, 0, 1};
+	bank_select = 0;
+	std::memcpy(registers, INITIAL, sizeof(registers));
+	irq_latch = 0;
+	irq_counter = 0;
+	irq_reload = false;
+	irq_enabled = false;
+	irq = false;
+	update_banks();
+}
+
+void MMC3::cpu_write(uint16_t address, uint8_t data)
+{
+	if (address < 0x8000)
+		return;
+
+	switch (address & 0xE001)
+	{
+	case 0x8000:
+	{
+		// Only the mode bits move banks; the register index does not
+		bool modes_changed = (bank_select ^ data) & 0xC0;
+		bank_select = data;
+		if (modes_changed)
+			update_banks();
+		break;
+	}
+	case 0x8001:
+		registers[bank_select & 0x07] = data;
+		if ((bank_select & 0x07) < 6)
+			update_chr_banks();
+		else
+			update_prg_banks();
+		break;
+	case 0xA000:
+		if (!cart.four_screen)
+			set_mirroring((data & 0x01) ? Mirror::HORIZONTAL : Mirror::VERTICAL);
+		break;
+	case 0xC000:
+		irq_latch = data;
+		break;
+	case 0xC001:
+		irq_counter = 0;
+		irq_reload = true;
+		break;
+	case 0xE000:
+		irq_enabled = false;
+		irq = false;
+		break;
+	case 0xE001:
+		irq_enabled = true;
+		break;
+	default: // $A001 PRG RAM protect is not emulated
+		break;
+	}
+}
+
+void MMC3::update_banks()
+{
+	update_chr_banks();
+	update_prg_banks();
+}
+
+void MMC3::update_chr_banks()
+{
+	// CHR A12 inversion swaps the 2 KiB and the 1 KiB halves
+	int flip = (bank_select & 0x80) ? 4 : 0;
+	map_chr_1k(0 ^ flip, registers[0] & 0xFE);
+	map_chr_1k(1 ^ flip, registers[0] | 0x01);
+	map_chr_1k(2 ^ flip, registers[1] & 0xFE);
+	map_chr_1k(3 ^ flip, registers[1] | 0x01);
+	for (int i = 0; i < 4; i++)
+		map_chr_1k((4 + i) ^ flip, registers[2 + i]);
+}
+
+void MMC3::update_prg_banks()
+{
+	// PRG mode swaps $8000 and $C000; the second-last bank takes the other one
+	bool swap = bank_select & 0x40;
+	map_prg_8k(swap ? 2 : 0, registers[6]);
+	map_prg_8k(1, registers[7]);
+	map_prg_8k(swap ? 0 : 2, -2);
+	map_prg_8k(3, -1);
+}
+
+void MMC3::scanline()
+{
+	if (irq_counter == 0 || irq_reload)
+	{
+		irq_counter = irq_latch;
+		irq_reload = false;
+	}
+	else
+	{
+		irq_counter--;
+	}
+	if (irq_counter == 0 && irq_enabled)
+		irq = true;
+}
+
+std::unique_ptr<Mapper> create_mapper(Cartridge &cartridge, PPU &ppu)
+{
+	if (cartridge.prg_rom.empty() || cartridge.chr.empty())
+		return nullptr;
+
+	switch (cartridge.mapper_id)
+	{
+	case 0:
+		return std::make_unique<NROM>(cartridge, ppu);
+	case 1:
+		return std::make_unique<MMC1>(cartridge, ppu);
+	case 2:
+		return std::make_unique<UxROM>(cartridge, ppu);
+	case 3:
+		return std::make_unique<CNROM>(cartridge, ppu);
+	case 4:
+		return std::make_unique<MMC3>(cartridge, ppu);
+	case 7:
+		return std::make_unique<AxROM>(cartridge, ppu);
+	default:
+		return nullptr;
+	}
+}
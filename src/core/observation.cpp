@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include "core/observation.h"
+#include "core/ppu.h"
+#include "core/frame_convert.h"
+
+Observation::Observation()
+{
+	configure(Config());
+}
+
+Observation::~Observation()
+{
+}
+
+void Observation::configure(const Config &new_config)
+{
+	config = new_config;
+
+	// Keep at least one source pixel per output pixel
+	config.crop_left = std::clamp(config.crop_left, 0, PPU::SCREEN_WIDTH - 1);
+	config.crop_right = std::clamp(config.crop_right, 0, PPU::SCREEN_WIDTH - 1 - config.crop_left);
+	config.crop_top = std::clamp(config.crop_top, 0, PPU::SCREEN_HEIGHT - 1);
+	config.crop_bottom = std::clamp(config.crop_bottom, 0, PPU::SCREEN_HEIGHT - 1 - config.crop_top);
+	int source_width = PPU::SCREEN_WIDTH - config.crop_left - config.crop_right;
+	int source_height = PPU::SCREEN_HEIGHT - config.crop_top - config.crop_bottom;
+	config.width = std::clamp(config.width, 1, source_width);
+	config.height = std::clamp(config.height, 1, source_height);
+
+	column.assign(PPU::SCREEN_WIDTH, -1);
+	column_width.assign(config.width, 0);
+	for (int x = 0; x < source_width; x++)
+	{
+		int out = x * config.width / source_width;
+		column[config.crop_left + x] = static_cast<int16_t>(out);
+		column_width[out]++;
+	}
+
+	line_row.assign(PPU::SCREEN_HEIGHT, -1);
+	row_last.assign(PPU::SCREEN_HEIGHT, 0);
+	for (int y = 0; y < source_height; y++)
+	{
+		int row = y * config.height / source_height;
+		line_row[config.crop_top + y] = static_cast<int16_t>(row);
+		row_last[config.crop_top + y] = y + 1 == source_height || (y + 1) * config.height / source_height != row;
+	}
+
+	sum.assign(config.width, 0);
+	lines_summed = 0;
+	previous.assign(config.width * config.height, 0);
+	output.assign(config.width * config.height, 0);
+}
+
+void Observation::add_line(int line, const uint8_t *indices, uint8_t emphasis)
+{
+	int row = line_row[line];
+	if (row < 0)
+		return;
+
+	const uint8_t *gray = palette_gray_table(emphasis);
+	int first = config.crop_left;
+	int last = PPU::SCREEN_WIDTH - config.crop_right;
+	for (int x = first; x < last; x++)
+		sum[column[x]] += gray[indices[x] & 0x3F];
+	lines_summed++;
+
+	if (row_last[line])
+		finish_row(row);
+}
+
+void Observation::finish_row(int row)
+{
+	uint8_t *last_frame = &previous[row * config.width];
+	uint8_t *out = &output[row * config.width];
+
+	for (int x = 0; x < config.width; x++)
+	{
+		uint32_t count = column_width[x] * lines_summed;
+		uint8_t value = static_cast<uint8_t>((sum[x] + count / 2) / count);
+		out[x] = config.max_pool ? std::max(value, last_frame[x]) : value;
+		last_frame[x] = value;
+		sum[x] = 0;
+	}
+	lines_summed = 0;
+}
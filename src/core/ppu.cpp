@@ -0,0 +1,876 @@
+#include <cstring>
+
+#include "core/ppu.h"
+#include "core/tile_decode.h"
+#include "core/frame_renderer.h"
+#include "core/frame_hash.h"
+#include "core/shm_ring.h"
+
+PPU::PPU()
+{
+	pattern.fill(0x00);
+	vram.fill(0x00);
+	palette.fill(0x00);
+	oam.fill(0x00);
+	frame.fill(0x00);
+	frame_emphasis.fill(0x00);
+	reset();
+}
+
+PPU::~PPU()
+{
+}
+
+void PPU::reset()
+{
+	end_deferred_frame(); // Timing starts over, the next frame gets a new log
+	ctrl = 0x00;
+	mask = 0x00;
+	status = 0x00;
+	oam_addr = 0x00;
+	data_buffer = 0x00;
+	v = 0x0000;
+	t = 0x0000;
+	fine_x = 0x00;
+	w = false;
+
+	// Start on the pre-render line so the first frame is a complete one
+	scanline = 261;
+	cycle = 0;
+	odd_frame = false;
+	sprite_zero_hit_cycle = -1;
+	line_sprite_count = 0;
+	tile_row_address = 0xFFFF;
+	frame_number = 0;
+	skip_frame = false;
+	frame_rendered = false;
+
+	nmi = false;
+	frame_complete = false;
+}
+
+/* Main bus interface */
+uint8_t PPU::cpu_read(uint16_t address, bool read_only)
+{
+	uint8_t data = 0x00;
+
+	switch (address & 0x0007)
+	{
+	case 0x0002: // Status
+		data = (status & 0xE0) | (data_buffer & 0x1F);
+		if (!read_only)
+		{
+			if (frame_log)
+				log_event(static_cast<uint8_t>(PPUEvent::Kind::READ), address, 0x00);
+			status &= ~static_cast<uint8_t>(STATUS::VERTICAL_BLANK);
+			w = false;
+		}
+		break;
+	case 0x0004: // OAM Data
+		data = oam[oam_addr];
+		break;
+	case 0x0007: // PPU Data
+		data = data_buffer;
+		if (read_only)
+			break;
+		if (frame_log)
+			log_event(static_cast<uint8_t>(PPUEvent::Kind::READ), address, 0x00);
+		data_buffer = ppu_read(v);
+		// Palette reads are not delayed by the read buffer
+		if ((v & 0x3FFF) >= 0x3F00)
+			data = data_buffer;
+		v = (v + (get_ctrl(CTRL::INCREMENT_MODE) ? 32 : 1)) & 0x7FFF;
+		break;
+	default: // Write-only registers
+		break;
+	}
+
+	return data;
+}
+
+void PPU::cpu_write(uint16_t address, uint8_t data)
+{
+	if (frame_log)
+		log_event(static_cast<uint8_t>(PPUEvent::Kind::WRITE), address, data);
+
+	switch (address & 0x0007)
+	{
+	case 0x0000: // Control
+	{
+		bool nmi_was_enabled = get_ctrl(CTRL::ENABLE_NMI);
+		ctrl = data;
+		t = (t & 0xF3FF) | (static_cast<uint16_t>(data & 0x03) << 10);
+		// Enabling NMI during vblank fires it immediately
+		if (!nmi_was_enabled && get_ctrl(CTRL::ENABLE_NMI) && (status & static_cast<uint8_t>(STATUS::VERTICAL_BLANK)))
+			nmi = true;
+		break;
+	}
+	case 0x0001: // Mask
+		mask = data;
+		break;
+	case 0x0003: // OAM Address
+		oam_addr = data;
+		break;
+	case 0x0004: // OAM Data
+		oam[oam_addr++] = data;
+		sprite_buckets_dirty = true;
+		break;
+	case 0x0005: // Scroll
+		if (!w)
+		{
+			t = (t & 0xFFE0) | (data >> 3);
+			fine_x = data & 0x07;
+		}
+		else
+		{
+			t = (t & 0x8C1F) | (static_cast<uint16_t>(data & 0xF8) << 2) | (static_cast<uint16_t>(data & 0x07) << 12);
+		}
+		w = !w;
+		break;
+	case 0x0006: // PPU Address
+		if (!w)
+		{
+			t = (t & 0x00FF) | (static_cast<uint16_t>(data & 0x3F) << 8);
+		}
+		else
+		{
+			t = (t & 0xFF00) | data;
+			v = t;
+		}
+		w = !w;
+		break;
+	case 0x0007: // PPU Data
+		ppu_write(v, data);
+		v = (v + (get_ctrl(CTRL::INCREMENT_MODE) ? 32 : 1)) & 0x7FFF;
+		break;
+	default: // Status is read-only
+		break;
+	}
+}
+
+void PPU::oam_dma(const uint8_t *page)
+{
+	if (frame_log)
+	{
+		log_event(static_cast<uint8_t>(PPUEvent::Kind::OAM_DMA), 0x0000, 0x00);
+		frame_log->dma_pages.emplace_back();
+		std::memcpy(frame_log->dma_pages.back().data(), page, 256);
+	}
+
+	for (uint16_t i = 0; i < 256; i++)
+		oam[(oam_addr + i) & 0xFF] = page[i];
+	sprite_buckets_dirty = true;
+}
+
+void PPU::log_event(uint8_t kind, uint16_t address, uint8_t data)
+{
+	frame_log->events.push_back({scanline, cycle, static_cast<PPUEvent::Kind>(kind), static_cast<uint8_t>(address & 0x0007), data});
+}
+
+// Mapper changes: only the live PPU sees them, so the replay needs them too
+void PPU::log_chr_page(int page, uint32_t offset)
+{
+	log_event(static_cast<uint8_t>(PPUEvent::Kind::CHR_PAGE), static_cast<uint16_t>(page), 0x00);
+	frame_log->chr_offsets.push_back(offset);
+}
+
+void PPU::log_mirroring(Mirror mode)
+{
+	log_event(static_cast<uint8_t>(PPUEvent::Kind::MIRRORING), 0x0000, static_cast<uint8_t>(mode));
+}
+
+void PPU::set_deferred_renderer(FrameRenderer *frame_renderer)
+{
+	if (frame_renderer == renderer)
+		return;
+	end_deferred_frame(); // The old renderer owns the open log
+	renderer = frame_renderer;
+}
+
+void PPU::end_deferred_frame()
+{
+	if (!frame_log)
+		return;
+	renderer->end_frame();
+	frame_log = nullptr;
+}
+
+void PPU::save_render_state(RenderState &state) const
+{
+	state.ctrl = ctrl;
+	state.mask = mask;
+	state.status = status;
+	state.oam_addr = oam_addr;
+	state.data_buffer = data_buffer;
+	state.v = v;
+	state.t = t;
+	state.fine_x = fine_x;
+	state.w = w;
+	state.scanline = scanline;
+	state.cycle = cycle;
+	state.odd_frame = odd_frame;
+	state.frame_number = frame_number;
+	state.mirroring = mirroring;
+	state.chr_writable = chr_writable;
+	state.external_chr = external_chr;
+	state.chr_size = chr_size;
+	state.chr_page = chr_page;
+	state.nametable_row_generation = nametable_row_generation;
+	state.chr_generation = chr_generation;
+	state.nametable_generation = nametable_generation;
+	state.vram = vram;
+	state.palette = palette;
+	state.oam = oam;
+	if (!external_chr)
+		state.pattern = pattern;
+}
+
+// The generations come from the emulated PPU, which bumps them on every change
+// the replay also makes, so the background lines this PPU cached from earlier
+// frames stay valid exactly when the emulated PPU's would
+void PPU::load_render_state(const RenderState &state)
+{
+	ctrl = state.ctrl;
+	mask = state.mask;
+	status = state.status;
+	oam_addr = state.oam_addr;
+	data_buffer = state.data_buffer;
+	v = state.v;
+	t = state.t;
+	fine_x = state.fine_x;
+	w = state.w;
+	scanline = state.scanline;
+	cycle = state.cycle;
+	odd_frame = state.odd_frame;
+	frame_number = state.frame_number;
+	mirroring = state.mirroring;
+	chr_writable = state.chr_writable;
+	chr_page = state.chr_page;
+	nametable_row_generation = state.nametable_row_generation;
+	chr_generation = state.chr_generation;
+	nametable_generation = state.nametable_generation;
+	vram = state.vram;
+	palette = state.palette;
+	oam = state.oam;
+
+	if (state.external_chr != external_chr || state.chr_size != chr_size)
+	{
+		external_chr = state.external_chr;
+		chr_size = state.chr_size;
+		chr_cache.resize(chr_size);
+		background_valid.fill(false);
+	}
+	if (!external_chr)
+	{
+		// Only the tiles that changed since the last frame are decoded again
+		for (uint32_t offset = 0; offset < pattern.size(); offset += 16)
+		{
+			if (std::memcmp(&pattern[offset], &state.pattern[offset], 16) != 0)
+			{
+				std::memcpy(&pattern[offset], &state.pattern[offset], 16);
+				chr_cache.invalidate(offset);
+			}
+		}
+	}
+
+	sprite_zero_hit_cycle = -1;
+	line_sprite_count = 0;
+	tile_row_address = 0xFFFF;
+	sprite_buckets_dirty = true;
+	skip_frame = false;
+}
+
+void PPU::set_chr_memory(const uint8_t *chr, uint32_t size)
+{
+	external_chr = chr;
+	chr_size = chr ? size : static_cast<uint32_t>(pattern.size());
+	for (uint32_t page = 0; page < chr_page.size(); page++)
+		chr_page[page] = (page * 0x0400) % chr_size;
+	chr_cache.resize(chr_size);
+	chr_generation++;
+}
+
+/* Scanline counter timing */
+int16_t PPU::a12_rise_dot() const
+{
+	if (!rendering_enabled())
+		return -1;
+	if (get_ctrl(CTRL::PATTERN_SPRITE) || get_ctrl(CTRL::SPRITE_SIZE))
+		return 260;
+	if (get_ctrl(CTRL::PATTERN_BACKGROUND))
+		return 324;
+	return -1;
+}
+
+uint32_t PPU::dots_until_a12_rise() const
+{
+	int16_t dot = a12_rise_dot();
+	if (dot < 0)
+		return 0;
+
+	// At most one line wrap away: every rendered line has a rise
+	int16_t line = scanline;
+	int16_t position = cycle;
+	uint32_t dots = 0;
+	while (true)
+	{
+		bool rendered = line < 240 || line == 261;
+		if (rendered && position < dot)
+			return dots + (dot - position);
+		dots += 341 - position;
+		if (line == 261 && odd_frame && position <= 339)
+			dots--; // Skipped dot
+		position = 0;
+		line = line == 261 ? 0 : line + 1;
+	}
+}
+
+/* PPU bus interface */
+uint16_t PPU::mirror_nametable(uint16_t address) const
+{
+	uint16_t table = (address >> 10) & 0x03;
+	uint16_t offset = address & 0x03FF;
+
+	switch (mirroring)
+	{
+	case Mirror::VERTICAL:
+		return ((table & 0x01) << 10) | offset;
+	case Mirror::HORIZONTAL:
+		return ((table >> 1) << 10) | offset;
+	case Mirror::ONESCREEN_LO:
+		return offset;
+	case Mirror::ONESCREEN_HI:
+		return 0x0400 | offset;
+	case Mirror::FOUR_SCREEN:
+		return address & 0x0FFF;
+	}
+	return offset;
+}
+
+uint16_t PPU::mirror_palette(uint16_t address) const
+{
+	uint16_t index = address & 0x001F;
+	// $3F10/$3F14/$3F18/$3F1C mirror the background entries
+	if ((index & 0x13) == 0x10)
+		index &= ~0x10;
+	return index;
+}
+
+uint8_t PPU::ppu_read(uint16_t address) const
+{
+	address &= 0x3FFF;
+
+	if (address < 0x2000)
+		return chr_data()[chr_offset(address)];
+	if (address < 0x3F00)
+		return vram[mirror_nametable(address)];
+	return palette[mirror_palette(address)];
+}
+
+void PPU::ppu_write(uint16_t address, uint8_t data)
+{
+	address &= 0x3FFF;
+
+	if (address < 0x2000)
+	{
+		// Only the internal pattern memory is writable
+		if (!chr_writable || external_chr)
+			return;
+		uint32_t offset = chr_offset(address);
+		pattern[offset] = data;
+		chr_cache.invalidate(offset);
+		chr_generation++;
+	}
+	else if (address < 0x3F00)
+	{
+		// Games often rewrite unchanged bytes; those keep every cache valid
+		uint16_t index = mirror_nametable(address);
+		if (vram[index] != data)
+		{
+			vram[index] = data;
+			nametable_generation++;
+			mark_nametable_dirty(index);
+		}
+	}
+	else
+	{
+		palette[mirror_palette(address)] = data;
+	}
+}
+
+void PPU::set_observation(const Observation::Config &config)
+{
+	observation.configure(config);
+	observation_enabled = true;
+}
+
+/* Instrumentation */
+PPU::Stats PPU::get_stats() const
+{
+	Stats stats;
+	stats.chr_cache = chr_cache.get_stats();
+	stats.background_line_hits = background_line_hits;
+	stats.background_line_misses = background_line_misses;
+	return stats;
+}
+
+void PPU::reset_stats()
+{
+	chr_cache.reset_stats();
+	background_line_hits = 0;
+	background_line_misses = 0;
+}
+
+/* Loopy scroll register updates */
+void PPU::increment_y()
+{
+	if ((v & 0x7000) != 0x7000)
+	{
+		v += 0x1000; // Fine Y
+		return;
+	}
+
+	v &= ~0x7000;
+	uint16_t coarse_y = (v & 0x03E0) >> 5;
+	if (coarse_y == 29)
+	{
+		coarse_y = 0;
+		v ^= 0x0800; // Switch vertical nametable
+	}
+	else if (coarse_y == 31)
+	{
+		coarse_y = 0; // Attribute rows wrap without switching nametable
+	}
+	else
+	{
+		coarse_y++;
+	}
+	v = (v & ~0x03E0) | (coarse_y << 5);
+}
+
+void PPU::transfer_x()
+{
+	v = (v & ~0x041F) | (t & 0x041F);
+}
+
+void PPU::transfer_y()
+{
+	v = (v & ~0x7BE0) | (t & 0x7BE0);
+}
+
+/* Scanline renderer */
+void PPU::fetch_tile_row(uint16_t address)
+{
+	uint16_t addr = address;
+	for (auto &fetch : tile_row)
+	{
+		fetch.tile = vram[mirror_nametable(0x2000 | (addr & 0x0FFF))];
+		uint8_t attribute = vram[mirror_nametable(0x23C0 | (addr & 0x0C00) | ((addr >> 4) & 0x38) | ((addr >> 2) & 0x07))];
+		fetch.palette = (attribute >> (((addr >> 4) & 0x04) | (addr & 0x02))) & 0x03;
+
+		// Increment coarse X, wrapping into the horizontally adjacent nametable
+		if ((addr & 0x001F) == 31)
+			addr = (addr & ~0x001F) ^ 0x0400;
+		else
+			addr++;
+	}
+
+	tile_row_address = address;
+	tile_row_generation = nametable_generation;
+}
+
+// Copies the pixels of count tiles of the current row, starting first tiles
+// from the left edge of the scroll position, out of the tile cache
+void PPU::fetch_background(int first, int count, uint8_t *pixels)
+{
+	uint16_t row_address = v & 0x0FFF;
+	if (row_address != tile_row_address || tile_row_generation != nametable_generation)
+		fetch_tile_row(row_address);
+
+	uint16_t table = get_ctrl(CTRL::PATTERN_BACKGROUND) ? 0x1000 : 0x0000;
+	uint8_t fine_y = (v >> 12) & 0x07;
+
+	const uint8_t *chr = chr_data();
+	std::array<uint8_t, 33> attribute;
+	for (int i = 0; i < count; i++)
+	{
+		const TileFetch &fetch = tile_row[first + i];
+		const uint8_t *tile = chr_cache.tile(chr, chr_offset(table + fetch.tile * 16) >> 4);
+		std::memcpy(&pixels[i * 8], tile + fine_y * 8, 8);
+		attribute[i] = fetch.palette << 2;
+	}
+	merge_tile_attributes(pixels, attribute.data(), count);
+}
+
+void PPU::mark_nametable_dirty(uint16_t vram_address)
+{
+	auto &rows = nametable_row_generation[vram_address >> 10];
+	uint16_t offset = vram_address & 0x03FF;
+	if (offset < 0x03C0)
+	{
+		rows[offset >> 5]++;
+		return;
+	}
+
+	// Attribute byte: its 4 tile rows, plus rows 30-31 which fetch from the attribute table
+	int first = ((offset - 0x03C0) >> 3) * 4;
+	for (int row = first; row < first + 4 && row < 30; row++)
+		rows[row]++;
+	rows[30]++;
+	rows[31]++;
+}
+
+PPU::BackgroundKey PPU::background_key() const
+{
+	BackgroundKey key;
+	key.v = v;
+	key.fine_x = fine_x;
+	key.pattern_table = get_ctrl(CTRL::PATTERN_BACKGROUND);
+	key.mirroring = mirroring;
+	uint16_t row = (v >> 5) & 0x1F;
+	uint16_t table = v & 0x0C00;
+	key.row_generation[0] = nametable_row_generation[mirror_nametable(0x2000 | table) >> 10][row];
+	// Without any horizontal scroll the neighbouring table is fetched but never shown
+	bool scrolled = (v & 0x001F) != 0 || fine_x != 0;
+	key.row_generation[1] = scrolled ? nametable_row_generation[mirror_nametable(0x2000 | (table ^ 0x0400)) >> 10][row] : 0;
+	key.chr_generation = chr_generation;
+	return key;
+}
+
+void PPU::render_background(std::array<uint8_t, SCREEN_WIDTH> &line)
+{
+	uint8_t *cached = &background_lines[scanline * SCREEN_WIDTH];
+	BackgroundKey key = background_key();
+
+	if (background_valid[scanline] && background_keys[scanline] == key)
+	{
+		background_line_hits++;
+		std::memcpy(line.data(), cached, SCREEN_WIDTH);
+	}
+	else
+	{
+		background_line_misses++;
+
+		// 33 tiles cover the line for any fine X
+		std::array<uint8_t, 33 * 8> pixels;
+		fetch_background(0, 33, pixels.data());
+
+		for (int x = 0; x < SCREEN_WIDTH; x++)
+			line[x] = pixels[x + fine_x];
+
+		std::memcpy(cached, line.data(), SCREEN_WIDTH);
+		background_keys[scanline] = key;
+		background_valid[scanline] = true;
+	}
+
+	if (!get_mask(MASK::RENDER_BACKGROUND_LEFT))
+		for (int x = 0; x < 8; x++)
+			line[x] = 0x00;
+}
+
+// Pixel values (0-3) of the sprite's row on this line, leftmost in the low byte
+uint64_t PPU::sprite_row(const SpriteEntry &sprite)
+{
+	uint8_t height = get_ctrl(CTRL::SPRITE_SIZE) ? 16 : 8;
+
+	uint8_t row = sprite.row;
+	if (sprite.attribute & 0x80)
+		row = height - 1 - row; // Flip vertically
+
+	uint16_t address;
+	if (height == 8)
+		address = (get_ctrl(CTRL::PATTERN_SPRITE) ? 0x1000 : 0x0000) + sprite.tile * 16;
+	else
+		address = ((sprite.tile & 0x01) << 12) + (sprite.tile & 0xFE) * 16 + ((row & 0x08) << 1);
+
+	uint64_t pixels;
+	std::memcpy(&pixels, chr_cache.tile(chr_data(), chr_offset(address) >> 4) + (row & 0x07) * 8, sizeof(pixels));
+	if (sprite.attribute & 0x40)
+		pixels = __builtin_bswap64(pixels); // Flip horizontally
+	return pixels;
+}
+
+// Sprite pixels are encoded as 0x10 | palette << 2 | pixel, with bit 6 set
+// for sprites behind the background and bit 7 set for sprite 0
+void PPU::render_sprites(std::array<uint8_t, SCREEN_WIDTH> &line)
+{
+	std::array<uint8_t, 8 * 8> pixels;
+	std::array<uint8_t, 8> attribute;
+	for (uint8_t i = 0; i < line_sprite_count; i++)
+	{
+		const SpriteEntry &sprite = line_sprites[i];
+		uint64_t row = sprite_row(sprite);
+		std::memcpy(&pixels[i * 8], &row, sizeof(row));
+
+		attribute[i] = 0x10 | ((sprite.attribute & 0x03) << 2) |
+					   ((sprite.attribute & 0x20) ? 0x40 : 0x00) |
+					   (sprite.sprite_zero ? 0x80 : 0x00);
+	}
+	merge_tile_attributes(pixels.data(), attribute.data(), line_sprite_count);
+
+	for (uint8_t i = 0; i < line_sprite_count; i++)
+	{
+		const uint8_t *sprite_pixels = &pixels[i * 8];
+		for (int b = 0; b < 8; b++)
+		{
+			int x = line_sprites[i].x + b;
+			if (x >= SCREEN_WIDTH)
+				break;
+			// Lower OAM indices win, even when they are behind the background
+			if (line[x] == 0x00 && !(x < 8 && !get_mask(MASK::RENDER_SPRITES_LEFT)))
+				line[x] = sprite_pixels[b];
+		}
+	}
+}
+
+void PPU::rebuild_sprite_buckets(uint8_t height)
+{
+	sprite_bucket_count.fill(0);
+	for (uint8_t n = 0; n < 64; n++)
+	{
+		int y = oam[n * 4];
+		for (int line = y; line < y + height && line < SCREEN_HEIGHT; line++)
+		{
+			uint8_t &count = sprite_bucket_count[line];
+			if (count < 8)
+				sprite_bucket[line][count++] = n;
+		}
+	}
+
+	sprite_bucket_height = height;
+	sprite_buckets_dirty = false;
+}
+
+void PPU::evaluate_sprites(int16_t line)
+{
+	uint8_t height = get_ctrl(CTRL::SPRITE_SIZE) ? 16 : 8;
+	if (sprite_buckets_dirty || height != sprite_bucket_height)
+		rebuild_sprite_buckets(height);
+
+	const auto &bucket = sprite_bucket[line];
+	line_sprite_count = sprite_bucket_count[line];
+	for (uint8_t i = 0; i < line_sprite_count; i++)
+	{
+		uint8_t n = bucket[i];
+		line_sprites[i] = {
+			static_cast<uint8_t>(line - oam[n * 4]), oam[n * 4 + 1], oam[n * 4 + 2], oam[n * 4 + 3], n == 0};
+	}
+
+	if (line_sprite_count < 8 || (status & static_cast<uint8_t>(STATUS::SPRITE_OVERFLOW)))
+		return;
+
+	// Once eight sprites are found the hardware keeps scanning for an overflow,
+	// but increments the byte offset along with the sprite index
+	uint8_t m = 0;
+	for (uint8_t n = bucket[7] + 1; n < 64; n++)
+	{
+		int diff = line - oam[n * 4 + m];
+		if (diff >= 0 && diff < height)
+		{
+			status |= static_cast<uint8_t>(STATUS::SPRITE_OVERFLOW);
+			break;
+		}
+		m = (m + 1) & 0x03;
+	}
+}
+
+// Frame-skip path: finds the sprite 0 hit from the background tiles under
+// sprite 0 alone, without composing the line
+void PPU::detect_sprite_zero_hit()
+{
+	if (!get_mask(MASK::RENDER_BACKGROUND) || !get_mask(MASK::RENDER_SPRITES))
+		return;
+	if (status & static_cast<uint8_t>(STATUS::SPRITE_ZERO_HIT))
+		return;
+	// Sprite 0 is always first in the list when it is on this line
+	if (line_sprite_count == 0 || !line_sprites[0].sprite_zero)
+		return;
+
+	const SpriteEntry &sprite = line_sprites[0];
+	uint64_t sprite_pixels = sprite_row(sprite);
+
+	int first_tile = (sprite.x + fine_x) >> 3;
+	std::array<uint8_t, 16> background;
+	fetch_background(first_tile, first_tile < 32 ? 2 : 1, background.data());
+
+	bool left_clipped = !get_mask(MASK::RENDER_BACKGROUND_LEFT) || !get_mask(MASK::RENDER_SPRITES_LEFT);
+	for (int b = 0; b < 8; b++)
+	{
+		int x = sprite.x + b;
+		if (x >= 255)
+			break;
+		if (x < 8 && left_clipped)
+			continue;
+
+		bool sprite_opaque = ((sprite_pixels >> (b * 8)) & 0x03) != 0;
+		bool bg_opaque = (background[x + fine_x - first_tile * 8] & 0x03) != 0;
+		if (sprite_opaque && bg_opaque)
+		{
+			sprite_zero_hit_cycle = x + 2;
+			return;
+		}
+	}
+}
+
+void PPU::render_scanline()
+{
+	sprite_zero_hit_cycle = -1;
+	if (skip_frame || scanline < band_first || scanline >= band_last)
+	{
+		if (rendering_enabled())
+			detect_sprite_zero_hit();
+		return;
+	}
+
+	// Observation mode composes into a scratch line instead of the framebuffer
+	std::array<uint8_t, SCREEN_WIDTH> observed_line;
+	uint8_t *out = observation_enabled ? observed_line.data() : &frame[scanline * SCREEN_WIDTH];
+	uint8_t emphasis = mask >> 5;
+	if (!observation_enabled)
+		frame_emphasis[scanline] = emphasis;
+
+	uint8_t color_mask = get_mask(MASK::GRAYSCALE) ? 0x30 : 0x3F;
+	if (!rendering_enabled())
+	{
+		std::memset(out, palette[0] & color_mask, SCREEN_WIDTH);
+	}
+	else
+	{
+		compose_scanline(out, color_mask);
+	}
+
+	if (frame_hashing)
+		frame_digest = hash_combine(frame_digest, hash_line(out, SCREEN_WIDTH, emphasis));
+	if (observation_enabled)
+		observation.add_line(scanline, out, emphasis);
+}
+
+void PPU::compose_scanline(uint8_t *out, uint8_t color_mask)
+{
+	std::array<uint8_t, SCREEN_WIDTH> background{};
+	std::array<uint8_t, SCREEN_WIDTH> sprites{};
+	if (get_mask(MASK::RENDER_BACKGROUND))
+		render_background(background);
+	if (get_mask(MASK::RENDER_SPRITES))
+		render_sprites(sprites);
+
+	bool sprite_zero_hit = (status & static_cast<uint8_t>(STATUS::SPRITE_ZERO_HIT)) != 0;
+
+	for (int x = 0; x < SCREEN_WIDTH; x++)
+	{
+		uint8_t bg = background[x];
+		uint8_t sp = sprites[x];
+		bool bg_opaque = (bg & 0x03) != 0;
+		uint8_t index = bg_opaque ? bg : 0x00;
+
+		if (sp)
+		{
+			if ((sp & 0x80) && bg_opaque && x != 255 && !sprite_zero_hit)
+			{
+				// The flag becomes visible to the CPU once the PPU reaches this pixel
+				sprite_zero_hit_cycle = x + 2;
+				sprite_zero_hit = true;
+			}
+			if (!(sp & 0x40) || !bg_opaque)
+				index = sp & 0x1F;
+		}
+
+		out[x] = palette[index] & color_mask;
+	}
+}
+
+void PPU::clock()
+{
+	// Most dots have no event: the visible portion of a line is rendered in one go at dot 1
+	if (cycle < 256 && cycle != 1 && cycle != sprite_zero_hit_cycle)
+	{
+		cycle++;
+		return;
+	}
+
+	if (scanline < 240)
+	{
+		if (cycle == 1)
+			render_scanline();
+		else if (cycle == sprite_zero_hit_cycle)
+			status |= static_cast<uint8_t>(STATUS::SPRITE_ZERO_HIT);
+
+		if (rendering_enabled())
+		{
+			if (cycle == 256)
+			{
+				increment_y();
+			}
+			else if (cycle == 257)
+			{
+				transfer_x();
+				evaluate_sprites(scanline);
+			}
+		}
+	}
+	else if (scanline == 240 && cycle == 1)
+	{
+		// The visible lines are done, later writes only matter for the next snapshot
+		end_deferred_frame();
+	}
+	else if (scanline == 241 && cycle == 1)
+	{
+		status |= static_cast<uint8_t>(STATUS::VERTICAL_BLANK);
+		frame_complete = true;
+		frame_rendered = !skip_frame;
+		if (frame_rendered)
+			frame_hash = frame_digest;
+		if (frame_ring && frame_rendered && !observation_enabled)
+			publish_frame(*frame_ring, frame_number, frame.data(), frame_emphasis.data());
+		frame_number++;
+		if (get_ctrl(CTRL::ENABLE_NMI))
+			nmi = true;
+	}
+	else if (scanline == 261)
+	{
+		if (cycle == 1)
+		{
+			// Deferred frames start from a snapshot taken before the pre-render line
+			if (renderer)
+				frame_log = renderer->begin_frame(*this);
+
+			status &= ~static_cast<uint8_t>(STATUS::VERTICAL_BLANK) &
+					  ~static_cast<uint8_t>(STATUS::SPRITE_ZERO_HIT) &
+					  ~static_cast<uint8_t>(STATUS::SPRITE_OVERFLOW);
+			sprite_zero_hit_cycle = -1;
+			frame_digest = FRAME_HASH_SEED;
+			skip_frame = renderer != nullptr || (frame_skip != 0 && (frame_number % (frame_skip + 1)) != 0);
+		}
+
+		if (rendering_enabled())
+		{
+			if (cycle == 256)
+			{
+				increment_y();
+			}
+			else if (cycle == 257)
+			{
+				transfer_x();
+				line_sprite_count = 0; // No sprites are drawn on line 0
+			}
+			else if (cycle == 280)
+			{
+				transfer_y();
+			}
+			else if (cycle == 339 && odd_frame)
+			{
+				cycle = 340; // Odd frames skip the last dot of the pre-render line
+			}
+		}
+	}
+
+	if (++cycle > 340)
+	{
+		cycle = 0;
+		if (++scanline > 261)
+		{
+			scanline = 0;
+			odd_frame = !odd_frame;
+		}
+	}
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "core/rom_database.h"
+#include "core/rom_hash.h"
+
+static constexpr char DATABASE_MAGIC[8] = {'N', 'E', 'S', 'R', 'O', 'M', 'D', 'B'};
+static constexpr uint32_t DATABASE_VERSION = 1;
+
+struct DatabaseHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+};
+static_assert(sizeof(DatabaseHeader) == 16, "DatabaseHeader is the on-disk layout");
+
+static bool by_crc(const RomRecord &a, const RomRecord &b)
+{
+	return a.crc32 < b.crc32;
+}
+
+RomDatabase::RomDatabase()
+{
+}
+
+RomDatabase::~RomDatabase()
+{
+	close();
+}
+
+bool RomDatabase::open(const std::string &path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(DatabaseHeader))
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (memory == MAP_FAILED)
+		return false;
+	mapped = memory;
+	mapped_size = info.st_size;
+
+	DatabaseHeader header;
+	std::memcpy(&header, memory, sizeof(header));
+	if (std::memcmp(header.magic, DATABASE_MAGIC, sizeof(DATABASE_MAGIC)) != 0 || header.version != DATABASE_VERSION ||
+		mapped_size != sizeof(DatabaseHeader) + static_cast<size_t>(header.count) * sizeof(RomRecord))
+	{
+		close();
+		return false;
+	}
+
+	records = reinterpret_cast<const RomRecord *>(static_cast<const uint8_t *>(memory) + sizeof(DatabaseHeader));
+	count = header.count;
+	return true;
+}
+
+void RomDatabase::close()
+{
+	if (mapped)
+		munmap(mapped, mapped_size);
+	mapped = nullptr;
+	mapped_size = 0;
+	owned.clear();
+	records = nullptr;
+	count = 0;
+}
+
+void RomDatabase::set_records(std::vector<RomRecord> new_records)
+{
+	close();
+	owned = std::move(new_records);
+	std::stable_sort(owned.begin(), owned.end(), by_crc);
+	records = owned.data();
+	count = owned.size();
+}
+
+bool RomDatabase::write(const std::string &path, std::vector<RomRecord> new_records)
+{
+	std::stable_sort(new_records.begin(), new_records.end(), by_crc);
+
+	DatabaseHeader header;
+	std::memcpy(header.magic, DATABASE_MAGIC, sizeof(DATABASE_MAGIC));
+	header.version = DATABASE_VERSION;
+	header.count = static_cast<uint32_t>(new_records.size());
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char *>(new_records.data()), new_records.size() * sizeof(RomRecord));
+	return static_cast<bool>(out);
+}
+
+const RomRecord *RomDatabase::find(const uint8_t *prg, size_t prg_size, const uint8_t *chr, size_t chr_size) const
+{
+	stats.lookups++;
+	if (count == 0)
+		return nullptr;
+
+	uint32_t crc = crc32(chr, chr_size, crc32(prg, prg_size));
+	RomRecord key{};
+	key.crc32 = crc;
+	auto [first, last] = std::equal_range(records, records + count, key, by_crc);
+	if (first == last)
+		return nullptr;
+
+	// CRC-32 collides across thousands of dumps; SHA-1 settles it
+	stats.crc_hits++;
+	uint8_t digest[20];
+	Sha1 sha1;
+	sha1.update(prg, prg_size);
+	sha1.update(chr, chr_size);
+	sha1.finish(digest);
+
+	static const uint8_t none[20] = {};
+	const RomRecord *crc_only = nullptr;
+	for (const RomRecord *record = first; record != last; record++)
+	{
+		if (std::memcmp(record->sha1, digest, sizeof(digest)) == 0)
+		{
+			stats.matches++;
+			return record;
+		}
+		if (!crc_only && std::memcmp(record->sha1, none, sizeof(none)) == 0)
+			crc_only = record;
+	}
+	stats.matches += crc_only != nullptr;
+	return crc_only;
+}
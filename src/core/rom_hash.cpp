@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "core/rom_hash.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NES_X86 1
+#endif
+
+/* CRC-32, slicing-by-8 */
+using CrcTables = std::array<std::array<uint32_t, 256>, 8>;
+
+static constexpr CrcTables make_tables()
+{
+	CrcTables tables{};
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ ((crc & 0x01) ? 0xEDB88320u : 0);
+		tables[0][i] = crc;
+	}
+	for (uint32_t i = 0; i < 256; i++)
+		for (int t = 1; t < 8; t++)
+			tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xFF];
+	return tables;
+}
+
+static constexpr CrcTables CRC_TABLES = make_tables();
+
+// Works on the inverted register, like the PCLMUL path
+static uint32_t crc32_tables(const uint8_t *data, size_t size, uint32_t crc)
+{
+	for (; size >= 8; data += 8, size -= 8)
+	{
+		uint32_t lo, hi;
+		std::memcpy(&lo, data, 4);
+		std::memcpy(&hi, data + 4, 4);
+		lo ^= crc;
+		crc = CRC_TABLES[7][lo & 0xFF] ^ CRC_TABLES[6][(lo >> 8) & 0xFF] ^
+			  CRC_TABLES[5][(lo >> 16) & 0xFF] ^ CRC_TABLES[4][lo >> 24] ^
+			  CRC_TABLES[3][hi & 0xFF] ^ CRC_TABLES[2][(hi >> 8) & 0xFF] ^
+			  CRC_TABLES[1][(hi >> 16) & 0xFF] ^ CRC_TABLES[0][hi >> 24];
+	}
+	for (; size > 0; data++, size--)
+		crc = (crc >> 8) ^ CRC_TABLES[0][(crc ^ *data) & 0xFF];
+	return crc;
+}
+
+uint32_t crc32_scalar(const uint8_t *data, size_t size, uint32_t crc)
+{
+	return ~crc32_tables(data, size, ~crc);
+}
+
+#ifdef NES_X86
+/* CRC-32, PCLMULQDQ folding */
+// Carries 16 bytes of remainder forward by 512 (k1k2) or 128 (k3k4) bits and adds the next block
+__attribute__((target("pclmul"))) static inline __m128i fold(__m128i x, __m128i k, __m128i next)
+{
+	__m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+	__m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+	return _mm_xor_si128(_mm_xor_si128(lo, hi), next);
+}
+
+// Fold constants for the reflected polynomial (Intel, "Fast CRC Computation
+// for Generic Polynomials Using PCLMULQDQ"). size is a multiple of 16, at least 64.
+__attribute__((target("pclmul,sse4.1"))) static uint32_t crc32_pclmul(const uint8_t *data, size_t size, uint32_t crc)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+	const __m128i k5 = _mm_set_epi64x(0, 0x0163CD6124);
+	const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+	const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	// Four independent lanes of 16 bytes
+	__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+	__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16));
+	__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 32));
+	__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 48));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+	data += 64;
+	size -= 64;
+
+	for (; size >= 64; data += 64, size -= 64)
+	{
+		x1 = fold(x1, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+		x2 = fold(x2, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16)));
+		x3 = fold(x3, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 32)));
+		x4 = fold(x4, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 48)));
+	}
+
+	// Down to one lane, then the remaining 16 byte blocks
+	x1 = fold(x1, k3k4, x2);
+	x1 = fold(x1, k3k4, x3);
+	x1 = fold(x1, k3k4, x4);
+	for (; size >= 16; data += 16, size -= 16)
+		x1 = fold(x1, k3k4, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+
+	// 128 -> 64 bits
+	__m128i t = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+	t = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, low32);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5, 0x00), t);
+
+	// Barrett reduction to 32 bits
+	t = _mm_and_si128(x1, low32);
+	t = _mm_clmulepi64_si128(t, poly, 0x10);
+	t = _mm_and_si128(t, low32);
+	t = _mm_clmulepi64_si128(t, poly, 0x00);
+	x1 = _mm_xor_si128(x1, t);
+	return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+static bool detect_pclmul()
+{
+	__builtin_cpu_init(); // Runs during static initialisation
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+static const bool has_pclmul = detect_pclmul();
+#endif
+
+/* Dispatch */
+uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc)
+{
+	if (size == 0)
+		return crc; // data may be null
+	crc = ~crc;
+#ifdef NES_X86
+	if (has_pclmul && size >= 64)
+	{
+		size_t blocks = size & ~static_cast<size_t>(15);
+		crc = crc32_pclmul(data, blocks, crc);
+		data += blocks;
+		size -= blocks;
+	}
+#endif
+	return ~crc32_tables(data, size, crc);
+}
+
+bool crc32_accelerated()
+{
+#ifdef NES_X86
+	return has_pclmul;
+#else
+	return false;
+#endif
+}
+
+/* SHA-1 */
+static inline uint32_t rotl32(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+Sha1::Sha1()
+	: state{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0}
+{
+}
+
+void Sha1::block(const uint8_t *data)
+{
+	uint32_t w[80];
+	for (int i = 0; i < 16; i++)
+		w[i] = load_be32(data + i * 4);
+	for (int i = 16; i < 80; i++)
+		w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	auto round = [&](uint32_t f, uint32_t k, uint32_t word)
+	{
+		uint32_t t = rotl32(a, 5) + f + e + k + word;
+		e = d;
+		d = c;
+		c = rotl32(b, 30);
+		b = a;
+		a = t;
+	};
+	for (int i = 0; i < 20; i++)
+		round((b & c) | (~b & d), 0x5A827999, w[i]);
+	for (int i = 20; i < 40; i++)
+		round(b ^ c ^ d, 0x6ED9EBA1, w[i]);
+	for (int i = 40; i < 60; i++)
+		round((b & c) | (b & d) | (c & d), 0x8F1BBCDC, w[i]);
+	for (int i = 60; i < 80; i++)
+		round(b ^ c ^ d, 0xCA62C1D6, w[i]);
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+void Sha1::update(const uint8_t *data, size_t size)
+{
+	if (size == 0)
+		return; // data may be null, e.g. no CHR ROM
+	length += size;
+	if (buffered > 0)
+	{
+		size_t take = std::min(size, sizeof(buffer) - buffered);
+		std::memcpy(buffer + buffered, data, take);
+		buffered += take;
+		data += take;
+		size -= take;
+		if (buffered < sizeof(buffer))
+			return;
+		block(buffer);
+		buffered = 0;
+	}
+	for (; size >= 64; data += 64, size -= 64)
+		block(data);
+	std::memcpy(buffer, data, size);
+	buffered = size;
+}
+
+void Sha1::finish(uint8_t digest[20])
+{
+	uint64_t bits = length * 8;
+	uint8_t pad[72] = {0x80};
+	size_t pad_size = (buffered < 56 ? 56 : 120) - buffered;
+	for (int i = 0; i < 8; i++)
+		pad[pad_size + i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+	update(pad, pad_size + 8);
+
+	for (int i = 0; i < 5; i++)
+	{
+		digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+		digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+		digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+		digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+	}
+}
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "core/save_ram.h"
+#include "core/cartridge.h"
+
+SaveRam::SaveRam(int flush_interval) : flush_interval(std::max(flush_interval, 1))
+{
+}
+
+SaveRam::~SaveRam()
+{
+	close();
+}
+
+bool SaveRam::open(std::shared_ptr<Cartridge> new_cartridge, const std::string &new_path)
+{
+	close();
+
+	std::vector<uint8_t> &ram = new_cartridge->prg_ram;
+	int fd = ::open(new_path.c_str(), O_RDONLY);
+	if (fd >= 0)
+	{
+		ssize_t size = ::read(fd, ram.data(), ram.size());
+		::close(fd);
+		if (size < 0)
+			return false;
+	}
+	else if (errno != ENOENT)
+	{
+		return false;
+	}
+
+	cartridge = std::move(new_cartridge);
+	path = new_path;
+	saved = ram;
+	frames = 0;
+	have_pending = false;
+	writing = false;
+	stopping = false;
+	stats = Stats();
+	writer = std::thread(&SaveRam::writer_loop, this);
+	return true;
+}
+
+void SaveRam::close()
+{
+	if (!cartridge)
+		return;
+
+	flush();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	work_ready.notify_all();
+	writer.join();
+	cartridge.reset();
+}
+
+/* Emulation thread */
+void SaveRam::end_frame()
+{
+	if (cartridge && ++frames >= flush_interval)
+	{
+		frames = 0;
+		check();
+	}
+}
+
+void SaveRam::flush()
+{
+	if (!cartridge)
+		return;
+
+	check();
+	std::unique_lock<std::mutex> guard(lock);
+	work_done.wait(guard, [this] { return !have_pending && !writing; });
+}
+
+// 8 KiB compare: far cheaper than tracking every store
+void SaveRam::check()
+{
+	const std::vector<uint8_t> &ram = cartridge->prg_ram;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stats.checks++;
+	}
+	if (std::memcmp(ram.data(), saved.data(), ram.size()) == 0)
+		return;
+	saved = ram;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stats.coalesced += have_pending;
+		pending = ram;
+		have_pending = true;
+	}
+	work_ready.notify_one();
+}
+
+SaveRam::Stats SaveRam::get_stats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
+
+/* Writer */
+void SaveRam::writer_loop()
+{
+	std::vector<uint8_t> data;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			work_ready.wait(guard, [this] { return stopping || have_pending; });
+			if (!have_pending)
+				return;
+			data.swap(pending);
+			have_pending = false;
+			writing = true;
+		}
+
+		bool ok = write_file(data);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			writing = false;
+			stats.saves += ok;
+			stats.write_error |= !ok;
+		}
+		work_done.notify_all();
+	}
+}
+
+bool SaveRam::write_file(const std::vector<uint8_t> &data)
+{
+	std::string temporary = path + ".tmp";
+	int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+
+	size_t done = 0;
+	while (done < data.size())
+	{
+		ssize_t written = ::write(fd, data.data() + done, data.size() - done);
+		if (written <= 0)
+			break;
+		done += written;
+	}
+	bool ok = done == data.size() && fsync(fd) == 0;
+	ok = ::close(fd) == 0 && ok;
+	if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+
+	// Make the rename itself durable
+	size_t slash = path.find_last_of('/');
+	std::string directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+	int dir = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if (dir >= 0)
+	{
+		fsync(dir);
+		::close(dir);
+	}
+	return true;
+}
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "core/shm_ring.h"
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs address-free atomics");
+
+static constexpr uint32_t RING_MAGIC = 0x474E5253; // "SRNG"
+static constexpr uint32_t RING_VERSION = 1;
+static constexpr size_t CACHE_LINE = 64;
+
+struct alignas(CACHE_LINE) ShmRing::Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t slot_size;
+	uint64_t slot_stride;
+	alignas(CACHE_LINE) std::atomic<uint64_t> published;
+};
+
+struct alignas(CACHE_LINE) ShmRing::Slot
+{
+	std::atomic<uint64_t> state; // Odd while being written
+	uint64_t tag;
+	uint32_t size;
+	// Payload follows at the next cache line
+};
+
+static size_t align_up(size_t value)
+{
+	return (value + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+}
+
+ShmRing::ShmRing()
+{
+}
+
+ShmRing::~ShmRing()
+{
+	close();
+}
+
+bool ShmRing::create(const std::string &name, uint32_t slot_count, uint32_t slot_size)
+{
+	close();
+	if (slot_count == 0)
+		return false;
+
+	uint64_t stride = sizeof(Slot) + align_up(slot_size);
+	size_t size = sizeof(Header) + stride * slot_count;
+
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, size) != 0)
+	{
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (memory == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	// ftruncate zero-fills, so every slot state starts out as "never written"
+	header = static_cast<Header *>(memory);
+	header->slot_count = slot_count;
+	header->slot_size = slot_size;
+	header->slot_stride = stride;
+	header->version = RING_VERSION;
+	header->published.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = RING_MAGIC;
+
+	mapped_size = size;
+	segment_name = name;
+	owner = true;
+	writing = 0;
+	return true;
+}
+
+bool ShmRing::open(const std::string &name)
+{
+	close();
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header))
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (memory == MAP_FAILED)
+		return false;
+
+	header = static_cast<Header *>(memory);
+	mapped_size = info.st_size;
+	if (header->magic != RING_MAGIC || header->version != RING_VERSION ||
+		sizeof(Header) + header->slot_stride * header->slot_count > mapped_size)
+	{
+		close();
+		return false;
+	}
+
+	segment_name = name;
+	owner = false;
+	return true;
+}
+
+void ShmRing::close()
+{
+	if (header)
+		munmap(header, mapped_size);
+	if (owner)
+		shm_unlink(segment_name.c_str());
+
+	header = nullptr;
+	mapped_size = 0;
+	owner = false;
+}
+
+uint32_t ShmRing::get_slot_count() const
+{
+	return header ? header->slot_count : 0;
+}
+
+uint32_t ShmRing::get_slot_size() const
+{
+	return header ? header->slot_size : 0;
+}
+
+ShmRing::Slot *ShmRing::slot(uint64_t sequence) const
+{
+	uint8_t *base = reinterpret_cast<uint8_t *>(header) + sizeof(Header);
+	return reinterpret_cast<Slot *>(base + (sequence % header->slot_count) * header->slot_stride);
+}
+
+/* Producer */
+uint8_t *ShmRing::begin_write()
+{
+	Slot *target = slot(writing);
+	target->state.store(writing * 2 + 1, std::memory_order_relaxed);
+	// Consumers must see the odd state before any payload byte changes
+	std::atomic_thread_fence(std::memory_order_release);
+	return reinterpret_cast<uint8_t *>(target) + sizeof(Slot);
+}
+
+void ShmRing::commit(uint32_t size, uint64_t tag)
+{
+	Slot *target = slot(writing);
+	target->size = size;
+	target->tag = tag;
+	target->state.store(writing * 2 + 2, std::memory_order_release);
+	writing++;
+	header->published.store(writing, std::memory_order_release);
+}
+
+/* Consumer */
+uint64_t ShmRing::get_published() const
+{
+	return header->published.load(std::memory_order_acquire);
+}
+
+const uint8_t *ShmRing::acquire(uint64_t sequence, uint32_t &size, uint64_t &tag) const
+{
+	const Slot *source = slot(sequence);
+	if (source->state.load(std::memory_order_acquire) != sequence * 2 + 2)
+		return nullptr;
+
+	size = source->size;
+	tag = source->tag;
+	return reinterpret_cast<const uint8_t *>(source) + sizeof(Slot);
+}
+
+bool ShmRing::validate(uint64_t sequence) const
+{
+	// Orders the payload reads before the second look at the state
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot(sequence)->state.load(std::memory_order_relaxed) == sequence * 2 + 2;
+}
+
+bool publish_frame(ShmRing &ring, uint64_t frame, const uint8_t *indices, const uint8_t *emphasis)
+{
+	if (!ring.is_open() || ring.get_slot_size() < SHM_FRAME_SIZE)
+		return false;
+
+	uint8_t *out = ring.begin_write();
+	std::memcpy(out, indices, 256 * 240);
+	std::memcpy(out + 256 * 240, emphasis, 240);
+	ring.commit(SHM_FRAME_SIZE, frame);
+	return true;
+}
+
+bool publish_audio(ShmRing &ring, uint64_t first_sample, const int16_t *samples, int count)
+{
+	if (!ring.is_open() || ring.get_slot_size() < sizeof(int16_t))
+		return false;
+
+	const int per_slot = static_cast<int>(ring.get_slot_size() / sizeof(int16_t));
+	for (int done = 0; done < count; done += per_slot)
+	{
+		int block = std::min(per_slot, count - done);
+		std::memcpy(ring.begin_write(), samples + done, block * sizeof(int16_t));
+		ring.commit(static_cast<uint32_t>(block * sizeof(int16_t)), first_sample + done);
+	}
+	return true;
+}
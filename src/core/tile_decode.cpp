@@ -0,0 +1,207 @@
+#include <cstring>
+
+#include "core/tile_decode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NES_X86 1
+#endif
+
+/* Scalar */
+static void decode_scalar(const uint8_t *lo, const uint8_t *hi, const uint8_t *attribute, int count, uint8_t *out)
+{
+	for (int i = 0; i < count; i++)
+	{
+		for (int b = 0; b < 8; b++)
+		{
+			uint8_t pixel = ((lo[i] >> (7 - b)) & 0x01) | (((hi[i] >> (7 - b)) & 0x01) << 1);
+			out[i * 8 + b] = pixel ? (pixel | attribute[i]) : 0x00;
+		}
+	}
+}
+
+static void merge_scalar(uint8_t *pixels, const uint8_t *attribute, int count)
+{
+	const uint64_t lsb = 0x0101010101010101ull;
+
+	for (int i = 0; i < count; i++)
+	{
+		uint64_t row;
+		std::memcpy(&row, pixels + i * 8, sizeof(row));
+		uint64_t opaque = ((row | (row >> 1)) & lsb) * 0xFF;
+		row |= opaque & (attribute[i] * lsb);
+		std::memcpy(pixels + i * 8, &row, sizeof(row));
+	}
+}
+
+#ifdef NES_X86
+/* SSE2: two tiles per register */
+static void decode_sse2(const uint8_t *lo, const uint8_t *hi, const uint8_t *attribute, int count, uint8_t *out)
+{
+	const __m128i bit_mask = _mm_set_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+										  0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i two = _mm_set1_epi8(2);
+	const __m128i zero = _mm_setzero_si128();
+
+	// Spreads two bytes into two runs of eight
+	auto broadcast = [](const uint8_t *src)
+	{
+		__m128i v = _mm_cvtsi32_si128(src[0] | (src[1] << 8));
+		v = _mm_unpacklo_epi8(v, v);
+		v = _mm_unpacklo_epi16(v, v);
+		return _mm_unpacklo_epi32(v, v);
+	};
+
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128i l = broadcast(lo + i);
+		__m128i h = broadcast(hi + i);
+		__m128i a = broadcast(attribute + i);
+
+		__m128i p0 = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(l, bit_mask), bit_mask), one);
+		__m128i p1 = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(h, bit_mask), bit_mask), two);
+		__m128i pixels = _mm_or_si128(p0, p1);
+		__m128i transparent = _mm_cmpeq_epi8(pixels, zero);
+		pixels = _mm_or_si128(pixels, _mm_andnot_si128(transparent, a));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 8), pixels);
+	}
+	if (i < count)
+		decode_scalar(lo + i, hi + i, attribute + i, count - i, out + i * 8);
+}
+
+static void merge_sse2(uint8_t *pixels, const uint8_t *attribute, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128i a = _mm_cvtsi32_si128(attribute[i] | (attribute[i + 1] << 8));
+		a = _mm_unpacklo_epi8(a, a);
+		a = _mm_unpacklo_epi16(a, a);
+		a = _mm_unpacklo_epi32(a, a);
+
+		__m128i *row = reinterpret_cast<__m128i *>(pixels + i * 8);
+		__m128i p = _mm_loadu_si128(row);
+		p = _mm_or_si128(p, _mm_andnot_si128(_mm_cmpeq_epi8(p, zero), a));
+		_mm_storeu_si128(row, p);
+	}
+	if (i < count)
+		merge_scalar(pixels + i * 8, attribute + i, count - i);
+}
+
+/* BMI2: PDEP scatters each bitplane into the low bits of eight bytes */
+__attribute__((target("bmi2"))) static void decode_bmi2(const uint8_t *lo, const uint8_t *hi, const uint8_t *attribute, int count, uint8_t *out)
+{
+	const uint64_t lsb = 0x0101010101010101ull;
+
+	for (int i = 0; i < count; i++)
+	{
+		// Bit 7 is the leftmost pixel, so reverse the byte order after depositing
+		uint64_t pixels = __builtin_bswap64(_pdep_u64(lo[i], lsb) | (_pdep_u64(hi[i], lsb) << 1));
+		uint64_t opaque = ((pixels | (pixels >> 1)) & lsb) * 0xFF;
+		pixels |= opaque & (attribute[i] * lsb);
+		std::memcpy(out + i * 8, &pixels, sizeof(pixels));
+	}
+}
+
+/* AVX2: four tiles per register */
+// Byte n of src goes to bytes 8n..8n+7 (two per lane)
+__attribute__((target("avx2"))) static inline __m256i broadcast_avx2(const uint8_t *src)
+{
+	const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+											2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	int32_t bytes;
+	std::memcpy(&bytes, src, sizeof(bytes));
+	return _mm256_shuffle_epi8(_mm256_set1_epi32(bytes), spread);
+}
+
+__attribute__((target("avx2"))) static void decode_avx2(const uint8_t *lo, const uint8_t *hi, const uint8_t *attribute, int count, uint8_t *out)
+{
+	const __m256i bit_mask = _mm256_set1_epi64x(0x0102040810204080ll);
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i two = _mm256_set1_epi8(2);
+	const __m256i zero = _mm256_setzero_si256();
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256i l = broadcast_avx2(lo + i);
+		__m256i h = broadcast_avx2(hi + i);
+		__m256i a = broadcast_avx2(attribute + i);
+
+		__m256i p0 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(l, bit_mask), bit_mask), one);
+		__m256i p1 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(h, bit_mask), bit_mask), two);
+		__m256i pixels = _mm256_or_si256(p0, p1);
+		__m256i transparent = _mm256_cmpeq_epi8(pixels, zero);
+		pixels = _mm256_or_si256(pixels, _mm256_andnot_si256(transparent, a));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i * 8), pixels);
+	}
+	if (i < count)
+		decode_sse2(lo + i, hi + i, attribute + i, count - i, out + i * 8);
+}
+
+__attribute__((target("avx2"))) static void merge_avx2(uint8_t *pixels, const uint8_t *attribute, int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256i a = broadcast_avx2(attribute + i);
+		__m256i *row = reinterpret_cast<__m256i *>(pixels + i * 8);
+		__m256i p = _mm256_loadu_si256(row);
+		p = _mm256_or_si256(p, _mm256_andnot_si256(_mm256_cmpeq_epi8(p, zero), a));
+		_mm256_storeu_si256(row, p);
+	}
+	if (i < count)
+		merge_sse2(pixels + i * 8, attribute + i, count - i);
+}
+#endif
+
+/* Runtime dispatch */
+static DecodeFn path_function(DecodePath path)
+{
+	switch (path)
+	{
+#ifdef NES_X86
+	case DecodePath::SSE2:
+		return decode_sse2;
+	case DecodePath::BMI2:
+		return decode_bmi2;
+	case DecodePath::AVX2:
+		return decode_avx2;
+#endif
+	default:
+		return decode_scalar;
+	}
+}
+
+static MergeFn merge_function(DecodePath path)
+{
+	switch (path)
+	{
+#ifdef NES_X86
+	case DecodePath::SSE2:
+		return merge_sse2;
+	case DecodePath::AVX2:
+		return merge_avx2;
+#endif
+	default:
+		return merge_scalar; // 64-bit SWAR, also used by the BMI2 path
+	}
+}
+
+void decode_tile_rows(const uint8_t *lo, const uint8_t *hi, const uint8_t *attribute, int count, uint8_t *out)
+{
+	path_function(get_decode_path())(lo, hi, attribute, count, out);
+}
+
+void merge_tile_attributes(uint8_t *pixels, const uint8_t *attribute, int count)
+{
+	merge_function(get_decode_path())(pixels, attribute, count);
+}
@@ -0,0 +1,122 @@
+#include <cstring>
+
+#include "core/y4m_recorder.h"
+#include "core/frame_convert.h"
+#include "core/ppu.h"
+
+static constexpr int WIDTH = PPU::SCREEN_WIDTH;
+static constexpr int HEIGHT = PPU::SCREEN_HEIGHT;
+static constexpr size_t FRAME_BYTES = WIDTH * HEIGHT + HEIGHT;
+
+Y4mRecorder::Y4mRecorder(int queue_frames)
+{
+	if (queue_frames < 1)
+		queue_frames = 1;
+	queue.resize(queue_frames, std::vector<uint8_t>(FRAME_BYTES));
+}
+
+Y4mRecorder::~Y4mRecorder()
+{
+	close();
+}
+
+bool Y4mRecorder::open(const std::string &path, uint32_t rate_num, uint32_t rate_den)
+{
+	close();
+
+	file = std::fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+	// Square pixels, progressive, limited range 4:2:0 as convert_yuv420() produces
+	std::fprintf(file, "YUV4MPEG2 W%d H%d F%u:%u Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+				 WIDTH, HEIGHT, rate_num, rate_den);
+
+	pushed = 0;
+	written = 0;
+	stopping = false;
+	stats = Stats();
+	encoder = std::thread(&Y4mRecorder::encoder_loop, this);
+	return true;
+}
+
+void Y4mRecorder::close()
+{
+	if (!file)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	frame_ready.notify_all();
+	encoder.join();
+
+	std::fclose(file);
+	file = nullptr;
+}
+
+void Y4mRecorder::push_frame(const uint8_t *indices, const uint8_t *emphasis)
+{
+	if (!file)
+		return;
+
+	std::unique_lock<std::mutex> guard(lock);
+	if (pushed - written == queue.size())
+	{
+		stats.producer_waits++;
+		slot_free.wait(guard, [this] { return pushed - written < queue.size(); });
+	}
+	std::vector<uint8_t> &slot = queue[pushed % queue.size()];
+	guard.unlock();
+
+	// Only the encoder reads queued slots, and it never touches this one until pushed moves
+	std::memcpy(slot.data(), indices, WIDTH * HEIGHT);
+	std::memcpy(slot.data() + WIDTH * HEIGHT, emphasis, HEIGHT);
+
+	guard.lock();
+	pushed++;
+	guard.unlock();
+	frame_ready.notify_one();
+}
+
+Y4mRecorder::Stats Y4mRecorder::get_stats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
+
+/* Encoder thread */
+void Y4mRecorder::encoder_loop()
+{
+	std::vector<uint8_t> planes(WIDTH * HEIGHT * 3 / 2);
+	uint8_t *y = planes.data();
+	uint8_t *u = y + WIDTH * HEIGHT;
+	uint8_t *v = u + WIDTH * HEIGHT / 4;
+
+	while (true)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		frame_ready.wait(guard, [this] { return stopping || written < pushed; });
+		if (written == pushed)
+			return;
+		const std::vector<uint8_t> &slot = queue[written % queue.size()];
+		guard.unlock();
+
+		convert_yuv420(slot.data(), slot.data() + WIDTH * HEIGHT, WIDTH, HEIGHT, y, u, v);
+
+		// The slot can be reused as soon as it is converted
+		guard.lock();
+		written++;
+		guard.unlock();
+		slot_free.notify_one();
+
+		bool ok = std::fwrite("FRAME\n", 1, 6, file) == 6 &&
+				  std::fwrite(planes.data(), 1, planes.size(), file) == planes.size();
+
+		guard.lock();
+		stats.frames_written++;
+		stats.write_error = stats.write_error || !ok;
+	}
+}
@@ -0,0 +1,536 @@
+#include "catch_amalgamated.hpp"
+#include "core/apu.h"
+#include "core/bus.h"
+#include "core/cpu_features.h"
+#include "core/audio_renderer.h"
+#include "core/expansion_audio.h"
+
+#include <vector>
+
+// Clocks the whole system until the CPU has run the given number of cycles
+static void run_cpu_cycles(Bus &bus, uint64_t cycles)
+{
+	uint64_t target = bus.get_cpu_cycles() + cycles;
+	while (bus.get_cpu_cycles() < target)
+		bus.clock();
+}
+
+/* Registers */
+TEST_CASE("Length counters run down on half frames and show in $4015", "[apu][length]")
+{
+	APU apu;
+	apu.cpu_write(0, 0x4015, 0x0F);
+	apu.cpu_write(0, 0x4000, 0x10); // Length counting, constant volume
+	apu.cpu_write(0, 0x4003, 0x18); // Length index 3: 2 half frames
+	apu.cpu_write(0, 0x400C, 0x30);
+	apu.cpu_write(0, 0x400F, 0x08); // Length index 1: 254
+	REQUIRE((apu.cpu_read(1, 0x4015) & 0x0F) == 0x09);
+
+	REQUIRE((apu.cpu_read(14913, 0x4015) & 0x01) == 0x01);
+	REQUIRE((apu.cpu_read(14914, 0x4015) & 0x01) == 0x01);
+	REQUIRE((apu.cpu_read(29830, 0x4015) & 0x0F) == 0x08);
+
+	// Disabling a channel clears its counter, and lengths do not load while disabled
+	apu.cpu_write(29830, 0x4015, 0x00);
+	apu.cpu_write(29830, 0x4007, 0x08);
+	REQUIRE((apu.cpu_read(29831, 0x4015) & 0x0F) == 0x00);
+}
+
+TEST_CASE("Frame counter raises its IRQ at the end of the 4-step sequence", "[apu][irq]")
+{
+	APU apu;
+	REQUIRE_FALSE(apu.irq());
+	REQUIRE(apu.next_event_cycle() == 29830);
+	apu.run_until(29829);
+	REQUIRE_FALSE(apu.irq());
+	apu.run_until(29830);
+	REQUIRE(apu.irq());
+
+	REQUIRE((apu.cpu_read(29831, 0x4015, true) & 0x40) == 0x40);
+	REQUIRE((apu.cpu_read(29831, 0x4015) & 0x40) == 0x40); // Reading acknowledges
+	REQUIRE_FALSE(apu.irq());
+
+	// Inhibited, or in 5-step mode, there is no IRQ
+	apu.cpu_write(30000, 0x4017, 0x40);
+	apu.run_until(100000);
+	REQUIRE_FALSE(apu.irq());
+	apu.cpu_write(100000, 0x4017, 0x80);
+	apu.run_until(200000);
+	REQUIRE_FALSE(apu.irq());
+}
+
+TEST_CASE("Frame IRQ reaches the CPU through the bus", "[apu][irq][bus]")
+{
+	Bus bus;
+	// Reset: CLI, then a long run of NOPs. IRQ handler: store $4015 to $10, then NOPs.
+	std::fill(bus.memory.begin() + 0x8000, bus.memory.begin() + 0xF000, 0xEA);
+	bus.memory[0x8000] = 0x58;
+	std::vector<uint8_t> handler = {0xAD, 0x15, 0x40, 0x85, 0x10};
+	std::copy(handler.begin(), handler.end(), bus.memory.begin() + 0xC000);
+	bus.memory[0xFFFC] = 0x00;
+	bus.memory[0xFFFD] = 0x80;
+	bus.memory[0xFFFE] = 0x00;
+	bus.memory[0xFFFF] = 0xC0;
+	bus.reset();
+
+	run_cpu_cycles(bus, 29000);
+	REQUIRE(bus.memory[0x10] == 0x00);
+	run_cpu_cycles(bus, 1000);
+	REQUIRE(bus.cpu.get_pc() > 0xC005);
+	REQUIRE((bus.memory[0x10] & 0x40) == 0x40);
+	REQUIRE_FALSE(bus.apu.irq()); // Acknowledged by the handler's read
+}
+
+/* Synthesis */
+TEST_CASE("Pulse channel produces its programmed frequency", "[apu][synthesis]")
+{
+	APU apu;
+	apu.cpu_write(0, 0x4015, 0x01);
+	apu.cpu_write(0, 0x4000, 0xBF); // 50% duty, halted length, volume 15
+	uint16_t period = 253;			// 1789773 / (16 * 254) = 440.4 Hz
+	apu.cpu_write(0, 0x4002, period & 0xFF);
+	apu.cpu_write(0, 0x4003, period >> 8);
+
+	// Skip the first 0.1 s while the DC blocker settles, then look at the next 0.2 s
+	const uint64_t tenth = static_cast<uint64_t>(APU::CLOCK_RATE / 10);
+	apu.end_frame(tenth);
+	std::vector<int16_t> samples(apu.samples_available());
+	apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+
+	apu.end_frame(tenth * 3);
+	samples.resize(apu.samples_available());
+	REQUIRE(apu.read_samples(samples.data(), static_cast<int>(samples.size())) == static_cast<int>(samples.size()));
+	REQUIRE(samples.size() == Catch::Approx(9600).margin(2));
+
+	int crossings = 0;
+	for (size_t i = 1; i < samples.size(); i++)
+		crossings += (samples[i - 1] < 0) != (samples[i] < 0);
+	REQUIRE(crossings == Catch::Approx(2 * 88.1).margin(4));
+
+	int16_t peak = 0;
+	for (int16_t sample : samples)
+		peak = std::max<int16_t>(peak, sample);
+	REQUIRE(peak > 1000);
+}
+
+// Ten frames of the pulse and noise channels with a sweep
+static std::vector<float> render_tone(BlipBuffer::Quality quality)
+{
+	APU apu;
+	apu.set_quality(quality);
+	apu.cpu_write(0, 0x4015, 0x09);
+	apu.cpu_write(0, 0x4000, 0xBF);
+	apu.cpu_write(0, 0x4001, 0xA3); // Sweep down
+	apu.cpu_write(0, 0x4002, 0x40);
+	apu.cpu_write(0, 0x4003, 0x01);
+	apu.cpu_write(0, 0x400C, 0x38);
+	apu.cpu_write(0, 0x400E, 0x04);
+	apu.cpu_write(0, 0x400F, 0x00);
+
+	std::vector<float> samples;
+	uint64_t cycle = 0;
+	for (int frame = 0; frame < 10; frame++)
+	{
+		cycle += 29781;
+		apu.end_frame(cycle);
+		std::vector<int16_t> block(apu.samples_available());
+		apu.read_samples(block.data(), static_cast<int>(block.size()));
+		samples.insert(samples.end(), block.begin(), block.end());
+	}
+	return samples;
+}
+
+TEST_CASE("Resampler paths and quality levels", "[apu][resampler]")
+{
+	SimdPath original = get_kernel_path(Kernel::RESAMPLER);
+
+	for (BlipBuffer::Quality quality : {BlipBuffer::Quality::LOW, BlipBuffer::Quality::MEDIUM, BlipBuffer::Quality::HIGH})
+	{
+		INFO("quality " << static_cast<int>(quality));
+		REQUIRE(set_kernel_path(Kernel::RESAMPLER, SimdPath::SCALAR));
+		std::vector<float> reference = render_tone(quality);
+		REQUIRE(reference.size() == Catch::Approx(7987).margin(2));
+
+		float peak = 0.0f;
+		for (float sample : reference)
+			peak = std::max(peak, std::abs(sample));
+		REQUIRE(peak > 1000.0f);
+
+		// Multiply-add per tap in the same order: identical output
+		if (set_kernel_path(Kernel::RESAMPLER, SimdPath::AVX2))
+			REQUIRE(render_tone(quality) == reference);
+	}
+
+	set_kernel_path(Kernel::RESAMPLER, original);
+}
+
+TEST_CASE("Silent APU produces silence at the configured rate", "[apu][synthesis]")
+{
+	APU apu;
+	apu.set_sample_rate(44100);
+	apu.end_frame(static_cast<uint64_t>(APU::CLOCK_RATE / 5));
+	REQUIRE(apu.samples_available() == Catch::Approx(8820).margin(2));
+
+	std::vector<int16_t> samples(apu.samples_available());
+	apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+	for (int16_t sample : samples)
+		REQUIRE(sample == 0);
+}
+
+TEST_CASE("A mid-frame $4017 write ends the block it interrupts", "[apu][synthesis]")
+{
+	APU apu; // 48 kHz
+	apu.cpu_write(0, 0x4015, 0x01);
+	apu.cpu_write(0, 0x4000, 0xBF);
+	apu.cpu_write(0, 0x4002, 0x80);
+	apu.cpu_write(0, 0x4003, 0x01);
+
+	// The restart lands between two steps, so without its own block end the
+	// block would run from the last step to the next one, twice the usual length
+	uint64_t cycle = 0;
+	for (int frame = 0; frame < 20; frame++)
+	{
+		apu.cpu_write(cycle + 15952, 0x4017, 0x00);
+		cycle += 23389;
+		apu.end_frame(cycle);
+	}
+
+	// Nothing was read: a quarter second plus at most one block is waiting
+	int limit = 48000 / 4 + static_cast<int>(7461 * 48000 / APU::CLOCK_RATE) + 2;
+	REQUIRE(apu.samples_available() <= limit);
+	REQUIRE(apu.get_stats().samples_generated == Catch::Approx(cycle * 48000 / APU::CLOCK_RATE).margin(2));
+
+	std::vector<int16_t> samples(apu.samples_available());
+	REQUIRE(apu.read_samples(samples.data(), static_cast<int>(samples.size())) == static_cast<int>(samples.size()));
+}
+
+TEST_CASE("DMC fetches its sample through the bus and raises its IRQ", "[apu][dmc]")
+{
+	Bus bus;
+	for (int i = 0; i < 17; i++)
+		bus.memory[0xC040 + i] = 0xFF;
+	bus.reset();
+
+	bus.write(0x4010, 0x8F);	 // IRQ on, fastest rate (54 cycles per bit)
+	bus.write(0x4012, 0x01);	 // $C040
+	bus.write(0x4013, 0x01);	 // 17 bytes
+	bus.write(0x4015, 0x10);
+	REQUIRE((bus.read(0x4015, true) & 0x10) == 0x10);
+
+	// The first byte is fetched at once, one more every 8 * 54 cycles
+	run_cpu_cycles(bus, 15 * 432);
+	REQUIRE((bus.read(0x4015, true) & 0x90) == 0x10);
+	run_cpu_cycles(bus, 2 * 432);
+	REQUIRE((bus.read(0x4015, true) & 0x90) == 0x80);
+	REQUIRE(bus.apu.get_stats().dmc_fetches == 17);
+	REQUIRE(bus.apu.irq());
+}
+
+TEST_CASE("Audio-off mode keeps the state the CPU can observe", "[apu][audio_off]")
+{
+	// Same register script on both; status, IRQs and DMC stalls must agree
+	APU full;
+	APU quiet;
+	quiet.set_audio_enabled(false);
+
+	struct Write
+	{
+		uint64_t cycle;
+		uint16_t address;
+		uint8_t data;
+	};
+	std::vector<Write> script = {
+		{0, 0x4015, 0x1F}, {0, 0x4000, 0x10}, {0, 0x4003, 0x18}, {10, 0x4008, 0x05},
+		{10, 0x400B, 0x20}, {20, 0x400C, 0x10}, {20, 0x400F, 0x48}, {30, 0x4010, 0x8C},
+		{30, 0x4013, 0x03}, {40, 0x4015, 0x1F}, {35000, 0x4017, 0x00}, {61000, 0x4004, 0x20},
+		{61000, 0x4007, 0x08}, {70001, 0x4015, 0x1F}, {90000, 0x4017, 0x80}, {120000, 0x4017, 0x00}};
+
+	uint64_t stalls[2] = {0, 0};
+	int mismatches = 0;
+	size_t next = 0;
+	for (uint64_t cycle = 0; cycle < 160000; cycle += 97)
+	{
+		for (; next < script.size() && script[next].cycle <= cycle; next++)
+		{
+			full.cpu_write(cycle, script[next].address, script[next].data);
+			quiet.cpu_write(cycle, script[next].address, script[next].data);
+		}
+		stalls[0] += full.take_stall_cycles();
+		stalls[1] += quiet.take_stall_cycles();
+		mismatches += full.cpu_read(cycle, 0x4015, true) != quiet.cpu_read(cycle, 0x4015, true) ||
+					  full.irq() != quiet.irq() ||
+					  full.next_event_cycle() != quiet.next_event_cycle() ||
+					  stalls[0] != stalls[1];
+	}
+	REQUIRE(mismatches == 0);
+	REQUIRE(stalls[0] > 0);
+	REQUIRE(full.get_stats().dmc_fetches == quiet.get_stats().dmc_fetches);
+
+	quiet.end_frame(160000);
+	REQUIRE(quiet.samples_available() == 0);
+
+	// Turned back on, it picks up from the current cycle
+	quiet.set_audio_enabled(true);
+	quiet.end_frame(160000 + static_cast<uint64_t>(APU::CLOCK_RATE / 10));
+	REQUIRE(quiet.samples_available() == Catch::Approx(4800).margin(2));
+}
+
+// Plays all channels, a DMC sample from $C040 and a mid-run $4017 write through
+// the bus, and returns the samples of each frame as the APU produced them
+static std::vector<int16_t> run_scripted_audio(Bus &bus, int frames, std::vector<uint8_t> &status)
+{
+	std::vector<int16_t> samples;
+	std::vector<int16_t> block(4096);
+	for (int frame = 0; frame < frames; frame++)
+	{
+		if (frame == 1)
+		{
+			bus.write(0x4015, 0x1F);
+			bus.write(0x4000, 0x9F);
+			bus.write(0x4002, 0x80);
+			bus.write(0x4003, 0x01);
+			bus.write(0x4008, 0x81);
+			bus.write(0x400A, 0x30);
+			bus.write(0x400B, 0x00);
+			bus.write(0x400C, 0x14);
+			bus.write(0x400E, 0x05);
+			bus.write(0x400F, 0x18);
+			bus.write(0x4010, 0x8E);
+			bus.write(0x4012, 0x01);
+			bus.write(0x4013, 0x04);
+			bus.write(0x4015, 0x1F);
+		}
+		if (frame == 4)
+			bus.write(0x4017, 0x80);
+		if (frame == 6)
+			bus.write(0x4002, 0x20);
+
+		run_cpu_cycles(bus, 29781);
+		status.push_back(bus.read(0x4015, true));
+		bus.apu.end_frame(bus.get_cpu_cycles());
+		int count;
+		while ((count = bus.apu.read_samples(block.data(), static_cast<int>(block.size()))) > 0)
+			samples.insert(samples.end(), block.begin(), block.begin() + count);
+	}
+	return samples;
+}
+
+static void setup_audio_bus(Bus &bus)
+{
+	std::fill(bus.memory.begin() + 0x8000, bus.memory.begin() + 0xC000, 0xEA);
+	for (int i = 0; i < 65; i++)
+		bus.memory[0xC040 + i] = static_cast<uint8_t>(i * 37);
+	bus.memory[0xFFFC] = 0x00;
+	bus.memory[0xFFFD] = 0x80;
+	bus.reset();
+}
+
+TEST_CASE("Deferred audio matches inline synthesis", "[apu][deferred]")
+{
+	const int frames = 10;
+	Bus inline_bus;
+	setup_audio_bus(inline_bus);
+	std::vector<uint8_t> inline_status;
+	std::vector<int16_t> expected = run_scripted_audio(inline_bus, frames, inline_status);
+
+	Bus deferred_bus;
+	setup_audio_bus(deferred_bus);
+	std::vector<int16_t> delivered;
+	uint64_t next_frame = 0;
+	bool in_order = true;
+	{
+		AudioRenderer renderer(2);
+		renderer.set_callback([&](uint64_t frame, APU &apu) {
+			in_order &= frame == next_frame++;
+			std::vector<int16_t> block(apu.samples_available());
+			apu.read_samples(block.data(), static_cast<int>(block.size()));
+			delivered.insert(delivered.end(), block.begin(), block.end());
+		});
+		deferred_bus.apu.set_deferred_renderer(&renderer);
+
+		std::vector<uint8_t> deferred_status;
+		std::vector<int16_t> left = run_scripted_audio(deferred_bus, frames, deferred_status);
+		REQUIRE(left.empty()); // Everything comes from the worker
+		REQUIRE(deferred_status == inline_status);
+		REQUIRE(deferred_bus.get_cpu_cycles() == inline_bus.get_cpu_cycles()); // Same DMC stalls
+
+		deferred_bus.apu.set_deferred_renderer(nullptr);
+		renderer.flush();
+	}
+
+	REQUIRE(in_order);
+	REQUIRE(deferred_bus.apu.get_audio_enabled());
+	REQUIRE(delivered == expected);
+	REQUIRE(inline_bus.apu.get_stats().dmc_fetches > 60);
+}
+
+/* Expansion audio */
+// Zero crossings over 0.2 s, after 0.1 s of settling, with only the chip
+// playing. With hysteresis, so the ringing of a small step near zero (the
+// sawtooth's staircase) does not count.
+static int expansion_crossings(ExpansionAudio &chip, const std::vector<std::pair<uint16_t, uint8_t>> &writes, int16_t &peak)
+{
+	APU apu;
+	apu.set_expansion(&chip);
+	for (auto [address, data] : writes)
+		apu.write_expansion(0, address, data);
+
+	const uint64_t tenth = static_cast<uint64_t>(APU::CLOCK_RATE / 10);
+	apu.end_frame(tenth);
+	std::vector<int16_t> samples(apu.samples_available());
+	apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+
+	apu.end_frame(tenth * 3);
+	samples.resize(apu.samples_available());
+	apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+	REQUIRE(samples.size() == Catch::Approx(9600).margin(2));
+
+	int crossings = 0;
+	bool high = samples[0] >= 0;
+	peak = 0;
+	for (int16_t sample : samples)
+	{
+		if (high ? sample < -200 : sample > 200)
+		{
+			high = !high;
+			crossings++;
+		}
+		peak = std::max<int16_t>(peak, sample);
+	}
+	return crossings;
+}
+
+TEST_CASE("Expansion chips produce their programmed frequencies", "[apu][expansion]")
+{
+	int16_t peak = 0;
+
+	SECTION("VRC6 pulse")
+	{
+		// 1789773 / (16 * 254) = 440.4 Hz
+		VRC6Audio chip;
+		REQUIRE(expansion_crossings(chip, {{0x9000, 0x7F}, {0x9001, 253}, {0x9002, 0x80}}, peak) == Catch::Approx(2 * 88.1).margin(4));
+	}
+	SECTION("VRC6 sawtooth, VRC6b address lines")
+	{
+		// 1789773 / (14 * 291) = 439.3 Hz
+		VRC6Audio chip(true);
+		REQUIRE(expansion_crossings(chip, {{0xB000, 42}, {0xB002, 290 & 0xFF}, {0xB001, 0x81}}, peak) == Catch::Approx(2 * 87.9).margin(4));
+	}
+	SECTION("Sunsoft 5B tone")
+	{
+		// 1789773 / (32 * 127) = 440.4 Hz
+		Sunsoft5BAudio chip;
+		REQUIRE(expansion_crossings(chip, {{0xC000, 0}, {0xE000, 127}, {0xC000, 7}, {0xE000, 0x3E}, {0xC000, 8}, {0xE000, 15}}, peak) == Catch::Approx(2 * 88.1).margin(4));
+	}
+	SECTION("Namco 163 wavetable channel")
+	{
+		// One channel, updated every 15 cycles: 1789773 * 3867 / (15 * 65536 * 16) = 440.0 Hz
+		Namco163Audio chip;
+		std::vector<std::pair<uint16_t, uint8_t>> writes = {{0xF800, 0x80}};
+		for (int i = 0; i < 8; i++)
+			writes.push_back({0x4800, i < 4 ? 0xFF : 0x00}); // 16 samples, half high
+		writes.push_back({0xF800, 0x80 | 0x78});
+		for (uint8_t data : {0x1B, 0x00, 0x0F, 0x00, 0xF0, 0x00, 0x00, 0x0F})
+			writes.push_back({0x4800, data});
+		REQUIRE(expansion_crossings(chip, writes, peak) == Catch::Approx(2 * 88.0).margin(4));
+		REQUIRE(chip.read(0x4800) == 0xFF); // Auto-increment wrapped to $00
+	}
+	SECTION("FDS wavetable")
+	{
+		// 1789773 * 1031 / (65536 * 64) = 440.0 Hz
+		FDSAudio chip;
+		std::vector<std::pair<uint16_t, uint8_t>> writes = {{0x4089, 0x80}};
+		for (int i = 0; i < 64; i++)
+			writes.push_back({static_cast<uint16_t>(0x4040 + i), i < 32 ? 63 : 0});
+		writes.insert(writes.end(), {{0x4089, 0x00}, {0x4080, 0x80 | 32}, {0x4087, 0x80}, {0x4082, 1031 & 0xFF}, {0x4083, 1031 >> 8}});
+		REQUIRE(expansion_crossings(chip, writes, peak) == Catch::Approx(2 * 88.0).margin(4));
+		REQUIRE(chip.read(0x4090) == (0x40 | 32));
+	}
+
+	REQUIRE(peak > 1000);
+}
+
+TEST_CASE("Releasing the VRC6 halt keeps the channel levels", "[apu][expansion]")
+{
+	// A constant-volume pulse is a steady level; the DC blocker settles it to 0
+	VRC6Audio chip;
+	APU apu;
+	apu.set_expansion(&chip);
+	for (auto [address, data] : {std::pair<uint16_t, uint8_t>{0x9000, 0x8F}, {0x9001, 253}, {0x9002, 0x80}})
+		apu.write_expansion(0, address, data);
+	const uint64_t tenth = static_cast<uint64_t>(APU::CLOCK_RATE / 10);
+	apu.end_frame(tenth);
+	std::vector<int16_t> samples(apu.samples_available());
+	apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+
+	// Halting freezes the dividers but not the level, so nothing may step
+	for (int i = 0; i < 50; i++)
+	{
+		apu.write_expansion(tenth + i * 2000, 0x9003, 0x01);
+		apu.write_expansion(tenth + i * 2000 + 1000, 0x9003, 0x00);
+	}
+	apu.end_frame(tenth * 2);
+	samples.resize(apu.samples_available());
+	apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+	for (int16_t sample : samples)
+		REQUIRE(std::abs(sample) < 50);
+}
+
+TEST_CASE("Deferred audio replays expansion chip accesses", "[apu][deferred][expansion]")
+{
+	// VRC6 pulse and sawtooth plus 2A03 pulse, with mid-frame changes
+	auto script = [](APU &apu, std::vector<int16_t> &out)
+	{
+		std::vector<int16_t> block(4096);
+		for (uint64_t frame = 0; frame < 8; frame++)
+		{
+			uint64_t start = frame * 29781;
+			if (frame == 1)
+			{
+				apu.cpu_write(start, 0x4015, 0x01);
+				apu.cpu_write(start, 0x4000, 0x9F);
+				apu.cpu_write(start, 0x4002, 0x80);
+				apu.cpu_write(start, 0x4003, 0x01);
+				for (auto [address, data] : {std::pair<uint16_t, uint8_t>{0x9000, 0x7F}, {0x9001, 200}, {0x9002, 0x80}, {0xB000, 20}, {0xB001, 0x80}, {0xB002, 0x81}})
+					apu.write_expansion(start + 100, address, data);
+			}
+			if (frame == 4)
+				apu.write_expansion(start + 5000, 0x9001, 120);
+			if (frame == 6)
+				apu.write_expansion(start + 10, 0x9002, 0x00);
+			apu.end_frame(start + 29781);
+			int count;
+			while ((count = apu.read_samples(block.data(), static_cast<int>(block.size()))) > 0)
+				out.insert(out.end(), block.begin(), block.begin() + count);
+		}
+	};
+
+	std::vector<int16_t> expected;
+	VRC6Audio inline_chip;
+	APU inline_apu;
+	inline_apu.set_expansion(&inline_chip);
+	script(inline_apu, expected);
+
+	std::vector<int16_t> samples;
+	VRC6Audio chip;
+	APU apu;
+	apu.set_expansion(&chip);
+	{
+		AudioRenderer renderer(2);
+		std::vector<int16_t> delivered;
+		renderer.set_callback([&](uint64_t, APU &shadow)
+		{
+			std::vector<int16_t> block(shadow.samples_available());
+			shadow.read_samples(block.data(), static_cast<int>(block.size()));
+			delivered.insert(delivered.end(), block.begin(), block.end());
+		});
+		apu.set_deferred_renderer(&renderer);
+		script(apu, samples); // The first frame is still synthesized here
+		apu.set_deferred_renderer(nullptr);
+		renderer.flush();
+		samples.insert(samples.end(), delivered.begin(), delivered.end());
+	}
+
+	REQUIRE(samples.size() == expected.size());
+	REQUIRE(samples == expected);
+}
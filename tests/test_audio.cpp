@@ -0,0 +1,172 @@
+#include "catch_amalgamated.hpp"
+#include "core/audio_ring.h"
+#include "core/audio_output.h"
+#include "core/apu.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+TEST_CASE("Audio ring hands samples across threads in order", "[audio][ring]")
+{
+	AudioRing ring(256);
+	const int total = 200000;
+	bool in_order = true;
+
+	std::thread consumer([&] {
+		std::vector<int16_t> block(97);
+		int expected = 0;
+		while (expected < total)
+		{
+			int count = ring.read(block.data(), static_cast<int>(block.size()));
+			for (int i = 0; i < count; i++)
+				in_order &= block[i] == static_cast<int16_t>(expected++);
+		}
+	});
+
+	// Retry what did not fit, so nothing is dropped
+	std::vector<int16_t> block(61);
+	for (int sent = 0; sent < total;)
+	{
+		int count = std::min(static_cast<int>(block.size()), total - sent);
+		for (int i = 0; i < count; i++)
+			block[i] = static_cast<int16_t>(sent + i);
+		sent += ring.write(block.data(), count);
+	}
+	consumer.join();
+	REQUIRE(in_order);
+
+	AudioRing::Stats stats = ring.get_stats();
+	REQUIRE(stats.samples_written == total);
+	REQUIRE(stats.samples_read == total);
+}
+
+TEST_CASE("Audio ring counts overruns and underruns", "[audio][ring]")
+{
+	AudioRing ring(100);
+	REQUIRE(ring.get_capacity() == 128);
+
+	std::vector<int16_t> samples(200, 7);
+	REQUIRE(ring.write(samples.data(), 100) == 100);
+	REQUIRE(ring.write(samples.data(), 50) == 28);
+	REQUIRE(ring.fill() == 128);
+
+	REQUIRE(ring.read(samples.data(), 200) == 128);
+	REQUIRE(ring.fill() == 0);
+
+	AudioRing::Stats stats = ring.get_stats();
+	REQUIRE(stats.overruns == 1);
+	REQUIRE(stats.overrun_samples == 22);
+	REQUIRE(stats.underruns == 1);
+	REQUIRE(stats.underrun_samples == 72);
+}
+
+// 30 emulated seconds against a device whose clock runs 0.3% fast. Returns the
+// underruns; final_fill is the fill after the last frame was pushed.
+static uint64_t run_drifting_device(bool rate_control, int &final_fill)
+{
+	const int target = 2400;
+	const double device_per_frame = 48000 * 1.003 / 60.0988;
+	AudioRing ring(9600);
+	AudioRateControl control(target);
+
+	APU apu;
+	apu.cpu_write(0, 0x4015, 0x01);
+	apu.cpu_write(0, 0x4000, 0xBF);
+	apu.cpu_write(0, 0x4002, 0xFD);
+	apu.cpu_write(0, 0x4003, 0x00);
+
+	std::vector<int16_t> samples(4096);
+	uint64_t cycle = 0;
+	double owed = 0.0;
+	bool started = false;
+	for (int frame = 0; frame < 1800; frame++)
+	{
+		cycle += 29781;
+		apu.end_frame(cycle);
+		int count = apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+		ring.write(samples.data(), count);
+		if (rate_control)
+			apu.set_rate_ratio(control.update(ring.fill()));
+
+		final_fill = ring.fill();
+
+		// The device starts once the target latency is buffered
+		started |= ring.fill() >= target;
+		if (started)
+		{
+			owed += device_per_frame;
+			int want = static_cast<int>(owed);
+			owed -= want;
+			ring.read(samples.data(), want);
+		}
+	}
+	return ring.get_stats().underruns;
+}
+
+TEST_CASE("Rate control holds the ring near its target", "[audio][rate]")
+{
+	int fill = 0;
+	REQUIRE(run_drifting_device(false, fill) > 0);
+	REQUIRE(run_drifting_device(true, fill) == 0);
+	REQUIRE(fill > 2400 / 4);
+	REQUIRE(fill < 2400 * 2);
+}
+
+TEST_CASE("Audio output sets the APU to its sample rate", "[audio][rate]")
+{
+	AudioOutput output(32000, 50, 200);
+	APU apu;
+	apu.set_sample_rate(48000);
+	uint64_t cycle = 0;
+	for (int frame = 0; frame < 6; frame++)
+	{
+		cycle += 29781;
+		apu.end_frame(cycle);
+		output.push(apu);
+	}
+	REQUIRE(apu.get_sample_rate() == 32000);
+
+	// The first frame was made at 48 kHz and dropped; the other five come
+	// out at about 533 samples each, not 800
+	uint64_t written = output.get_stats().ring.samples_written;
+	REQUIRE(written > 2500);
+	REQUIRE(written < 2800);
+}
+
+TEST_CASE("Null sink drains the ring into a file", "[audio][sink]")
+{
+	std::string path = "/tmp/nes_test_" + std::to_string(getpid()) + "_audio.raw";
+	AudioOutput output(48000, 50, 200);
+	REQUIRE(output.open_null_sink(path, 5));
+
+	APU apu;
+	uint64_t cycle = 0;
+	for (int frame = 0; frame < 6; frame++)
+	{
+		cycle += 29781;
+		apu.end_frame(cycle);
+		output.push(apu);
+		std::this_thread::sleep_for(std::chrono::milliseconds(16));
+	}
+	output.close();
+
+	AudioOutput::Stats stats = output.get_stats();
+	REQUIRE(stats.ring.samples_written > 4000);
+	REQUIRE(stats.ring.samples_read > 0);
+	REQUIRE_FALSE(stats.write_error);
+
+	// Every period is written, padded with silence when the ring ran dry
+	FILE *file = std::fopen(path.c_str(), "rb");
+	REQUIRE(file != nullptr);
+	std::fseek(file, 0, SEEK_END);
+	long size = std::ftell(file);
+	std::fclose(file);
+	std::remove(path.c_str());
+	REQUIRE(size > 0);
+	REQUIRE(size % (240 * 2) == 0);
+	REQUIRE(static_cast<uint64_t>(size / 2) >= stats.ring.samples_read);
+}
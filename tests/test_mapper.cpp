@@ -0,0 +1,653 @@
+#include "catch_amalgamated.hpp"
+#include "core/bus.h"
+#include "core/cartridge.h"
+#include "core/mapper.h"
+#include "core/rom_database.h"
+#include "core/rom_hash.h"
+#include "core/save_ram.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// iNES image whose every 8 KiB PRG bank and 1 KiB CHR bank is filled with its own number
+static std::vector<uint8_t> make_image(uint8_t mapper, int prg_16k, int chr_8k, uint8_t flags6 = 0x00)
+{
+	std::vector<uint8_t> image = {'N', 'E', 'S', 0x1A, static_cast<uint8_t>(prg_16k), static_cast<uint8_t>(chr_8k),
+								  static_cast<uint8_t>((mapper << 4) | flags6), static_cast<uint8_t>(mapper & 0xF0),
+								  0, 0, 0, 0, 0, 0, 0, 0};
+	for (int bank = 0; bank < prg_16k * 2; bank++)
+		image.insert(image.end(), 0x2000, static_cast<uint8_t>(bank));
+	for (int bank = 0; bank < chr_8k * 8; bank++)
+		image.insert(image.end(), 0x0400, static_cast<uint8_t>(0x80 | bank));
+	return image;
+}
+
+static std::string temp_path(const char *suffix)
+{
+	return "/tmp/nes_test_" + std::to_string(getpid()) + "_" + suffix;
+}
+
+static std::shared_ptr<Cartridge> make_cartridge(uint8_t mapper, int prg_16k, int chr_8k, uint8_t flags6 = 0x00)
+{
+	auto cartridge = std::make_shared<Cartridge>();
+	REQUIRE(cartridge->load(make_image(mapper, prg_16k, chr_8k, flags6)));
+	return cartridge;
+}
+
+// The 8 KiB PRG bank visible in each CPU slot, and the 1 KiB CHR bank in each pattern slot
+static std::vector<int> prg_banks(Bus &bus)
+{
+	return {bus.read(0x8000), bus.read(0xA000), bus.read(0xC000), bus.read(0xE000)};
+}
+
+static std::vector<int> chr_banks(Bus &bus)
+{
+	std::vector<int> banks;
+	for (int slot = 0; slot < 8; slot++)
+		banks.push_back(bus.ppu.ppu_read(static_cast<uint16_t>(slot * 0x0400)) & 0x7F);
+	return banks;
+}
+
+/* Cartridge */
+TEST_CASE("iNES images load with their header fields", "[mapper][cartridge]")
+{
+	Cartridge cartridge;
+	REQUIRE(cartridge.load(make_image(4, 2, 1, 0x03)));
+	REQUIRE(cartridge.mapper_id == 4);
+	REQUIRE(cartridge.prg_rom.size() == 0x8000);
+	REQUIRE(cartridge.chr.size() == 0x2000);
+	REQUIRE_FALSE(cartridge.chr_ram);
+	REQUIRE(cartridge.mirroring == Mirror::VERTICAL);
+	REQUIRE(cartridge.battery);
+	REQUIRE(cartridge.prg_ram.size() == 0x2000);
+
+	REQUIRE(cartridge.load(make_image(2, 8, 0)));
+	REQUIRE(cartridge.chr_ram);
+	REQUIRE(cartridge.chr.size() == 0x2000);
+
+	std::vector<uint8_t> truncated = make_image(0, 2, 1);
+	truncated.resize(truncated.size() - 1);
+	REQUIRE_FALSE(cartridge.load(truncated));
+	std::vector<uint8_t> bad_magic = make_image(0, 1, 1);
+	bad_magic[3] = 0x00;
+	REQUIRE_FALSE(cartridge.load(bad_magic));
+
+	Bus bus;
+	REQUIRE_FALSE(bus.insert_cartridge(make_cartridge(5, 2, 1))); // MMC5 is not built in
+	REQUIRE(bus.get_mapper() == nullptr);
+}
+
+/* ROM database */
+TEST_CASE("CRC-32 and SHA-1 match their reference values", "[mapper][rom_database]")
+{
+	const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+	REQUIRE(crc32(check, sizeof(check)) == 0xCBF43926);
+	REQUIRE(crc32_scalar(check, sizeof(check)) == 0xCBF43926);
+
+	// Folded path against the tables, at every length and offset around its block sizes
+	std::vector<uint8_t> data(4096 + 64);
+	uint32_t seed = 1;
+	for (uint8_t &byte : data)
+		byte = static_cast<uint8_t>((seed = seed * 1103515245 + 12345) >> 16);
+	int mismatches = 0;
+	for (size_t size : {0, 1, 15, 16, 63, 64, 65, 127, 128, 200, 1000, 4096})
+		for (size_t offset = 0; offset < 4; offset++)
+			mismatches += crc32(data.data() + offset, size) != crc32_scalar(data.data() + offset, size);
+	REQUIRE(mismatches == 0);
+	REQUIRE(crc32(data.data() + 1000, 3000, crc32(data.data(), 1000)) == crc32(data.data(), 4000));
+	REQUIRE(crc32(nullptr, 0, 0xCBF43926) == 0xCBF43926); // CHR-RAM carts hash no CHR
+
+	auto sha1_hex = [](const std::vector<std::pair<const uint8_t *, size_t>> &parts)
+	{
+		Sha1 sha1;
+		for (auto [part, size] : parts)
+			sha1.update(part, size);
+		uint8_t digest[20];
+		sha1.finish(digest);
+		std::string hex;
+		for (uint8_t byte : digest)
+		{
+			const char *digits = "0123456789abcdef";
+			hex += digits[byte >> 4];
+			hex += digits[byte & 0x0F];
+		}
+		return hex;
+	};
+	const uint8_t abc[] = {'a', 'b', 'c'};
+	REQUIRE(sha1_hex({}) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+	REQUIRE(sha1_hex({{abc, 3}}) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+	REQUIRE(sha1_hex({{abc, 1}, {nullptr, 0}, {abc + 1, 2}}) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+	std::vector<uint8_t> million(1000000, 'a');
+	REQUIRE(sha1_hex({{million.data(), 1000}, {million.data(), 999000}}) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+}
+
+TEST_CASE("The ROM database corrects known headers", "[mapper][rom_database]")
+{
+	// A CNROM dump whose header claims NROM, no battery, horizontal mirroring
+	std::vector<uint8_t> image = make_image(0, 2, 2);
+	image[20] = 0x42; // Tell it apart from other images of the same shape
+	std::vector<uint8_t> other = make_image(0, 2, 2);
+
+	Cartridge reference;
+	REQUIRE(reference.load(image));
+	RomRecord record{};
+	record.crc32 = crc32(reference.chr.data(), reference.chr.size(), crc32(reference.prg_rom.data(), reference.prg_rom.size()));
+	Sha1 sha1;
+	sha1.update(reference.prg_rom.data(), reference.prg_rom.size());
+	sha1.update(reference.chr.data(), reference.chr.size());
+	sha1.finish(record.sha1);
+	record.mapper = 3;
+	record.flags = RomRecord::VERTICAL | RomRecord::BATTERY;
+	record.region = Region::PAL;
+
+	// Same CRC, different SHA-1: must not match
+	RomRecord collision = record;
+	collision.sha1[0] ^= 0xFF;
+	collision.mapper = 7;
+
+	std::string path = temp_path("roms.db");
+	REQUIRE(RomDatabase::write(path, {collision, record}));
+	RomDatabase database;
+	REQUIRE(database.open(path));
+	REQUIRE(database.size() == 2);
+
+	Cartridge cartridge;
+	REQUIRE(cartridge.load(image, &database));
+	REQUIRE(cartridge.header_corrected);
+	REQUIRE(cartridge.mapper_id == 3);
+	REQUIRE(cartridge.mirroring == Mirror::VERTICAL);
+	REQUIRE(cartridge.battery);
+	REQUIRE(cartridge.region == Region::PAL);
+
+	// Unknown dumps keep their header and cost no SHA-1
+	REQUIRE(cartridge.load(other, &database));
+	REQUIRE_FALSE(cartridge.header_corrected);
+	REQUIRE(cartridge.mapper_id == 0);
+	REQUIRE(database.get_stats().lookups == 2);
+	REQUIRE(database.get_stats().crc_hits == 1);
+
+	// CRC-only entries match on the CRC alone
+	collision = record;
+	std::memset(collision.sha1, 0, sizeof(collision.sha1));
+	database.set_records({collision});
+	REQUIRE(cartridge.load(image, &database));
+	REQUIRE(cartridge.header_corrected);
+
+	// Malformed files are rejected
+	std::ofstream(path, std::ios::binary | std::ios::trunc) << "NESROMDB garbage";
+	REQUIRE_FALSE(database.open(path));
+	std::remove(path.c_str());
+	REQUIRE_FALSE(database.open(path));
+}
+
+/* Save RAM */
+static std::vector<uint8_t> read_file(const std::string &path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return std::vector<uint8_t>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("Battery RAM is saved behind the game's back", "[mapper][save_ram]")
+{
+	std::string path = temp_path("game.sav");
+	std::remove(path.c_str());
+
+	{
+		Bus bus;
+		auto cartridge = make_cartridge(0, 1, 1, 0x02);
+		REQUIRE(bus.insert_cartridge(cartridge));
+		SaveRam save(4);
+		REQUIRE(save.open(cartridge, path)); // No file yet: a new save
+
+		// Nothing is written until the RAM changes
+		for (int frame = 0; frame < 8; frame++)
+			save.end_frame();
+		save.flush();
+		REQUIRE(save.get_stats().saves == 0);
+		REQUIRE(read_file(path).empty());
+
+		bus.write(0x6000, 0x12);
+		bus.write(0x7FFF, 0x34);
+		for (int frame = 0; frame < 3; frame++)
+			save.end_frame();
+		REQUIRE(save.get_stats().checks == 3); // Two interval checks and the flush above
+		save.end_frame();
+		save.flush();
+		REQUIRE(save.get_stats().saves == 1);
+		std::vector<uint8_t> file = read_file(path);
+		REQUIRE(file.size() == 0x2000);
+		REQUIRE(file[0x0000] == 0x12);
+		REQUIRE(file[0x1FFF] == 0x34);
+		REQUIRE(read_file(path + ".tmp").empty());
+
+		bus.write(0x6001, 0x56); // Saved by close()
+	}
+
+	Bus bus;
+	auto cartridge = make_cartridge(0, 1, 1, 0x02);
+	REQUIRE(bus.insert_cartridge(cartridge));
+	SaveRam save;
+	REQUIRE(save.open(cartridge, path));
+	REQUIRE(bus.read(0x6000) == 0x12);
+	REQUIRE(bus.read(0x6001) == 0x56);
+	REQUIRE(bus.read(0x7FFF) == 0x34);
+	save.close();
+	std::remove(path.c_str());
+
+	// Unwritable location: reported, the game keeps running
+	SaveRam broken(1);
+	REQUIRE(broken.open(cartridge, "/nonexistent_dir/game.sav"));
+	bus.write(0x6000, 0x99);
+	broken.flush();
+	REQUIRE(broken.get_stats().write_error);
+}
+
+/* Cheats */
+TEST_CASE("Game Genie codes decode to address, value and compare", "[mapper][cheat]")
+{
+	Cheat cheat;
+	REQUIRE(decode_game_genie("GOSSIP", cheat));
+	REQUIRE(cheat.address == 0xD1DD);
+	REQUIRE(cheat.value == 0x14);
+	REQUIRE(cheat.compare == -1);
+	REQUIRE(decode_game_genie("sxiopo", cheat));
+	REQUIRE(cheat.address == 0x91D9);
+	REQUIRE(cheat.value == 0xAD);
+	REQUIRE(decode_game_genie("ZEXPYGLA", cheat));
+	REQUIRE(cheat.address == 0x94A7);
+	REQUIRE(cheat.value == 0x02);
+	REQUIRE(cheat.compare == 0x03);
+
+	REQUIRE_FALSE(decode_game_genie("GOSSI", cheat));
+	REQUIRE_FALSE(decode_game_genie("GOSSIB", cheat)); // B is not a Game Genie letter
+	REQUIRE_FALSE(decode_game_genie(std::string("GOS\0IP", 6), cheat));
+}
+
+TEST_CASE("Cheats patch only their page and follow bank switches", "[mapper][cheat]")
+{
+	Bus bus;
+	REQUIRE(bus.insert_cartridge(make_cartridge(2, 4, 0))); // UxROM, 8 KiB banks 0-7
+
+	// Compare code: only while 8 KiB bank 2 is at $8000
+	bus.add_cheat({0x8000, 0x77, 2});
+	bus.add_cheat({0x8001, 0x55});
+	REQUIRE(bus.read(0x8000) == 0);
+	REQUIRE(bus.read(0x8001) == 0x55);
+	REQUIRE(bus.read(0x8002) == 0); // Same page, no cheat
+	bus.write(0x8000, 1);
+	REQUIRE(bus.read(0x8000) == 0x77);
+	REQUIRE(bus.read(0x8001) == 0x55);
+	REQUIRE(bus.read(0x8800) == 2);
+	bus.write(0x8000, 2);
+	REQUIRE(bus.read(0x8000) == 4);
+
+	// Game Genie codes land in ROM; a code for a fixed-bank byte
+	Cheat cheat;
+	REQUIRE(decode_game_genie("GOSSIP", cheat));
+	REQUIRE(bus.read(0xD1DD) == 6);
+	REQUIRE(bus.add_game_genie("GOSSIP"));
+	REQUIRE(bus.read(0xD1DD) == 0x14);
+	REQUIRE_FALSE(bus.add_game_genie("??????"));
+
+	// Cheats outlive the cartridge, and go away when cleared
+	bus.insert_cartridge(make_cartridge(2, 4, 0));
+	REQUIRE(bus.read(0x8001) == 0x55);
+	REQUIRE(bus.read(0xD1DD) == 0x14);
+	bus.clear_cheats();
+	REQUIRE(bus.read(0x8001) == 0);
+	REQUIRE(bus.read(0xD1DD) == 6);
+}
+
+/* Bus */
+TEST_CASE("A cartridge takes over $4020-$FFFF and mirrors RAM", "[mapper][bus]")
+{
+	Bus bus;
+	REQUIRE(bus.insert_cartridge(make_cartridge(0, 1, 1)));
+
+	// 16 KiB NROM appears twice
+	REQUIRE(prg_banks(bus) == std::vector<int>{0, 1, 0, 1});
+	bus.write(0x8000, 0x55); // ROM
+	REQUIRE(bus.read(0x8000) == 0x00);
+
+	bus.write(0x0012, 0x34);
+	REQUIRE(bus.read(0x0812) == 0x34);
+	REQUIRE(bus.read(0x1812) == 0x34);
+	bus.write(0x6123, 0x99);
+	REQUIRE(bus.read(0x6123) == 0x99);
+
+	// CHR ROM ignores PPUDATA writes
+	REQUIRE(bus.ppu.ppu_read(0x0000) == 0x80);
+	bus.ppu.ppu_write(0x0000, 0x12);
+	REQUIRE(bus.ppu.ppu_read(0x0000) == 0x80);
+
+	// Ejecting goes back to flat memory
+	bus.eject_cartridge();
+	bus.write(0x8000, 0x55);
+	REQUIRE(bus.read(0x8000) == 0x55);
+}
+
+TEST_CASE("CPU runs a program from cartridge ROM", "[mapper][bus]")
+{
+	std::vector<uint8_t> image = make_image(0, 1, 1);
+	// LDA #$42; STA $0200 at $C000, reset vector $C000
+	const size_t prg = 16;
+	std::vector<uint8_t> program = {0xA9, 0x42, 0x8D, 0x00, 0x02};
+	std::copy(program.begin(), program.end(), image.begin() + prg);
+	image[prg + 0x3FFC] = 0x00;
+	image[prg + 0x3FFD] = 0xC0;
+	auto cartridge = std::make_shared<Cartridge>();
+	REQUIRE(cartridge->load(image));
+
+	Bus bus;
+	REQUIRE(bus.insert_cartridge(cartridge));
+	bus.reset();
+	REQUIRE(bus.cpu.get_pc() == 0xC000);
+	for (int i = 0; i < 40; i++)
+		bus.clock();
+	REQUIRE(bus.read(0x0A00) == 0x42); // Through the RAM mirror
+}
+
+/* Mappers */
+static void mmc1_write(Bus &bus, uint16_t address, uint8_t value)
+{
+	for (int bit = 0; bit < 5; bit++)
+		bus.write(address, (value >> bit) & 0x01);
+}
+
+TEST_CASE("MMC1 switches banks through its serial port", "[mapper][mmc1]")
+{
+	Bus bus;
+	REQUIRE(bus.insert_cartridge(make_cartridge(1, 8, 4)));
+
+	// Power-on: last bank fixed at $C000
+	REQUIRE(prg_banks(bus) == std::vector<int>{0, 1, 14, 15});
+
+	mmc1_write(bus, 0xE000, 3);
+	REQUIRE(prg_banks(bus) == std::vector<int>{6, 7, 14, 15});
+
+	// 4 KiB CHR mode, vertical mirroring; then two CHR banks
+	mmc1_write(bus, 0x8000, 0x1E);
+	mmc1_write(bus, 0xA000, 5);
+	mmc1_write(bus, 0xC000, 2);
+	REQUIRE(chr_banks(bus) == std::vector<int>{20, 21, 22, 23, 8, 9, 10, 11});
+
+	// A reset write in the middle of a sequence discards it
+	bus.write(0xE000, 0x01);
+	bus.write(0xE000, 0x80);
+	mmc1_write(bus, 0xE000, 1);
+	REQUIRE(prg_banks(bus) == std::vector<int>{2, 3, 14, 15});
+
+	// 32 KiB mode ignores the low bit
+	mmc1_write(bus, 0x8000, 0x00);
+	mmc1_write(bus, 0xE000, 5);
+	REQUIRE(prg_banks(bus) == std::vector<int>{8, 9, 10, 11});
+}
+
+TEST_CASE("UxROM, CNROM and AxROM switch on any ROM write", "[mapper]")
+{
+	Bus uxrom;
+	REQUIRE(uxrom.insert_cartridge(make_cartridge(2, 8, 0)));
+	uxrom.write(0x8000, 5);
+	REQUIRE(prg_banks(uxrom) == std::vector<int>{10, 11, 14, 15});
+	// CHR RAM is writable
+	uxrom.ppu.ppu_write(0x0010, 0x77);
+	REQUIRE(uxrom.ppu.ppu_read(0x0010) == 0x77);
+
+	Bus cnrom;
+	REQUIRE(cnrom.insert_cartridge(make_cartridge(3, 2, 4)));
+	cnrom.write(0xFFFF, 2);
+	REQUIRE(chr_banks(cnrom) == std::vector<int>{16, 17, 18, 19, 20, 21, 22, 23});
+
+	Bus axrom;
+	REQUIRE(axrom.insert_cartridge(make_cartridge(7, 8, 0)));
+	REQUIRE(prg_banks(axrom) == std::vector<int>{0, 1, 2, 3});
+	axrom.write(0x8000, 0x12);
+	REQUIRE(prg_banks(axrom) == std::vector<int>{8, 9, 10, 11});
+
+	// One-screen from the upper table: both nametables read the same byte
+	axrom.ppu.ppu_write(0x2000, 0x3C);
+	REQUIRE(axrom.ppu.ppu_read(0x2400) == 0x3C);
+	REQUIRE(axrom.ppu.vram[0x0400] == 0x3C);
+}
+
+TEST_CASE("MMC3 banks and scanline IRQ", "[mapper][mmc3]")
+{
+	Bus bus;
+	REQUIRE(bus.insert_cartridge(make_cartridge(4, 8, 8)));
+	Mapper &mapper = *bus.get_mapper();
+
+	for (uint8_t r = 0; r < 8; r++)
+	{
+		bus.write(0x8000, r);
+		bus.write(0x8001, static_cast<uint8_t>(10 + r * 3));
+	}
+	// R6 = 28 and R7 = 31 wrap around the 16 PRG banks
+	REQUIRE(prg_banks(bus) == std::vector<int>{12, 15, 14, 15});
+	REQUIRE(chr_banks(bus) == std::vector<int>{10, 11, 12, 13, 16, 19, 22, 25});
+
+	// Both inversion bits
+	bus.write(0x8000, 0xC0);
+	REQUIRE(prg_banks(bus) == std::vector<int>{14, 15, 12, 15});
+	REQUIRE(chr_banks(bus) == std::vector<int>{16, 19, 22, 25, 10, 11, 12, 13});
+
+	// Counter reloads with the latch, counts down and fires on reaching zero
+	bus.write(0xC000, 3);
+	bus.write(0xC001, 0);
+	bus.write(0xE001, 0);
+	for (int line = 0; line < 3; line++)
+	{
+		mapper.scanline();
+		REQUIRE_FALSE(mapper.irq);
+	}
+	mapper.scanline();
+	REQUIRE(mapper.irq);
+	bus.write(0xE000, 0); // Acknowledge and disable
+	REQUIRE_FALSE(mapper.irq);
+}
+
+TEST_CASE("Four-screen boards get four separate nametables", "[mapper][mmc3]")
+{
+	Bus bus;
+	REQUIRE(bus.insert_cartridge(make_cartridge(4, 8, 8, 0x08)));
+	for (int table = 0; table < 4; table++)
+		bus.ppu.ppu_write(static_cast<uint16_t>(0x2000 + table * 0x0400), static_cast<uint8_t>(0x10 + table));
+	for (int table = 0; table < 4; table++)
+	{
+		REQUIRE(bus.ppu.ppu_read(static_cast<uint16_t>(0x2000 + table * 0x0400)) == 0x10 + table);
+		REQUIRE(bus.ppu.vram[table * 0x0400] == 0x10 + table);
+	}
+	// $3000-$3EFF still mirrors $2000-$2EFF
+	REQUIRE(bus.ppu.ppu_read(0x3C00) == 0x13);
+
+	// The mirroring register has nothing to switch
+	bus.write(0xA000, 0x01);
+	REQUIRE(bus.ppu.ppu_read(0x2C00) == 0x13);
+}
+
+// A mapper that is not built in, with reads that reach cpu_read()
+class TestMapper : public Mapper
+{
+public:
+	TestMapper(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::OTHER)
+	{
+		for (int page = 0x8000 >> MemoryPages::PAGE_BITS; page < MemoryPages::COUNT; page++)
+			pages.map_read(page, nullptr); // Reads have side effects
+	}
+	uint8_t cpu_read(uint16_t address) override { return address >= 0x8000 ? last : read_standard(address); }
+	void cpu_write(uint16_t address, uint8_t data) override { last = data ^ static_cast<uint8_t>(address); }
+
+	uint8_t last = 0x00;
+};
+
+TEST_CASE("Custom mappers plug in through the virtual interface", "[mapper]")
+{
+	Bus bus;
+	auto cartridge = make_cartridge(99, 1, 1);
+	bus.insert_cartridge(cartridge, std::make_unique<TestMapper>(*cartridge, bus.ppu));
+	bus.write(0x8001, 0x10);
+	REQUIRE(bus.read(0x9000) == 0x11);
+}
+
+TEST_CASE("Bank switches remap pages without copying", "[mapper][bus]")
+{
+	// ROM is read in place: a change to the cartridge's data shows up directly
+	Bus bus;
+	auto cartridge = make_cartridge(3, 2, 4); // CNROM, 32 KiB CHR
+	REQUIRE(bus.insert_cartridge(cartridge));
+	cartridge->prg_rom[0x0123] = 0x5A;
+	REQUIRE(bus.read(0x8123) == 0x5A);
+
+	bus.write(0x8000, 2);
+	cartridge->chr[2 * 0x2000 + 0x0010] = 0x3C;
+	REQUIRE(bus.ppu.ppu_read(0x0010) == 0x3C);
+	bus.ppu.ppu_write(0x0010, 0x00); // CHR ROM
+	REQUIRE(cartridge->chr[2 * 0x2000 + 0x0010] == 0x3C);
+	bus.write(0x8000, 0);
+	REQUIRE(chr_banks(bus) == std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7});
+
+	// PRG RAM is mapped read/write, CHR RAM lives in the PPU
+	Bus ram_bus;
+	auto ram_cartridge = make_cartridge(2, 4, 0); // UxROM with CHR RAM
+	REQUIRE(ram_bus.insert_cartridge(ram_cartridge));
+	ram_bus.write(0x6010, 0x77);
+	REQUIRE(ram_cartridge->prg_ram[0x0010] == 0x77);
+	REQUIRE(ram_bus.read(0x6010) == 0x77);
+	ram_bus.ppu.ppu_write(0x1234, 0x99);
+	REQUIRE(ram_bus.ppu.ppu_read(0x1234) == 0x99);
+	ram_bus.write(0x8000, 3);
+	REQUIRE(ram_bus.ppu.ppu_read(0x1234) == 0x99);
+
+	// Ejecting goes back to flat memory
+	ram_bus.eject_cartridge();
+	ram_bus.write(0x8000, 0x42);
+	REQUIRE(ram_bus.read(0x8000) == 0x42);
+	REQUIRE(ram_bus.memory[0x8000] == 0x42);
+}
+
+// Records where on the screen the bus clocks its scanline counter
+class CountingMapper : public Mapper
+{
+public:
+	CountingMapper(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::OTHER) {}
+	void cpu_write(uint16_t, uint8_t) override {}
+	void scanline() override { clocks++; }
+
+	int clocks = 0;
+};
+
+TEST_CASE("Scheduled scanline clocks land on the A12 rise", "[mapper][mmc3]")
+{
+	Bus bus;
+	auto cartridge = make_cartridge(99, 2, 1);
+	std::fill(cartridge->prg_rom.begin(), cartridge->prg_rom.end(), 0xEA); // NOP
+	cartridge->prg_rom[0x7FFC] = 0x00;
+	cartridge->prg_rom[0x7FFD] = 0x80;
+	auto owned = std::make_unique<CountingMapper>(*cartridge, bus.ppu);
+	CountingMapper &mapper = *owned;
+	bus.insert_cartridge(cartridge, std::move(owned));
+	bus.reset();
+
+	// PPUCTRL/PPUMASK changes at arbitrary dots, across odd and even frames
+	struct Step
+	{
+		int dots;
+		uint16_t address;
+		uint8_t data;
+		int rise; // Expected dot, -1 for none
+	};
+	const Step steps[] = {
+		{0, 0x2001, 0x18, -1},			 // Rendering on, both tables at $0000
+		{341 * 100 + 17, 0x2000, 0x08, 260}, // Sprites at $1000
+		{341 * 262 * 2 + 5, 0x2000, 0x10, 324}, // Background at $1000
+		{341 * 300 + 123, 0x2000, 0x20, 260},	// 8x16 sprites
+		{341 * 262 + 259, 0x2001, 0x00, -1},	// Rendering off
+		{341 * 50, 0x2001, 0x08, 260},
+		{341 * 262 * 2, 0x2000, 0x00, -1},
+	};
+
+	int expected = 0;
+	int mismatches = 0;
+	for (const Step &step : steps)
+	{
+		bus.write(step.address, step.data);
+		for (int i = 0; i < step.dots; i++)
+		{
+			bus.clock();
+			int16_t line = bus.ppu.get_scanline();
+			if ((line < 240 || line == 261) && bus.ppu.get_cycle() == step.rise)
+				expected++;
+			mismatches += mapper.clocks != expected;
+		}
+	}
+	REQUIRE(mismatches == 0);
+	REQUIRE(mapper.clocks == expected);
+	REQUIRE(expected > 800);
+}
+
+class SoundMapper : public Mapper
+{
+public:
+	SoundMapper(Cartridge &cartridge, PPU &ppu) : Mapper(cartridge, ppu, MapperKind::OTHER)
+	{
+		audio = std::make_unique<Namco163Audio>();
+	}
+	void cpu_write(uint16_t address, uint8_t) override { writes += address >= 0xE000; }
+
+	int writes = 0;
+};
+
+TEST_CASE("Expansion audio registers go through the APU", "[mapper][apu]")
+{
+	Bus bus;
+	auto cartridge = make_cartridge(19, 2, 1);
+	std::fill(cartridge->prg_rom.begin(), cartridge->prg_rom.end(), 0xEA); // NOP
+	cartridge->prg_rom[0x7FFC] = 0x00;
+	cartridge->prg_rom[0x7FFD] = 0x80;
+	auto owned = std::make_unique<SoundMapper>(*cartridge, bus.ppu);
+	SoundMapper &mapper = *owned;
+	bus.insert_cartridge(cartridge, std::move(owned));
+	bus.reset();
+
+	// Wave RAM through the data port, with auto-increment
+	bus.write(0xF800, 0x80);
+	bus.write(0x4800, 0x0F);
+	bus.write(0x4800, 0xF0);
+	bus.write(0xF800, 0x80);
+	REQUIRE(bus.read(0x4800, true) == 0x00); // Peeks do not reach the chip
+	REQUIRE(bus.read(0x4800) == 0x0F);
+	REQUIRE(bus.read(0x4800) == 0xF0);
+	REQUIRE(mapper.writes == 2); // The mapper still sees its own register
+
+	// A channel at full volume is heard, and silenced with the sound disable bit
+	bus.write(0xF800, 0x80 | 0x78);
+	for (uint8_t data : {0x00, 0x00, 0x40, 0x00, 0xFC, 0x00, 0x00, 0x0F})
+		bus.write(0x4800, data);
+	auto peak = [&]
+	{
+		uint64_t target = bus.get_cpu_cycles() + 29781;
+		while (bus.get_cpu_cycles() < target)
+			bus.clock();
+		bus.apu.end_frame(bus.get_cpu_cycles());
+		std::vector<int16_t> samples(bus.apu.samples_available());
+		bus.apu.read_samples(samples.data(), static_cast<int>(samples.size()));
+		int16_t high = 0;
+		for (int16_t sample : samples)
+			high = std::max<int16_t>(high, static_cast<int16_t>(std::abs(sample)));
+		return high;
+	};
+	peak();
+	REQUIRE(peak() > 1000);
+	bus.write(0xE000, 0x40);
+	peak();
+	REQUIRE(peak() < 100);
+
+	bus.eject_cartridge();
+	bus.apu.end_frame(bus.get_cpu_cycles());
+}
@@ -0,0 +1,905 @@
+#include "catch_amalgamated.hpp"
+#include "core/ppu.h"
+#include "core/bus.h"
+#include "core/tile_decode.h"
+#include "core/frame_convert.h"
+#include "core/frame_renderer.h"
+#include "core/frame_hash.h"
+
+#include <random>
+#include <vector>
+
+// Clocks the PPU until it reaches the given scanline and dot
+static void run_until(PPU &ppu, int16_t scanline, int16_t cycle)
+{
+	while (ppu.get_scanline() != scanline || ppu.get_cycle() != cycle)
+		ppu.clock();
+}
+
+static void set_address(PPU &ppu, uint16_t address)
+{
+	ppu.cpu_write(0x0006, address >> 8);
+	ppu.cpu_write(0x0006, address & 0xFF);
+}
+
+// Solid tile (pixel value 3) at pattern index 1, used by both planes
+static void make_solid_tile(PPU &ppu, uint16_t table)
+{
+	for (int row = 0; row < 8; row++)
+	{
+		ppu.pattern[table + 16 + row] = 0xFF;
+		ppu.pattern[table + 16 + row + 8] = 0xFF;
+	}
+}
+
+/* Registers */
+TEST_CASE("PPUDATA writes and buffered reads", "[ppu][registers]")
+{
+	PPU ppu;
+
+	set_address(ppu, 0x2000);
+	ppu.cpu_write(0x0007, 0x11);
+	ppu.cpu_write(0x0007, 0x22);
+
+	set_address(ppu, 0x2000);
+	ppu.cpu_read(0x0007); // Primes the read buffer
+	REQUIRE(ppu.cpu_read(0x0007) == 0x11);
+	REQUIRE(ppu.cpu_read(0x0007) == 0x22);
+}
+
+TEST_CASE("PPUDATA increments by 32 in vertical mode", "[ppu][registers]")
+{
+	PPU ppu;
+
+	ppu.cpu_write(0x0000, 0x04);
+	set_address(ppu, 0x2000);
+	ppu.cpu_write(0x0007, 0xAA);
+	ppu.cpu_write(0x0007, 0xBB);
+
+	REQUIRE(ppu.ppu_read(0x2000) == 0xAA);
+	REQUIRE(ppu.ppu_read(0x2020) == 0xBB);
+}
+
+TEST_CASE("Palette reads are not buffered and mirror the backdrop", "[ppu][registers]")
+{
+	PPU ppu;
+
+	set_address(ppu, 0x3F10);
+	ppu.cpu_write(0x0007, 0x2C);
+
+	set_address(ppu, 0x3F00);
+	REQUIRE(ppu.cpu_read(0x0007) == 0x2C);
+}
+
+TEST_CASE("Nametables follow the mirroring mode", "[ppu][mirroring]")
+{
+	PPU ppu;
+
+	ppu.set_mirroring(Mirror::VERTICAL);
+	ppu.ppu_write(0x2005, 0x42);
+	REQUIRE(ppu.ppu_read(0x2805) == 0x42);
+
+	ppu.set_mirroring(Mirror::HORIZONTAL);
+	ppu.ppu_write(0x2010, 0x24);
+	REQUIRE(ppu.ppu_read(0x2410) == 0x24);
+}
+
+/* Timing */
+TEST_CASE("Vertical blank starts at scanline 241 and raises NMI", "[ppu][timing]")
+{
+	PPU ppu;
+	ppu.cpu_write(0x0000, 0x80);
+
+	run_until(ppu, 241, 1);
+	REQUIRE((ppu.cpu_read(0x0002, true) & 0x80) == 0);
+	ppu.clock();
+	REQUIRE(ppu.nmi);
+	REQUIRE(ppu.frame_complete);
+
+	// Reading the status clears the flag
+	REQUIRE((ppu.cpu_read(0x0002) & 0x80) != 0);
+	REQUIRE((ppu.cpu_read(0x0002) & 0x80) == 0);
+}
+
+/* Rendering */
+TEST_CASE("Background tiles are rendered with their attribute palette", "[ppu][render]")
+{
+	PPU ppu;
+	make_solid_tile(ppu, 0x0000);
+
+	ppu.ppu_write(0x2000, 0x01);	  // Top-left tile
+	ppu.ppu_write(0x23C0, 0x02);	  // Top-left quadrant uses palette 2
+	ppu.ppu_write(0x3F00, 0x0F);	  // Backdrop
+	ppu.ppu_write(0x3F0B, 0x16);	  // Palette 2, color 3
+	ppu.cpu_write(0x0001, 0x0A);	  // Background on, no left clipping
+
+	run_until(ppu, 241, 1);
+
+	const auto &frame = ppu.get_frame();
+	REQUIRE(frame[0] == 0x16);
+	REQUIRE(frame[7 * PPU::SCREEN_WIDTH + 7] == 0x16);
+	REQUIRE(frame[8] == 0x0F);
+	REQUIRE(frame[PPU::SCREEN_WIDTH * 100] == 0x0F);
+}
+
+TEST_CASE("Sprite zero hit is raised when the PPU reaches the pixel", "[ppu][sprites]")
+{
+	PPU ppu;
+	make_solid_tile(ppu, 0x0000);
+
+	// Fill the first nametable with the solid tile
+	for (uint16_t i = 0; i < 960; i++)
+		ppu.ppu_write(0x2000 + i, 0x01);
+
+	ppu.oam[0] = 29; // Y, drawn from line 30
+	ppu.oam[1] = 0x01;
+	ppu.oam[2] = 0x00;
+	ppu.oam[3] = 100; // X
+	ppu.cpu_write(0x0001, 0x1E);
+
+	run_until(ppu, 30, 100);
+	REQUIRE((ppu.cpu_read(0x0002, true) & 0x40) == 0);
+	run_until(ppu, 30, 103);
+	REQUIRE((ppu.cpu_read(0x0002, true) & 0x40) != 0);
+
+	// Cleared on the pre-render line
+	run_until(ppu, 261, 2);
+	REQUIRE((ppu.cpu_read(0x0002, true) & 0x40) == 0);
+}
+
+TEST_CASE("Sprite overflow is set by a ninth sprite on a line", "[ppu][sprites]")
+{
+	PPU ppu;
+	ppu.oam.fill(0xFF);
+	for (int i = 0; i < 9; i++)
+		ppu.oam[i * 4] = 50;
+	ppu.cpu_write(0x0001, 0x10);
+
+	run_until(ppu, 50, 0);
+	REQUIRE((ppu.cpu_read(0x0002, true) & 0x20) == 0);
+	run_until(ppu, 50, 258);
+	REQUIRE((ppu.cpu_read(0x0002, true) & 0x20) != 0);
+}
+
+TEST_CASE("Eight sprites on a line do not overflow", "[ppu][sprites]")
+{
+	PPU ppu;
+	ppu.oam.fill(0xFF);
+	for (int i = 0; i < 8; i++)
+		ppu.oam[i * 4] = 50;
+	ppu.cpu_write(0x0001, 0x10);
+
+	run_until(ppu, 241, 0);
+	REQUIRE((ppu.cpu_read(0x0002, true) & 0x20) == 0);
+}
+
+// Straight OAM scan with the hardware's diagonal overflow search
+static bool reference_overflow(const std::array<uint8_t, 256> &oam, int line, int height)
+{
+	int found = 0;
+	int n = 0;
+	for (; n < 64 && found < 8; n++)
+	{
+		int diff = line - oam[n * 4];
+		if (diff >= 0 && diff < height)
+			found++;
+	}
+	if (found < 8)
+		return false;
+
+	for (int m = 0; n < 64; n++, m = (m + 1) & 0x03)
+	{
+		int diff = line - oam[n * 4 + m];
+		if (diff >= 0 && diff < height)
+			return true;
+	}
+	return false;
+}
+
+TEST_CASE("Bucketed sprite evaluation overflows on the same line as an OAM scan", "[ppu][sprites]")
+{
+	std::mt19937 rng(21);
+	for (int trial = 0; trial < 40; trial++)
+	{
+		// Crowd the sprites into a narrow band so lines often hold 8 or more
+		std::array<uint8_t, 256> page;
+		for (auto &byte : page)
+			byte = static_cast<uint8_t>(rng());
+		for (int n = 0; n < 64; n++)
+			page[n * 4] = static_cast<uint8_t>(60 + rng() % 40);
+		bool tall = trial & 1;
+
+		int expected = -1;
+		for (int line = 0; line < PPU::SCREEN_HEIGHT && expected < 0; line++)
+			if (reference_overflow(page, line, tall ? 16 : 8))
+				expected = line;
+
+		PPU ppu;
+		ppu.oam_dma(page.data());
+		ppu.cpu_write(0x0000, tall ? 0x20 : 0x00);
+		ppu.cpu_write(0x0001, 0x10);
+
+		int found = -1;
+		for (int line = 0; line < PPU::SCREEN_HEIGHT && found < 0; line++)
+		{
+			run_until(ppu, line, 258);
+			if (ppu.cpu_read(0x0002, true) & 0x20)
+				found = line;
+		}
+		INFO("trial " << trial);
+		REQUIRE(found == expected);
+	}
+}
+
+TEST_CASE("OAM writes through $2004 move sprites on the next frame", "[ppu][sprites]")
+{
+	PPU ppu;
+	make_solid_tile(ppu, 0x0000);
+	ppu.oam.fill(0xFF);
+	ppu.ppu_write(0x3F00, 0x0F);
+	ppu.ppu_write(0x3F13, 0x16);
+	ppu.cpu_write(0x0001, 0x14);
+
+	ppu.cpu_write(0x0003, 0x00);
+	for (uint8_t byte : {19, 1, 0, 40})
+		ppu.cpu_write(0x0004, byte);
+	run_until(ppu, 241, 1);
+	REQUIRE(ppu.get_frame()[20 * PPU::SCREEN_WIDTH + 40] == 0x16);
+
+	ppu.cpu_write(0x0003, 0x00);
+	ppu.cpu_write(0x0004, 99); // Y only
+	run_until(ppu, 241, 2);
+	run_until(ppu, 241, 1);
+	REQUIRE(ppu.get_frame()[20 * PPU::SCREEN_WIDTH + 40] == 0x0F);
+	REQUIRE(ppu.get_frame()[100 * PPU::SCREEN_WIDTH + 40] == 0x16);
+}
+
+/* Frame skip */
+// Dot at which sprite 0 hit becomes visible on the given line, -1 if never
+static int sprite_zero_hit_dot(PPU &ppu, int16_t line)
+{
+	run_until(ppu, line, 0);
+	while (ppu.get_scanline() == line)
+	{
+		if (ppu.cpu_read(0x0002, true) & 0x40)
+			return ppu.get_cycle();
+		ppu.clock();
+	}
+	return -1;
+}
+
+TEST_CASE("Skipped frames find sprite 0 hit on the same dot", "[ppu][frameskip]")
+{
+	std::mt19937 rng(5);
+	for (int trial = 0; trial < 20; trial++)
+	{
+		uint8_t sprite_x = static_cast<uint8_t>(rng());
+		uint8_t scroll_x = static_cast<uint8_t>(rng());
+		uint8_t flip = static_cast<uint8_t>(rng() & 0x40);
+
+		int dots[2];
+		for (int skip = 0; skip < 2; skip++)
+		{
+			PPU ppu;
+			std::mt19937 scene(trial);
+			for (auto &byte : ppu.pattern)
+				byte = static_cast<uint8_t>(scene() & scene()); // Sparse pixels
+			ppu.oam[0] = 39;
+			ppu.oam[1] = static_cast<uint8_t>(scene());
+			ppu.oam[2] = flip;
+			ppu.oam[3] = sprite_x;
+			for (uint16_t i = 0; i < 0x0800; i++)
+				ppu.ppu_write(0x2000 + i, static_cast<uint8_t>(scene()));
+			ppu.cpu_write(0x0005, scroll_x);
+			ppu.cpu_write(0x0005, 0x00);
+			ppu.cpu_write(0x0001, 0x1E);
+
+			// Frame 0 is always composed, the comparison happens on frame 1
+			ppu.set_frame_skip(skip ? 1 : 0);
+			run_until(ppu, 241, 1);
+			ppu.clock();
+			dots[skip] = sprite_zero_hit_dot(ppu, 40);
+			run_until(ppu, 241, 2);
+			REQUIRE(ppu.is_frame_rendered() == (skip == 0));
+		}
+		INFO("trial " << trial);
+		REQUIRE(dots[0] == dots[1]);
+	}
+}
+
+TEST_CASE("Skipped frames leave the framebuffer untouched", "[ppu][frameskip]")
+{
+	PPU ppu;
+	ppu.ppu_write(0x3F00, 0x01);
+	ppu.cpu_write(0x0001, 0x08);
+	ppu.set_frame_skip(2);
+
+	run_until(ppu, 241, 1);
+	ppu.clock();
+	REQUIRE(ppu.get_frame()[0] == 0x01);
+
+	// Frames 1 and 2 are skipped, frame 3 is composed
+	ppu.ppu_write(0x3F00, 0x02);
+	for (int frame = 1; frame <= 3; frame++)
+	{
+		run_until(ppu, 241, 1);
+		ppu.clock();
+		REQUIRE(ppu.frame_complete);
+		REQUIRE(ppu.get_frame()[0] == (frame == 3 ? 0x02 : 0x01));
+	}
+}
+
+/* Deferred rendering */
+// One frame of mid-frame register traffic: split scroll, a $2006 jump, a
+// mapper CHR bank and mirroring switch, an emphasis change, a status read and
+// palette/OAM updates during vblank
+static void run_scripted_frame(PPU &ppu, int frame)
+{
+	run_until(ppu, 60, 300);
+	ppu.cpu_write(0x0005, static_cast<uint8_t>(frame * 7));
+	ppu.cpu_write(0x0005, 0x00);
+	run_until(ppu, 120, 280);
+	ppu.cpu_write(0x0006, 0x08);
+	ppu.cpu_write(0x0006, static_cast<uint8_t>(0x40 + frame));
+	run_until(ppu, 150, 200);
+	for (int page = 4; page < 8; page++)
+		ppu.map_chr_page(page, static_cast<uint32_t>((page + frame) % 8) * 0x0400);
+	ppu.set_mirroring(Mirror::HORIZONTAL);
+	run_until(ppu, 180, 100);
+	ppu.cpu_write(0x0001, 0x3E);
+	ppu.cpu_read(0x0002);
+	run_until(ppu, 241, 1);
+	ppu.clock();
+
+	std::array<uint8_t, 256> page;
+	for (int i = 0; i < 256; i++)
+		page[i] = static_cast<uint8_t>(i * 13 + frame);
+	ppu.oam_dma(page.data());
+	set_address(ppu, 0x3F01);
+	ppu.cpu_write(0x0007, static_cast<uint8_t>(0x10 + frame));
+	set_address(ppu, 0x0000);
+	ppu.cpu_write(0x0001, 0x1E);
+	for (int page = 4; page < 8; page++)
+		ppu.map_chr_page(page, page * 0x0400);
+	ppu.set_mirroring(Mirror::VERTICAL);
+}
+
+static void setup_scripted_scene(PPU &ppu)
+{
+	std::mt19937 scene(11);
+	for (auto &byte : ppu.pattern)
+		byte = static_cast<uint8_t>(scene());
+	for (uint16_t i = 0; i < 0x0800; i++)
+		ppu.ppu_write(0x2000 + i, static_cast<uint8_t>(scene()));
+	for (uint16_t i = 0; i < 32; i++)
+		ppu.ppu_write(0x3F00 + i, static_cast<uint8_t>(scene() & 0x3F));
+	for (auto &byte : ppu.oam)
+		byte = static_cast<uint8_t>(scene());
+	ppu.set_mirroring(Mirror::VERTICAL);
+	ppu.cpu_write(0x0000, 0x10);
+	ppu.cpu_write(0x0001, 0x1E);
+}
+
+TEST_CASE("Deferred frames match inline rendering", "[ppu][deferred]")
+{
+	const int frames = 4;
+	const size_t frame_size = PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT;
+
+	std::vector<uint8_t> expected;
+	std::vector<uint8_t> expected_emphasis;
+	{
+		PPU ppu;
+		setup_scripted_scene(ppu);
+		for (int frame = 0; frame < frames; frame++)
+		{
+			run_scripted_frame(ppu, frame);
+			expected.insert(expected.end(), ppu.get_frame().begin(), ppu.get_frame().end());
+			expected_emphasis.insert(expected_emphasis.end(), ppu.get_frame_emphasis().begin(), ppu.get_frame_emphasis().end());
+		}
+	}
+
+	for (int threads : {1, 3})
+	{
+		std::vector<uint8_t> frames_out(frames * frame_size);
+		std::vector<uint8_t> emphasis_out(frames * PPU::SCREEN_HEIGHT);
+		uint64_t delivered = 0;
+		bool in_order = true;
+		{
+			FrameRenderer renderer(threads, 2);
+			renderer.set_callback([&](uint64_t frame, const uint8_t *indices, const uint8_t *emphasis)
+			{
+				// Runs on a worker thread, so no assertions in here
+				in_order = in_order && frame == delivered;
+				std::copy(indices, indices + frame_size, frames_out.begin() + frame * frame_size);
+				std::copy(emphasis, emphasis + PPU::SCREEN_HEIGHT, emphasis_out.begin() + frame * PPU::SCREEN_HEIGHT);
+				delivered++;
+			});
+
+			PPU ppu;
+			setup_scripted_scene(ppu);
+			ppu.set_deferred_renderer(&renderer);
+			for (int frame = 0; frame < frames; frame++)
+			{
+				run_scripted_frame(ppu, frame);
+				REQUIRE_FALSE(ppu.is_frame_rendered());
+			}
+			renderer.flush();
+		}
+
+		INFO("threads " << threads);
+		REQUIRE(delivered == frames);
+		REQUIRE(in_order);
+		REQUIRE(frames_out == expected);
+		REQUIRE(emphasis_out == expected_emphasis);
+	}
+}
+
+TEST_CASE("Deferred frames are hashed and observed by the renderer", "[ppu][deferred]")
+{
+	Observation::Config config;
+	config.max_pool = false;
+
+	PPU hashed, observed;
+	for (PPU *ppu : {&hashed, &observed})
+		setup_scripted_scene(*ppu);
+	hashed.set_frame_hashing(true);
+	observed.set_observation(config);
+
+	std::vector<uint64_t> hashes;
+	std::vector<uint8_t> observation;
+	FrameRenderer renderer(2, 2);
+	renderer.set_frame_hashing(true);
+	renderer.set_observation(config);
+	renderer.set_callback([&](uint64_t, const uint8_t *, const uint8_t *)
+	{
+		hashes.push_back(renderer.get_frame_hash());
+		const Observation &out = renderer.get_observation();
+		observation.assign(out.data(), out.data() + out.get_width() * out.get_height());
+	});
+	PPU deferred;
+	setup_scripted_scene(deferred);
+	deferred.set_deferred_renderer(&renderer);
+
+	std::vector<uint64_t> expected;
+	for (int frame = 0; frame < 3; frame++)
+	{
+		for (PPU *ppu : {&hashed, &observed, &deferred})
+			run_scripted_frame(*ppu, frame);
+		expected.push_back(hashed.get_frame_hash());
+	}
+	renderer.flush();
+
+	REQUIRE(hashes == expected);
+	const Observation &inline_observation = observed.get_observation();
+	REQUIRE(std::equal(observation.begin(), observation.end(), inline_observation.data()));
+	REQUIRE(observation.size() == static_cast<size_t>(inline_observation.get_width() * inline_observation.get_height()));
+}
+
+TEST_CASE("Changing the deferred renderer mid-frame closes the open frame", "[ppu][deferred]")
+{
+	// One slot each: a frame left open would block the next begin_frame()
+	FrameRenderer first(1, 1), second(1, 1);
+	int first_frames = 0, second_frames = 0;
+	first.set_callback([&](uint64_t, const uint8_t *, const uint8_t *) { first_frames++; });
+	second.set_callback([&](uint64_t, const uint8_t *, const uint8_t *) { second_frames++; });
+
+	PPU ppu;
+	setup_scripted_scene(ppu);
+	ppu.set_deferred_renderer(&first);
+	run_scripted_frame(ppu, 0);
+	run_until(ppu, 100, 0);
+	ppu.set_deferred_renderer(nullptr);
+	run_until(ppu, 241, 2);
+	REQUIRE_FALSE(ppu.is_frame_rendered()); // Started deferred
+	run_scripted_frame(ppu, 1);
+	REQUIRE(ppu.is_frame_rendered());
+
+	run_until(ppu, 100, 0);
+	ppu.set_deferred_renderer(&second);
+	run_scripted_frame(ppu, 2);
+	run_until(ppu, 100, 0);
+	ppu.set_deferred_renderer(&first); // Second's open frame goes to second
+	for (int frame = 3; frame < 6; frame++)
+		run_scripted_frame(ppu, frame);
+	ppu.set_deferred_renderer(nullptr);
+	first.flush();
+	second.flush();
+
+	REQUIRE(first_frames == 2 + 3);
+	REQUIRE(second_frames == 2);
+}
+
+TEST_CASE("Resetting mid-frame closes the deferred frame", "[ppu][deferred]")
+{
+	PPU inline_ppu;
+	setup_scripted_scene(inline_ppu);
+
+	std::vector<uint8_t> last;
+	int delivered = 0;
+	FrameRenderer renderer(1, 1);
+	renderer.set_callback([&](uint64_t, const uint8_t *indices, const uint8_t *)
+	{
+		last.assign(indices, indices + PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT);
+		delivered++;
+	});
+	PPU deferred;
+	setup_scripted_scene(deferred);
+	deferred.set_deferred_renderer(&renderer);
+
+	for (PPU *ppu : {&inline_ppu, &deferred})
+	{
+		for (int reset = 0; reset < 3; reset++)
+		{
+			run_until(*ppu, 100, 0);
+			ppu->reset();
+			ppu->cpu_write(0x0000, 0x10);
+			ppu->cpu_write(0x0001, 0x1E);
+		}
+		for (int frame = 0; frame < 2; frame++)
+			run_scripted_frame(*ppu, frame);
+	}
+	renderer.flush();
+
+	REQUIRE(delivered == 3 + 2);
+	REQUIRE(std::equal(last.begin(), last.end(), inline_ppu.get_frame().begin()));
+}
+
+/* Observation */
+TEST_CASE("Observation matches a box-filtered downsample of the frame", "[ppu][observation]")
+{
+	Observation::Config config;
+	config.width = 84;
+	config.height = 84;
+	config.crop_top = 8;
+	config.crop_bottom = 12;
+	config.crop_left = 8;
+	config.max_pool = false;
+
+	PPU full, observed;
+	setup_scripted_scene(full);
+	setup_scripted_scene(observed);
+	observed.set_observation(config);
+	for (int frame = 0; frame < 2; frame++)
+	{
+		run_scripted_frame(full, frame);
+		run_scripted_frame(observed, frame);
+	}
+
+	const auto &frame = full.get_frame();
+	const auto &emphasis = full.get_frame_emphasis();
+	const int source_width = PPU::SCREEN_WIDTH - 8;
+	const int source_height = PPU::SCREEN_HEIGHT - 20;
+	const Observation &observation = observed.get_observation();
+	REQUIRE(observation.get_width() == 84);
+	REQUIRE(observation.get_height() == 84);
+
+	std::vector<uint8_t> expected(84 * 84);
+	for (int row = 0; row < 84; row++)
+	{
+		for (int col = 0; col < 84; col++)
+		{
+			uint32_t sum = 0, count = 0;
+			for (int y = 0; y < source_height; y++)
+			{
+				for (int x = 0; x < source_width; x++)
+				{
+					if (y * 84 / source_height != row || x * 84 / source_width != col)
+						continue;
+					int line = 8 + y;
+					sum += palette_gray_table(emphasis[line])[frame[line * PPU::SCREEN_WIDTH + 8 + x]];
+					count++;
+				}
+			}
+			expected[row * 84 + col] = static_cast<uint8_t>((sum + count / 2) / count);
+		}
+	}
+	REQUIRE(std::vector<uint8_t>(observation.data(), observation.data() + 84 * 84) == expected);
+}
+
+TEST_CASE("Observation max-pools the last two frames and leaves the framebuffer alone", "[ppu][observation]")
+{
+	PPU ppu;
+	ppu.cpu_write(0x0001, 0x08);
+	ppu.ppu_write(0x3F00, 0x30); // White backdrop
+	run_until(ppu, 241, 1);
+	ppu.clock();
+	REQUIRE(ppu.get_frame()[0] == 0x30);
+
+	Observation::Config config;
+	config.width = 128;
+	config.height = 120;
+	ppu.set_observation(config);
+	uint8_t white = palette_gray_table(0)[0x30];
+	uint8_t black = palette_gray_table(0)[0x0F];
+
+	ppu.ppu_write(0x3F00, 0x0F);
+	run_until(ppu, 241, 1);
+	ppu.clock();
+	REQUIRE(ppu.get_observation().data()[0] == black); // Nothing pooled yet
+
+	ppu.ppu_write(0x3F00, 0x30);
+	run_until(ppu, 241, 1);
+	ppu.clock();
+	ppu.ppu_write(0x3F00, 0x0F);
+	run_until(ppu, 241, 1);
+	ppu.clock();
+	REQUIRE(ppu.get_observation().data()[128 * 120 - 1] == white);
+
+	run_until(ppu, 241, 1);
+	ppu.clock();
+	REQUIRE(ppu.get_observation().data()[0] == black);
+	REQUIRE(ppu.get_frame()[0] == 0x30);
+}
+
+/* Background line cache */
+TEST_CASE("Unchanged background lines are reused across frames", "[ppu][background_cache]")
+{
+	auto setup = [](PPU &ppu)
+	{
+		std::mt19937 scene(3);
+		for (auto &byte : ppu.pattern)
+			byte = static_cast<uint8_t>(scene());
+		for (uint16_t i = 0; i < 0x0800; i++)
+			ppu.ppu_write(0x2000 + i, static_cast<uint8_t>(scene()));
+		for (uint16_t i = 0; i < 32; i++)
+			ppu.ppu_write(0x3F00 + i, static_cast<uint8_t>(i));
+		ppu.set_mirroring(Mirror::VERTICAL);
+		ppu.cpu_write(0x0001, 0x0A);
+	};
+	auto next_frame = [](PPU &ppu)
+	{
+		ppu.reset_stats();
+		run_until(ppu, 241, 1);
+		ppu.clock();
+		return ppu.get_stats();
+	};
+
+	PPU ppu;
+	setup(ppu);
+	REQUIRE(next_frame(ppu).background_line_misses == 240);
+	auto stats = next_frame(ppu);
+	REQUIRE(stats.background_line_hits == 240);
+	REQUIRE(stats.background_line_misses == 0);
+
+	// Rewriting the same value changes nothing
+	ppu.ppu_write(0x20A3, ppu.ppu_read(0x20A3));
+	REQUIRE(next_frame(ppu).background_line_misses == 0);
+
+	// One tile in row 5 dirties that row's 8 lines
+	ppu.ppu_write(0x20A3, ppu.ppu_read(0x20A3) ^ 0x01);
+	stats = next_frame(ppu);
+	REQUIRE(stats.background_line_misses == 8);
+	REQUIRE(stats.background_line_hits == 232);
+
+	// The second nametable is off screen without scrolling
+	ppu.ppu_write(0x2400, ppu.ppu_read(0x2400) ^ 0x01);
+	REQUIRE(next_frame(ppu).background_line_misses == 0);
+
+	// An attribute byte covers 4 tile rows
+	ppu.ppu_write(0x23C9, ppu.ppu_read(0x23C9) ^ 0x04);
+	REQUIRE(next_frame(ppu).background_line_misses == 32);
+
+	// Reused lines match a frame rendered from scratch
+	PPU fresh;
+	setup(fresh);
+	fresh.ppu_write(0x20A3, ppu.ppu_read(0x20A3));
+	fresh.ppu_write(0x2400, ppu.ppu_read(0x2400));
+	fresh.ppu_write(0x23C9, ppu.ppu_read(0x23C9));
+	next_frame(fresh);
+	REQUIRE(fresh.get_frame() == ppu.get_frame());
+
+	// Any scroll change misses every line
+	ppu.cpu_write(0x0005, 0x01);
+	ppu.cpu_write(0x0005, 0x00);
+	REQUIRE(next_frame(ppu).background_line_misses == 240);
+}
+
+/* Frame hashing */
+TEST_CASE("Incremental frame hash matches a full-frame pass", "[ppu][hash]")
+{
+	PPU ppu;
+	setup_scripted_scene(ppu);
+	ppu.set_frame_hashing(true);
+
+	uint64_t previous = 0;
+	for (int frame = 0; frame < 3; frame++)
+	{
+		run_scripted_frame(ppu, frame);
+		uint64_t hash = ppu.get_frame_hash();
+		REQUIRE(hash == hash_frame(ppu.get_frame().data(), ppu.get_frame_emphasis().data(), PPU::SCREEN_WIDTH, PPU::SCREEN_HEIGHT));
+		REQUIRE(hash != previous);
+		previous = hash;
+	}
+}
+
+TEST_CASE("Identical frames share a hash, any change breaks it", "[ppu][hash]")
+{
+	PPU ppu;
+	make_solid_tile(ppu, 0x0000);
+	ppu.ppu_write(0x2000 + 32 * 29 + 31, 0x01); // Bottom-right tile only
+	ppu.ppu_write(0x3F03, 0x16);
+	ppu.cpu_write(0x0001, 0x0A);
+	ppu.set_frame_hashing(true);
+
+	auto next_frame = [&]
+	{
+		run_until(ppu, 241, 1);
+		ppu.clock();
+		return ppu.get_frame_hash();
+	};
+
+	uint64_t first = next_frame();
+	REQUIRE(next_frame() == first); // Lag frame
+
+	ppu.ppu_write(0x3F03, 0x17); // Last pixel of the frame changes
+	uint64_t changed = next_frame();
+	REQUIRE(changed != first);
+
+	ppu.cpu_write(0x0001, 0x2A); // Same indices, emphasis on
+	REQUIRE(next_frame() != changed);
+}
+
+/* Tile decode */
+TEST_CASE("All tile decode paths match the scalar decoder", "[ppu][decode]")
+{
+	std::mt19937 rng(42);
+	std::array<uint8_t, 33> lo, hi, attribute;
+	for (int i = 0; i < 33; i++)
+	{
+		lo[i] = static_cast<uint8_t>(rng());
+		hi[i] = static_cast<uint8_t>(rng());
+		attribute[i] = static_cast<uint8_t>(rng() & 0xFC);
+	}
+
+	DecodePath original = get_decode_path();
+	REQUIRE(set_decode_path(DecodePath::SCALAR));
+	std::array<uint8_t, 33 * 8> expected;
+	decode_tile_rows(lo.data(), hi.data(), attribute.data(), 33, expected.data());
+
+	for (DecodePath path : {DecodePath::SSE2, DecodePath::BMI2, DecodePath::AVX2})
+	{
+		if (!set_decode_path(path))
+			continue;
+		// Odd counts exercise the tail handling of the vector paths
+		for (int count : {1, 3, 8, 33})
+		{
+			std::array<uint8_t, 33 * 8> pixels{};
+			decode_tile_rows(lo.data(), hi.data(), attribute.data(), count, pixels.data());
+			INFO(decode_path_name(path) << " count " << count);
+			REQUIRE(std::equal(pixels.begin(), pixels.begin() + count * 8, expected.begin()));
+		}
+	}
+	set_decode_path(original);
+}
+
+TEST_CASE("Tile decode puts bit 7 leftmost and keeps transparent pixels zero", "[ppu][decode]")
+{
+	uint8_t lo = 0x81, hi = 0x80, attribute = 0x0C;
+	std::array<uint8_t, 8> pixels;
+	decode_tile_rows(&lo, &hi, &attribute, 1, pixels.data());
+
+	REQUIRE(pixels[0] == 0x0F);
+	REQUIRE(pixels[1] == 0x00);
+	REQUIRE(pixels[7] == 0x0D);
+}
+
+/* CHR cache */
+TEST_CASE("CHR-RAM writes invalidate the decoded tile", "[ppu][chr_cache]")
+{
+	PPU ppu;
+	make_solid_tile(ppu, 0x0000);
+	ppu.ppu_write(0x2000, 0x01);
+	ppu.ppu_write(0x3F03, 0x16);
+	ppu.ppu_write(0x3F01, 0x2A);
+	ppu.cpu_write(0x0001, 0x0A);
+
+	run_until(ppu, 241, 1);
+	uint32_t solid = ppu.get_frame()[0];
+
+	// Clear the high plane of tile 1 row 0 through PPUDATA: pixel value 3 becomes 1
+	ppu.cpu_write(0x0001, 0x00);
+	set_address(ppu, 0x0018);
+	ppu.cpu_write(0x0007, 0x00);
+	set_address(ppu, 0x0000); // Restore the scroll
+	ppu.cpu_write(0x0001, 0x0A);
+
+	ppu.clock();
+	run_until(ppu, 241, 1);
+	REQUIRE(ppu.get_frame()[0] != solid);
+	REQUIRE(ppu.get_frame()[PPU::SCREEN_WIDTH] == solid);
+
+	auto stats = ppu.get_stats().chr_cache;
+	REQUIRE(stats.invalidations == 1);
+	REQUIRE(stats.misses == 3); // Tiles 0 and 1, then tile 1 again
+	REQUIRE(stats.hits > 0);
+	REQUIRE(stats.memory_bytes >= 512 * 64);
+}
+
+/* Frame conversion */
+TEST_CASE("Frame conversion paths match the scalar conversion", "[ppu][convert]")
+{
+	constexpr int W = PPU::SCREEN_WIDTH, H = 8;
+	std::mt19937 rng(7);
+	std::array<uint8_t, W * H> indices;
+	std::array<uint8_t, H> emphasis;
+	for (auto &i : indices)
+		i = static_cast<uint8_t>(rng() & 0x3F);
+	for (auto &e : emphasis)
+		e = static_cast<uint8_t>(rng() & 0x07);
+
+	SimdPath original = get_kernel_path(Kernel::FRAME_CONVERT);
+	REQUIRE(set_kernel_path(Kernel::FRAME_CONVERT, SimdPath::SCALAR));
+	std::vector<uint32_t> rgba(W * H);
+	std::vector<uint16_t> rgb565(W * H);
+	std::vector<uint8_t> y(W * H), u(W * H / 4), v(W * H / 4);
+	convert_rgba8888(indices.data(), emphasis.data(), W, H, rgba.data());
+	convert_rgb565(indices.data(), emphasis.data(), W, H, rgb565.data());
+	convert_yuv420(indices.data(), emphasis.data(), W, H, y.data(), u.data(), v.data());
+
+	if (set_kernel_path(Kernel::FRAME_CONVERT, SimdPath::AVX2))
+	{
+		std::vector<uint32_t> rgba2(W * H);
+		std::vector<uint16_t> rgb5652(W * H);
+		std::vector<uint8_t> y2(W * H), u2(W * H / 4), v2(W * H / 4);
+		convert_rgba8888(indices.data(), emphasis.data(), W, H, rgba2.data());
+		convert_rgb565(indices.data(), emphasis.data(), W, H, rgb5652.data());
+		convert_yuv420(indices.data(), emphasis.data(), W, H, y2.data(), u2.data(), v2.data());
+
+		REQUIRE(rgba == rgba2);
+		REQUIRE(rgb565 == rgb5652);
+		REQUIRE(y == y2);
+		REQUIRE(u == u2);
+		REQUIRE(v == v2);
+	}
+	set_kernel_path(Kernel::FRAME_CONVERT, original);
+
+	REQUIRE(rgba[0] == palette_rgba(indices[0], emphasis[0]));
+}
+
+TEST_CASE("Forcing the tile decode path leaves frame conversion alone", "[ppu][convert]")
+{
+	SimdPath decode = get_decode_path();
+	SimdPath convert = get_kernel_path(Kernel::FRAME_CONVERT);
+	for (SimdPath path : {SimdPath::SCALAR, SimdPath::SSE2, SimdPath::BMI2})
+	{
+		if (set_decode_path(path))
+			REQUIRE(get_kernel_path(Kernel::FRAME_CONVERT) == convert);
+	}
+	REQUIRE_FALSE(set_kernel_path(Kernel::FRAME_CONVERT, SimdPath::BMI2)); // No such kernel
+	REQUIRE(get_kernel_path(Kernel::FRAME_CONVERT) == convert);
+	set_decode_path(decode);
+}
+
+TEST_CASE("Colour emphasis darkens the other channels", "[ppu][convert]")
+{
+	uint32_t plain = palette_rgba(0x30, 0x00);
+	uint32_t red = palette_rgba(0x30, 0x01);
+
+	REQUIRE((red & 0xFF) == (plain & 0xFF));
+	REQUIRE(((red >> 8) & 0xFF) < ((plain >> 8) & 0xFF));
+	REQUIRE(palette_rgba(0x0F, 0x07) == palette_rgba(0x0F, 0x00));
+}
+
+/* Bus */
+TEST_CASE("OAM DMA copies a CPU page into OAM", "[ppu][bus][dma]")
+{
+	Bus bus;
+	for (uint16_t i = 0; i < 256; i++)
+		bus.write(0x0300 + i, static_cast<uint8_t>(i ^ 0x5A));
+
+	bus.write(0x2003, 0x00);
+	bus.write(0x4014, 0x03);
+
+	REQUIRE(bus.ppu.oam[0x00] == 0x5A);
+	REQUIRE(bus.ppu.oam[0xFF] == (0xFF ^ 0x5A));
+}
+
+TEST_CASE("PPU registers are mirrored through $3FFF", "[ppu][bus]")
+{
+	Bus bus;
+	bus.write(0x3FFE, 0x21); // $2006
+	bus.write(0x3FFE, 0x00);
+	bus.write(0x2007, 0x77);
+
+	REQUIRE(bus.ppu.ppu_read(0x2100) == 0x77);
+}
@@ -0,0 +1,146 @@
+#include "catch_amalgamated.hpp"
+#include "core/y4m_recorder.h"
+#include "core/frame_convert.h"
+#include "core/ppu.h"
+#include "core/audio_recorder.h"
+#include "core/apu.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static std::string temp_path(const char *suffix)
+{
+	return "/tmp/nes_test_" + std::to_string(getpid()) + "_" + suffix;
+}
+
+static std::vector<uint8_t> read_file(const std::string &path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("Y4M recorder writes every frame in order", "[recorder]")
+{
+	const int width = PPU::SCREEN_WIDTH, height = PPU::SCREEN_HEIGHT;
+	const int frames = 40;
+	std::string path = temp_path("video.y4m");
+
+	// A tiny queue so the producer has to wait on the encoder
+	Y4mRecorder recorder(2);
+	REQUIRE(recorder.open(path));
+
+	std::vector<uint8_t> indices(width * height);
+	std::vector<uint8_t> emphasis(height, 0);
+	for (int frame = 0; frame < frames; frame++)
+	{
+		for (int i = 0; i < width * height; i++)
+			indices[i] = static_cast<uint8_t>((i + frame) & 0x3F);
+		emphasis[0] = static_cast<uint8_t>(frame & 0x07);
+		recorder.push_frame(indices.data(), emphasis.data());
+	}
+	recorder.close();
+	REQUIRE(recorder.get_stats().frames_written == frames);
+	REQUIRE_FALSE(recorder.get_stats().write_error);
+
+	std::vector<uint8_t> file = read_file(path);
+	std::remove(path.c_str());
+
+	std::string header = "YUV4MPEG2 W256 H240 F39375000:655171 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n";
+	REQUIRE(std::string(file.begin(), file.begin() + header.size()) == header);
+
+	const size_t frame_size = 6 + width * height * 3 / 2;
+	REQUIRE(file.size() == header.size() + frames * frame_size);
+
+	// Last frame matches a direct conversion
+	std::vector<uint8_t> y(width * height), u(width * height / 4), v(width * height / 4);
+	convert_yuv420(indices.data(), emphasis.data(), width, height, y.data(), u.data(), v.data());
+	const uint8_t *last = file.data() + header.size() + (frames - 1) * frame_size;
+	REQUIRE(std::string(last, last + 6) == "FRAME\n");
+	REQUIRE(std::vector<uint8_t>(last + 6, last + 6 + y.size()) == y);
+	REQUIRE(std::vector<uint8_t>(last + 6 + y.size(), last + 6 + y.size() + u.size()) == u);
+	REQUIRE(std::vector<uint8_t>(last + 6 + y.size() + u.size(), last + frame_size) == v);
+}
+
+TEST_CASE("Y4M recorder fails to open an unwritable path", "[recorder]")
+{
+	Y4mRecorder recorder;
+	REQUIRE_FALSE(recorder.open("/nonexistent/dir/video.y4m"));
+	REQUIRE_FALSE(recorder.is_open());
+	uint8_t frame[PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT] = {};
+	uint8_t emphasis[PPU::SCREEN_HEIGHT] = {};
+	recorder.push_frame(frame, emphasis); // Ignored
+}
+
+static uint32_t get32(const uint8_t *in)
+{
+	return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+TEST_CASE("Audio recorder writes a complete WAV file through a small pool", "[recorder][audio]")
+{
+	std::string path = temp_path("audio.wav");
+
+	// Two tiny buffers, so the producer has to wait on the writer
+	AudioRecorder recorder(2, 256);
+	REQUIRE(recorder.open(path, 48000));
+
+	std::vector<int16_t> samples(100000);
+	for (size_t i = 0; i < samples.size(); i++)
+		samples[i] = static_cast<int16_t>(i * 7);
+	for (size_t i = 0; i < samples.size(); i += 333)
+		recorder.push_samples(samples.data() + i, static_cast<int>(std::min<size_t>(333, samples.size() - i)));
+	recorder.close();
+
+	AudioRecorder::Stats stats = recorder.get_stats();
+	REQUIRE(stats.samples_written == samples.size());
+	REQUIRE_FALSE(stats.write_error);
+
+	std::vector<uint8_t> file = read_file(path);
+	std::remove(path.c_str());
+	REQUIRE(file.size() == 44 + samples.size() * 2);
+	REQUIRE(std::string(file.begin(), file.begin() + 4) == "RIFF");
+	REQUIRE(get32(&file[4]) == file.size() - 8);
+	REQUIRE(std::string(file.begin() + 8, file.begin() + 16) == "WAVEfmt ");
+	REQUIRE(get32(&file[24]) == 48000);
+	REQUIRE(get32(&file[40]) == samples.size() * 2);
+	REQUIRE(std::memcmp(file.data() + 44, samples.data(), samples.size() * 2) == 0);
+}
+
+TEST_CASE("Audio recorder captures the APU at its native rate", "[recorder][audio]")
+{
+	std::string path = temp_path("audio.raw");
+	const uint32_t native = static_cast<uint32_t>(APU::CLOCK_RATE);
+
+	APU apu;
+	apu.set_sample_rate(native);
+	apu.cpu_write(0, 0x4015, 0x01);
+	apu.cpu_write(0, 0x4000, 0xBF);
+	apu.cpu_write(0, 0x4002, 0xFD);
+	apu.cpu_write(0, 0x4003, 0x00);
+
+	AudioRecorder recorder;
+	REQUIRE(recorder.open(path, native, AudioRecorder::Format::RAW));
+	for (int frame = 1; frame <= 3; frame++)
+	{
+		apu.end_frame(frame * 29781);
+		recorder.push(apu);
+	}
+	recorder.close();
+
+	// One sample per CPU cycle
+	std::vector<uint8_t> file = read_file(path);
+	std::remove(path.c_str());
+	REQUIRE(file.size() / 2 == Catch::Approx(3 * 29781).margin(2));
+	REQUIRE(recorder.get_stats().samples_written == file.size() / 2);
+
+	int16_t peak = 0;
+	for (size_t i = 0; i + 1 < file.size(); i += 2)
+		peak = std::max<int16_t>(peak, static_cast<int16_t>(file[i] | (file[i + 1] << 8)));
+	REQUIRE(peak > 1000);
+}
@@ -0,0 +1,228 @@
+#include "catch_amalgamated.hpp"
+#include "core/shm_ring.h"
+#include "core/ppu.h"
+#include "core/frame_renderer.h"
+#include "core/apu.h"
+#include "core/audio_output.h"
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static std::string ring_name(const char *suffix)
+{
+	return "/nes_test_" + std::to_string(getpid()) + "_" + suffix;
+}
+
+TEST_CASE("Published slots are visible to a second mapping", "[shm_ring]")
+{
+	ShmRing producer, consumer;
+	std::string name = ring_name("basic");
+	REQUIRE(producer.create(name, 4, 64));
+	REQUIRE(consumer.open(name));
+	REQUIRE(consumer.get_slot_count() == 4);
+	REQUIRE(consumer.get_published() == 0);
+
+	uint32_t size;
+	uint64_t tag;
+	REQUIRE(consumer.acquire(0, size, tag) == nullptr);
+
+	std::memcpy(producer.begin_write(), "frame", 5);
+	producer.commit(5, 42);
+	REQUIRE(consumer.get_published() == 1);
+
+	const uint8_t *data = consumer.acquire(0, size, tag);
+	REQUIRE(data != nullptr);
+	REQUIRE(size == 5);
+	REQUIRE(tag == 42);
+	REQUIRE(std::memcmp(data, "frame", 5) == 0);
+	REQUIRE(consumer.validate(0));
+}
+
+TEST_CASE("A lapped consumer finds old sequences gone", "[shm_ring]")
+{
+	ShmRing producer, consumer;
+	std::string name = ring_name("lapped");
+	REQUIRE(producer.create(name, 4, 8));
+	REQUIRE(consumer.open(name));
+
+	for (uint64_t i = 0; i < 6; i++)
+	{
+		producer.begin_write()[0] = static_cast<uint8_t>(i);
+		producer.commit(1, i);
+	}
+
+	uint32_t size;
+	uint64_t tag;
+	REQUIRE(consumer.acquire(1, size, tag) == nullptr); // Overwritten by 5
+	REQUIRE_FALSE(consumer.validate(1));
+	for (uint64_t i = 2; i < 6; i++)
+	{
+		const uint8_t *data = consumer.acquire(i, size, tag);
+		REQUIRE(data != nullptr);
+		REQUIRE(data[0] == i);
+	}
+	REQUIRE(consumer.acquire(6, size, tag) == nullptr); // Not published yet
+
+	// A slot being rewritten no longer validates
+	producer.begin_write();
+	REQUIRE(consumer.acquire(2, size, tag) == nullptr);
+	REQUIRE_FALSE(consumer.validate(2));
+}
+
+TEST_CASE("Validated reads are never torn while the producer runs ahead", "[shm_ring]")
+{
+	ShmRing producer, consumer;
+	std::string name = ring_name("torn");
+	const uint32_t slot_size = 4096;
+	REQUIRE(producer.create(name, 3, slot_size));
+	REQUIRE(consumer.open(name));
+
+	std::atomic<bool> done = false;
+	std::thread writer([&]
+	{
+		for (uint64_t i = 0; i < 20000; i++)
+		{
+			std::memset(producer.begin_write(), static_cast<int>(i & 0xFF), slot_size);
+			producer.commit(slot_size, i);
+		}
+		done = true;
+	});
+
+	// Keeps reading until one full pass after the writer finished
+	uint64_t accepted = 0, torn = 0;
+	for (bool finished = false; !finished;)
+	{
+		finished = done;
+		uint64_t published = consumer.get_published();
+		if (published == 0)
+			continue;
+
+		uint64_t sequence = published - 1;
+		uint32_t size;
+		uint64_t tag;
+		const uint8_t *data = consumer.acquire(sequence, size, tag);
+		if (!data)
+			continue;
+
+		bool uniform = true;
+		for (uint32_t i = 0; i < size; i++)
+			uniform = uniform && data[i] == static_cast<uint8_t>(sequence & 0xFF);
+		if (!consumer.validate(sequence))
+			continue;
+		accepted++;
+		torn += !uniform;
+	}
+	writer.join();
+
+	REQUIRE(accepted > 0);
+	REQUIRE(torn == 0);
+}
+
+TEST_CASE("The PPU publishes composed frames into the ring", "[shm_ring][ppu]")
+{
+	ShmRing producer, consumer;
+	std::string name = ring_name("frames");
+	REQUIRE(producer.create(name, 2, SHM_FRAME_SIZE));
+	REQUIRE(consumer.open(name));
+
+	PPU ppu;
+	ppu.ppu_write(0x3F00, 0x21);
+	ppu.cpu_write(0x0001, 0x48); // Background on, green emphasis
+	ppu.set_frame_ring(&producer);
+	ppu.set_frame_skip(1);
+	for (int frame = 0; frame < 3; frame++)
+	{
+		ppu.frame_complete = false;
+		while (!ppu.frame_complete)
+			ppu.clock();
+	}
+
+	// Frame 1 was skipped and never published
+	REQUIRE(consumer.get_published() == 2);
+	uint32_t size;
+	uint64_t tag;
+	const uint8_t *data = consumer.acquire(1, size, tag);
+	REQUIRE(data != nullptr);
+	REQUIRE(size == SHM_FRAME_SIZE);
+	REQUIRE(tag == 2);
+	REQUIRE(data[0] == 0x21);
+	REQUIRE(data[PPU::SCREEN_WIDTH * PPU::SCREEN_HEIGHT] == 0x02);
+	REQUIRE(consumer.validate(1));
+}
+
+TEST_CASE("The deferred renderer publishes frames into the ring", "[shm_ring][ppu]")
+{
+	ShmRing producer, consumer;
+	std::string name = ring_name("deferred");
+	REQUIRE(producer.create(name, 4, SHM_FRAME_SIZE));
+	REQUIRE(consumer.open(name));
+
+	FrameRenderer renderer(1, 2);
+	renderer.set_frame_ring(&producer);
+	PPU ppu;
+	ppu.ppu_write(0x3F00, 0x21);
+	ppu.cpu_write(0x0001, 0x48);
+	ppu.set_deferred_renderer(&renderer);
+	for (int frame = 0; frame < 3; frame++)
+	{
+		ppu.frame_complete = false;
+		while (!ppu.frame_complete)
+			ppu.clock();
+	}
+	renderer.flush();
+
+	// Tagged with the PPU's frame numbers, like inline publishing
+	REQUIRE(consumer.get_published() == 3);
+	uint32_t size;
+	uint64_t tag;
+	const uint8_t *data = consumer.acquire(2, size, tag);
+	REQUIRE(data != nullptr);
+	REQUIRE(tag == 2);
+	REQUIRE(data[0] == 0x21);
+	REQUIRE(consumer.validate(2));
+}
+
+TEST_CASE("Audio output publishes its sample blocks into the ring", "[shm_ring][audio]")
+{
+	ShmRing producer, consumer;
+	std::string name = ring_name("audio");
+	REQUIRE(producer.create(name, 16, 512 * sizeof(int16_t)));
+	REQUIRE(consumer.open(name));
+
+	APU apu;
+	apu.cpu_write(0, 0x4015, 0x01);
+	apu.cpu_write(0, 0x4000, 0xBF);
+	apu.cpu_write(0, 0x4002, 0xFD);
+	apu.cpu_write(0, 0x4003, 0x00);
+	AudioOutput output;
+	output.set_shm_ring(&producer);
+	for (int frame = 1; frame <= 3; frame++)
+	{
+		apu.end_frame(frame * 29781);
+		output.push(apu);
+	}
+
+	// The shared ring carries the same samples as the output ring, in 512 sample slots
+	std::vector<int16_t> expected(output.get_ring().fill());
+	output.get_ring().read(expected.data(), static_cast<int>(expected.size()));
+	REQUIRE(expected.size() > 2000);
+
+	std::vector<int16_t> published;
+	for (uint64_t sequence = 0; sequence < consumer.get_published(); sequence++)
+	{
+		uint32_t size;
+		uint64_t tag;
+		const uint8_t *data = consumer.acquire(sequence, size, tag);
+		REQUIRE(data != nullptr);
+		REQUIRE(size <= 512 * sizeof(int16_t));
+		REQUIRE(tag == published.size());
+		const int16_t *samples = reinterpret_cast<const int16_t *>(data);
+		published.insert(published.end(), samples, samples + size / sizeof(int16_t));
+		REQUIRE(consumer.validate(sequence));
+	}
+	REQUIRE(published == expected);
+}